@@ -0,0 +1,63 @@
+/***************************************************************************
+Copyright © 2023 Shell M. Shrader <shell at shellware dot com>
+----------------------------------------------------------------------------
+This work is free. You can redistribute it and/or modify it under the
+terms of the Do What The Fuck You Want To Public License, Version 2,
+as published by Sam Hocevar. See the COPYING file for more details.
+****************************************************************************/
+#ifndef ADAPTIVE_SAMPLER_H
+#define ADAPTIVE_SAMPLER_H
+
+#include <stdint.h>
+
+#define ADAPTIVE_CHANNELS              3        // temperature, pressure, humidity
+#define ADAPTIVE_HOLD_SAMPLES          3        // flat samples before backing off
+#define ADAPTIVE_SMOOTHING             0.25     // ew weight of the newest rate / residual
+
+// per channel activity thresholds in reading units (milli-C, milli-hPa, milli-%)
+#define ADAPTIVE_TEMPERATURE_RATE      20.0     // per second, ~1.2 C/min
+#define ADAPTIVE_TEMPERATURE_DEVIATION 100.0
+#define ADAPTIVE_PRESSURE_RATE         20.0     // per second, a door or hvac surge
+#define ADAPTIVE_PRESSURE_DEVIATION    30.0
+#define ADAPTIVE_HUMIDITY_RATE         100.0    // per second, ~6 %/min
+#define ADAPTIVE_HUMIDITY_DEVIATION    500.0
+
+typedef struct adaptive_channel_type {
+    float         rate_threshold;
+    float         deviation_threshold;
+    int32_t       previous;
+    float         rate;             // ew smoothed |dx/dt| per second
+    float         mean;
+    float         variance;         // ew variance around mean
+} ADAPTIVE_CHANNEL_TYPE;
+
+// Picks the next sample interval from how much the channels are moving.
+// Any channel whose smoothed rate of change or deviation crosses its
+// threshold drops the interval straight to the minimum; once readings
+// have been flat for ADAPTIVE_HOLD_SAMPLES the interval doubles on every
+// further flat sample up to the maximum.  No Arduino dependencies, so a
+// recorded trace can be replayed through it on the host.
+class AdaptiveSampler {
+    public:
+        AdaptiveSampler();
+        void     configure(uint32_t minInterval, uint32_t maxInterval, uint32_t startInterval);
+        void     setThresholds(uint8_t channel, float rate, float deviation);
+        void     reset();
+        uint32_t update(const int32_t values[ADAPTIVE_CHANNELS], uint32_t timestamp);
+        uint32_t getInterval() const;
+        float    getActivity() const;
+        bool     isActive() const;
+
+    protected:
+        ADAPTIVE_CHANNEL_TYPE channels[ADAPTIVE_CHANNELS];
+        uint32_t min_interval;
+        uint32_t max_interval;
+        uint32_t start_interval;
+        uint32_t interval;
+        uint32_t last_timestamp;
+        float    activity;
+        uint8_t  flat_samples;
+        bool     primed;
+};
+
+#endif
@@ -0,0 +1,72 @@
+/***************************************************************************
+Copyright © 2023 Shell M. Shrader <shell at shellware dot com>
+----------------------------------------------------------------------------
+This work is free. You can redistribute it and/or modify it under the
+terms of the Do What The Fuck You Want To Public License, Version 2,
+as published by Sam Hocevar. See the COPYING file for more details.
+****************************************************************************/
+#ifndef BME280_SENSOR_H
+#define BME280_SENSOR_H
+
+#include <Adafruit_BME280.h>
+
+#define BME280_I2C_CLOCK               400000
+#define BME280_DEFAULT_SPI_CLOCK       10000000
+#define BME280_MAX_SPI_CLOCK           10000000
+#define BME280_FORCED_TIMEOUT          2000     // ms, matches takeForcedMeasurement()
+#define BME280_CHIP_ID                 0x60
+
+// one compensated reading in the integer units SAMPLES_TYPE accumulates
+typedef struct bme280_reading_type {
+    long          temperature;      // milli-C
+    long          pressure;         // milli-hPa
+    long          humidity;         // milli-%
+} BME280_READING_TYPE;
+
+// Adafruit_BME280 with an SPI clock we control and a single burst read of
+// the eight data registers (0xF7-0xFE) compensated with the datasheet
+// integer formulas.  The stock readTemperature/readPressure/readHumidity
+// path re-reads temperature for every channel, tripling bus traffic.
+class BME280Sensor : public Adafruit_BME280 {
+    public:
+        bool          beginSPI(int8_t csPin, uint32_t clock, SPIClass* theSPI = &SPI);
+        bool          resume(uint8_t addr, TwoWire* theWire = &Wire);
+        bool          resumeSPI(int8_t csPin, uint32_t clock, SPIClass* theSPI = &SPI);
+        void          resumeForced(sensor_sampling tempSampling, sensor_sampling pressSampling,
+                                   sensor_sampling humSampling, sensor_filter filter);
+        bool          isSPI();
+        void          reset();
+        void          configure(sensor_mode mode, sensor_sampling tempSampling, sensor_sampling pressSampling,
+                                sensor_sampling humSampling, sensor_filter filter, standby_duration duration);
+        bool          isForced();
+        bool          startForcedMeasurement();
+        bool          isMeasuring();
+        uint32_t      getMeasurementMicros();
+        uint32_t      getStandbyMicros();
+        bool          readSample(BME280_READING_TYPE* reading);
+        unsigned long getBusMicros();
+
+        static uint32_t measurementMicros(sensor_sampling tempSampling, sensor_sampling pressSampling, sensor_sampling humSampling);
+        static uint32_t standbyMicros(standby_duration duration);
+        static int8_t   samplingFromFactor(long factor);
+        static uint8_t  factorFromSampling(sensor_sampling sampling);
+        static int8_t   filterFromCoefficient(long coefficient);
+        static uint8_t  coefficientFromFilter(sensor_filter filter);
+        static int8_t   standbyFromMillis(float millis);
+        static float    millisFromStandby(standby_duration duration);
+
+    protected:
+        bool          attach();
+        bool          readDataRegisters(uint8_t* buffer, size_t len);
+        int32_t       compensateTemperature(int32_t adc_T);
+        uint32_t      compensatePressure(int32_t adc_P);
+        uint32_t      compensateHumidity(int32_t adc_H);
+        unsigned long busMicros = 0;
+        sensor_mode      sensorMode = MODE_NORMAL;
+        sensor_sampling  osrsT      = SAMPLING_X16;
+        sensor_sampling  osrsP      = SAMPLING_X16;
+        sensor_sampling  osrsH      = SAMPLING_X16;
+        standby_duration standby    = STANDBY_MS_0_5;
+};
+
+#endif
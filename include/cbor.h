@@ -0,0 +1,36 @@
+/***************************************************************************
+Copyright © 2023 Shell M. Shrader <shell at shellware dot com>
+----------------------------------------------------------------------------
+This work is free. You can redistribute it and/or modify it under the
+terms of the Do What The Fuck You Want To Public License, Version 2,
+as published by Sam Hocevar. See the COPYING file for more details.
+****************************************************************************/
+#ifndef CBOR_H
+#define CBOR_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+// minimal RFC 8949 encoder for integers, arrays and maps into a caller
+// supplied buffer.  Writes past the end are dropped and flagged, so a
+// record can be encoded unconditionally and checked once at the end.
+class CborWriter {
+    public:
+        CborWriter(uint8_t* buffer, size_t capacity);
+        void   writeUnsigned(uint32_t value);
+        void   writeInt(int32_t value);
+        void   beginArray(size_t items);
+        void   beginMap(size_t pairs);
+        size_t length() const;
+        bool   overflowed() const;
+
+    protected:
+        void   writeHead(uint8_t major, uint32_t value);
+        void   put(uint8_t value);
+        uint8_t* buf;
+        size_t   cap;
+        size_t   len;
+        bool     overflow;
+};
+
+#endif
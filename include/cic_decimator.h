@@ -0,0 +1,89 @@
+/***************************************************************************
+Copyright © 2023 Shell M. Shrader <shell at shellware dot com>
+----------------------------------------------------------------------------
+This work is free. You can redistribute it and/or modify it under the
+terms of the Do What The Fuck You Want To Public License, Version 2,
+as published by Sam Hocevar. See the COPYING file for more details.
+****************************************************************************/
+#ifndef CIC_DECIMATOR_H
+#define CIC_DECIMATOR_H
+
+#include <stdint.h>
+
+#define CIC_ORDER                      3
+
+// keeps input bits + ORDER * log2(ratio) inside the int64 registers for
+// 21 bit milli-unit inputs (milli-hPa tops out near 1.1e6)
+#define CIC_MAX_RATIO                  16384
+
+// Cascaded integrator-comb decimator: ORDER integrators run at the input
+// rate, ORDER combs at the output rate, and the R^ORDER gain is divided
+// out so outputs stay in input units.  Integer only, fixed footprint and
+// wrap-around safe -- two's complement overflow in the integrators
+// cancels in the combs as long as the output fits in 64 bits.
+template <uint8_t ORDER = CIC_ORDER>
+class CicDecimator {
+    public:
+        CicDecimator() {
+            setRatio(1);
+        }
+
+        void setRatio(uint32_t decimation) {
+            ratio = decimation < 1 ? 1 : (decimation > CIC_MAX_RATIO ? CIC_MAX_RATIO : decimation);
+            gain = 1;
+            for (uint8_t i = 0; i < ORDER; i++) gain *= ratio;
+            reset();
+        }
+
+        uint32_t getRatio() {
+            return ratio;
+        }
+
+        void reset() {
+            for (uint8_t i = 0; i < ORDER; i++) {
+                integrators[i] = 0;
+                delays[i] = 0;
+            }
+            phase = 0;
+            warmup = ORDER - 1;
+        }
+
+        // returns true (and sets out) once every ratio inputs, after the
+        // first ORDER - 1 outputs which only cover part of the impulse response
+        bool push(int32_t in, int32_t* out) {
+            uint64_t acc = (uint64_t) (int64_t) in;
+            for (uint8_t i = 0; i < ORDER; i++) {
+                integrators[i] += acc;
+                acc = integrators[i];
+            }
+
+            if (++phase < ratio) return false;
+            phase = 0;
+
+            for (uint8_t i = 0; i < ORDER; i++) {
+                const uint64_t prev = delays[i];
+                delays[i] = acc;
+                acc -= prev;
+            }
+
+            if (warmup > 0) {
+                warmup--;
+                return false;
+            }
+
+            // round half away from zero
+            const int64_t value = (int64_t) acc;
+            *out = (int32_t) ((value + (value < 0 ? -gain / 2 : gain / 2)) / gain);
+            return true;
+        }
+
+    protected:
+        uint64_t integrators[ORDER];
+        uint64_t delays[ORDER];
+        uint32_t ratio;
+        uint32_t phase;
+        int64_t  gain;
+        uint8_t  warmup;
+};
+
+#endif
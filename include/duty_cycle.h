@@ -0,0 +1,71 @@
+/***************************************************************************
+Copyright © 2023 Shell M. Shrader <shell at shellware dot com>
+----------------------------------------------------------------------------
+This work is free. You can redistribute it and/or modify it under the
+terms of the Do What The Fuck You Want To Public License, Version 2,
+as published by Sam Hocevar. See the COPYING file for more details.
+****************************************************************************/
+#ifndef DUTY_CYCLE_H
+#define DUTY_CYCLE_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#define DUTY_CYCLE_MAGIC               0x42323830   // "B280"
+#define DUTY_CYCLE_MIN_SLEEP           100          // ms
+#define DUTY_CYCLE_CONNECT_TIMEOUT     15000        // ms to wait for wifi + mqtt before giving up on a publish
+#define DUTY_CYCLE_SETUP_WINDOW        60000        // ms a cold boot stays up so the setup page is reachable
+
+// rough d1 mini figures -- only used for the estimate in the per cycle log
+#define DUTY_CYCLE_AWAKE_MA            20.0         // cpu + sensor, radio off
+#define DUTY_CYCLE_RADIO_MA            75.0         // wifi associated
+#define DUTY_CYCLE_SLEEP_MA            0.02
+
+enum duty_cycle_action {
+    DUTY_CYCLE_SAMPLE,                              // read the sensors with the radio off
+    DUTY_CYCLE_PUBLISH                              // full boot, wifi + mqtt
+};
+
+// must lead any retained block; the crc covers the whole block
+typedef struct duty_cycle_state_type {
+    uint32_t      magic;
+    uint32_t      length;
+    uint32_t      crc;
+    uint32_t      clock;            // ms since the first cold boot, advanced by every wake + sleep
+    uint32_t      wakes;
+    uint32_t      last_calibration; // clock of the last sea level calibration
+    float         charge;           // mA*ms drawn since the first cold boot
+    uint32_t      quiet_awake;      // ms awake over the radio-off wakes since the last radio wake
+    uint16_t      quiet_wakes;
+    uint8_t       next_action;
+} DUTY_CYCLE_STATE_TYPE;
+
+// Sleep / wake scheduling for battery nodes.  Works on a caller owned
+// state block and caller supplied durations -- no clocks or hardware are
+// touched -- so a simulated sleep/wake sequence can be driven on the host.
+class DutyCycle {
+    public:
+        void     configure(uint32_t sampleInterval, uint8_t samplesPerPublish);
+        void     begin(DUTY_CYCLE_STATE_TYPE* retained, bool restored);
+        duty_cycle_action getAction() const;
+        uint32_t sleep(uint32_t awake, uint32_t radio, uint16_t samplesHeld);
+        uint32_t getClock() const;
+        float    getCycleCurrent() const;
+        float    getAverageCurrent() const;
+        uint16_t getQuietWakes() const;
+        uint32_t getQuietAwake() const;
+
+        static uint32_t crc32(const uint8_t* data, size_t length);
+        static void     seal(void* block, size_t length);
+        static bool     verify(void* block, size_t length);
+
+    protected:
+        DUTY_CYCLE_STATE_TYPE* state = nullptr;
+        uint32_t sample_interval     = 0;
+        uint8_t  samples_per_publish = 0;
+        float    cycle_current       = 0;
+        uint16_t quiet_wakes         = 0;   // radio-off wakes folded into the last radio wake
+        uint32_t quiet_awake         = 0;
+};
+
+#endif
@@ -0,0 +1,92 @@
+/***************************************************************************
+Copyright © 2023 Shell M. Shrader <shell at shellware dot com>
+----------------------------------------------------------------------------
+This work is free. You can redistribute it and/or modify it under the
+terms of the Do What The Fuck You Want To Public License, Version 2,
+as published by Sam Hocevar. See the COPYING file for more details.
+****************************************************************************/
+#ifndef INFLUX_EXPORTER_H
+#define INFLUX_EXPORTER_H
+
+#include <Arduino.h>
+#include <WiFiClient.h>
+#include <WiFiUdp.h>
+#include <time.h>
+
+#include "window.h"
+
+#define INFLUX_BATCH_LEN               1400     // one unfragmented udp datagram
+#define INFLUX_LINE_LEN                512
+#define INFLUX_BATCH_WINDOWS           3
+#define INFLUX_OUTBOX_DEPTH            2        // full batches waiting on handle()
+#define INFLUX_MAX_RETRIES             3
+#define INFLUX_RETRY_DELAY             2000
+#define INFLUX_TIMEOUT                 750
+#define INFLUX_UDP_PORT                8089
+#define INFLUX_HTTP_PORT               8086
+#define INFLUX_MEASUREMENT             "bme280"
+
+// Formats completed windows as InfluxDB line protocol into a fixed batch
+// buffer and ships the batch as a single udp datagram, or as an HTTP POST
+// to /write?db=<database> when a database is configured.  addWindow() only
+// formats; a full batch moves to the outbox queue and handle() sends the
+// oldest one, making at most one bounded attempt per call and backing off
+// between retries.  Untimestamped lines are stamped by the server on
+// arrival, so handle() ships them with the rest of their pass in one send.
+// Lines count as dropped once INFLUX_MAX_RETRIES attempts have failed, or
+// when a line arrives with the batch and every outbox still full.
+// Connect and reply are capped at INFLUX_TIMEOUT, and so is the lookup on
+// the esp8266; the resolved address is cached until a send fails.
+class InfluxExporter {
+    public:
+        InfluxExporter();
+        void     begin(const char* serverHost, uint16_t serverPort, const char* databaseName, const char* hostTag);
+        void     end();
+        bool     isStarted();
+        bool     addWindow(const WINDOW_TYPE& window, time_t epoch);
+        bool     handle();
+        uint32_t getLinesSent();
+        uint32_t getBytesSent();
+        uint32_t getLinesDropped();
+        uint32_t getFormatMicros();
+        uint32_t getSendMillis();
+        float    getLinesPerSecond();
+
+    protected:
+        size_t   formatLine(char* line, size_t capacity, const WINDOW_TYPE& window, time_t epoch);
+        bool     send();
+        bool     sendUdp();
+        bool     sendHttp();
+        bool     resolve();
+        bool     queueBatch();
+        void     resetBatch();
+        void     resetOutbox();
+        void     popOutbox();
+        WiFiUDP  udp;
+        const char* server;
+        const char* database;
+        const char* host;
+        IPAddress serverIp;
+        bool     resolved;
+        uint16_t port;
+        bool     started;
+        char     batch[INFLUX_BATCH_LEN];      // filling
+        size_t   batchLen;
+        uint16_t batchLines;
+        bool     batchUnstamped;
+        char     outbox[INFLUX_OUTBOX_DEPTH][INFLUX_BATCH_LEN];    // waiting on handle()
+        size_t   outboxLen[INFLUX_OUTBOX_DEPTH];
+        uint16_t outboxLines[INFLUX_OUTBOX_DEPTH];
+        uint8_t  outboxHead;
+        uint8_t  outboxCount;
+        uint8_t  retries;
+        unsigned long retryRef;
+        unsigned long startedRef;
+        uint32_t linesSent;
+        uint32_t bytesSent;
+        uint32_t linesDropped;
+        uint32_t formatMicros;
+        uint32_t sendMillis;
+};
+
+#endif
@@ -9,9 +9,22 @@ as published by Sam Hocevar. See the COPYING file for more details.
 #include <Adafruit_BME280.h>
 #include <ArduinoHA.h>
 
+#include "window.h"
+#include "cbor.h"
+#include "influx_exporter.h"
+#include "bme280_sensor.h"
+#include "cic_decimator.h"
+#include "stream_estimator.h"
+#include "adaptive_sampler.h"
+#include "duty_cycle.h"
+#include "nws_stations.h"
+#include "sea_level.h"
+#include "window_history.h"
+
 #ifdef esp32
     #include <WiFiClientSecure.h>
     #include <ArduinoJson.h>
+    #include <esp_sleep.h>
 #else
     #include <ESP8266HTTPClient.h>
     #include <WiFiClientSecureBearSSL.h>
@@ -35,6 +48,29 @@ as published by Sam Hocevar. See the COPYING file for more details.
 #define PUBLISH_INTERVAL               "publish_interval"
 #define PUBLISH_INTERVAL_IN_SECONDS    "publish_interval_in_seconds"
 #define NWS_STATION                    "nws_station"
+#define MQTT_RAW_TOPIC                 "mqtt_raw_topic"
+#define INFLUX_SERVER                  "influx_server"
+#define INFLUX_PORT                    "influx_port"
+#define INFLUX_DB                      "influx_db"
+#define SPI_CS_PIN                     "spi_cs_pin"
+#define SPI_CLOCK                      "spi_clock"
+#define OSRS_TEMPERATURE               "osrs_temperature"
+#define OSRS_PRESSURE                  "osrs_pressure"
+#define OSRS_HUMIDITY                  "osrs_humidity"
+#define IIR_FILTER                     "iir_filter"
+#define STANDBY_TIME                   "standby_ms"
+#define SENSOR_MODE                    "sensor_mode"
+#define HIGH_RATE_PERIOD               "high_rate_period"
+#define MQTT_FAST_TOPIC                "mqtt_fast_topic"
+#define ESTIMATOR                      "estimator"
+#define EMA_ALPHA                      "ema_alpha"
+#define KALMAN_Q                       "kalman_q"
+#define KALMAN_R                       "kalman_r"
+#define ADAPTIVE_MIN_INTERVAL          "adaptive_min_ms"
+#define ADAPTIVE_MAX_INTERVAL          "adaptive_max_ms"
+#define DEEP_SLEEP                     "deep_sleep"
+#define RADIO_SLEEP                    "radio_sleep"
+#define STATION_ELEVATION              "station_elevation"
 
 #define TEMPERATURE                    "temperature"
 #define HUMIDITY                       "humidity"
@@ -43,18 +79,72 @@ as published by Sam Hocevar. See the COPYING file for more details.
 #define _RSSI                          "rssi"
 #define SEA_LEVEL_ATMOSPHERIC_PRESSURE "sea_level_atmospheric_pressure"
 #define IP_ADDRESS                     "ip_address"
+#define SAMPLE_RATE                    "sample_rate"
 
 #define MQTT_SERVER_LEN                16
 #define MQTT_USER_LEN                  16
 #define MQTT_PWD_LEN                   32
-#define NWS_STATION_LEN                6
+#define NWS_STATION_LEN                48       // comma separated, in order of preference
+#define MQTT_RAW_TOPIC_LEN             64
+#define INFLUX_SERVER_LEN              32
+#define INFLUX_DB_LEN                  16
+#define MQTT_FAST_TOPIC_LEN            64
 
 #define DEFAULT_SAMPLES_PER_PUBLISH    3
 #define DEFAULT_PUBLISH_INTERVAL       60000
 
+#define DEFAULT_OVERSAMPLING           Adafruit_BME280::SAMPLING_X16
+#define DEFAULT_IIR_FILTER             Adafruit_BME280::FILTER_OFF
+#define DEFAULT_STANDBY                Adafruit_BME280::STANDBY_MS_0_5
+
 #define MIN_SAMPLES_PER_PUBLISH        3
 #define MIN_PUBLISH_INTERVAL           1000
 
+// adaptive windows close on time; cap their size so the long sums cannot overflow
+#define MAX_WINDOW_SAMPLES             1000
+
+// longest single idle between loop passes while the radio sleeps
+#define RADIO_SLEEP_MAX_IDLE           1000
+// ... and while the serial mirror has a backlog or a telnet session is open,
+// since TelnetSpy only moves data from loop()
+#define RADIO_SLEEP_SERVICE_IDLE       20
+
+enum radio_sleep_mode {
+    RADIO_SLEEP_OFF,
+    RADIO_SLEEP_MODEM,
+    RADIO_SLEEP_LIGHT
+};
+
+// indexed by radio_sleep_mode
+const char* const RADIO_SLEEP_NAMES[] = { "off", "modem", "light" };
+
+// telnet log record tags, indexed by log_subsystem
+enum log_subsystem {
+    SUBSYSTEM_SYSTEM,
+    SUBSYSTEM_SENSOR,
+    SUBSYSTEM_MQTT,
+    SUBSYSTEM_INFLUX,
+    SUBSYSTEM_NWS,
+    SUBSYSTEM_POWER
+};
+
+const char* const LOG_SUBSYSTEM_NAMES[] = { "sys", "sensor", "mqtt", "influx", "nws", "power" };
+
+// tags the next logged line; level is ERROR, WARN, INFO or DEBUG
+#ifdef BS_USE_TELNETSPY
+    #define LOG_TAG(level, subsystem) SerialAndTelnet.setRecordTag(TELNETSPY_LEVEL_##level, subsystem)
+#else
+    #define LOG_TAG(level, subsystem)
+#endif
+
+// printf style line for hot paths: the format stays in flash and the telnet log
+// stores only the raw arguments, formatting them when a client reads the line
+#ifdef BS_USE_TELNETSPY
+    #define LOG_DEFERF(format, ...) SerialAndTelnet.printDeferred(PSTR(format), ##__VA_ARGS__)
+#else
+    #define LOG_DEFERF(format, ...) LOG_PRINTF(format, ##__VA_ARGS__)
+#endif
+
 typedef struct bme280_config_type : config_type {
     tiny_int      mqtt_server_flag;
     char          mqtt_server[MQTT_SERVER_LEN];
@@ -68,12 +158,57 @@ typedef struct bme280_config_type : config_type {
     unsigned long publish_interval;
     tiny_int      nws_station_flag;
     char          nws_station[NWS_STATION_LEN];
+    tiny_int      mqtt_raw_topic_flag;
+    char          mqtt_raw_topic[MQTT_RAW_TOPIC_LEN];
+    tiny_int      influx_server_flag;
+    char          influx_server[INFLUX_SERVER_LEN];
+    tiny_int      influx_port_flag;
+    unsigned short influx_port;
+    tiny_int      influx_db_flag;
+    char          influx_db[INFLUX_DB_LEN];
+    tiny_int      spi_cs_pin_flag;
+    tiny_int      spi_cs_pin;
+    tiny_int      spi_clock_flag;
+    unsigned long spi_clock;
+    tiny_int      osrs_temperature_flag;
+    tiny_int      osrs_temperature;
+    tiny_int      osrs_pressure_flag;
+    tiny_int      osrs_pressure;
+    tiny_int      osrs_humidity_flag;
+    tiny_int      osrs_humidity;
+    tiny_int      iir_filter_flag;
+    tiny_int      iir_filter;
+    tiny_int      standby_flag;
+    tiny_int      standby;
+    tiny_int      sensor_mode_flag;
+    tiny_int      sensor_mode;
+    tiny_int      high_rate_period_flag;
+    unsigned short high_rate_period;
+    tiny_int      mqtt_fast_topic_flag;
+    char          mqtt_fast_topic[MQTT_FAST_TOPIC_LEN];
+    tiny_int      estimator_flag;
+    tiny_int      estimator;
+    tiny_int      ema_alpha_flag;
+    float         ema_alpha;
+    tiny_int      kalman_q_flag;
+    float         kalman_q;
+    tiny_int      kalman_r_flag;
+    float         kalman_r;
+    tiny_int      adaptive_min_interval_flag;
+    unsigned long adaptive_min_interval;
+    tiny_int      adaptive_max_interval_flag;
+    unsigned long adaptive_max_interval;
+    tiny_int      deep_sleep_flag;
+    tiny_int      radio_sleep_flag;
+    tiny_int      radio_sleep;
+    tiny_int      station_elevation_flag;
+    float         station_elevation;
 } BME280_CONFIG_TYPE;
 
 typedef struct samples_type {
     long          temperature               = 0;
     long          humidity                  = 0;
-    long          altitude                  = 0;
+    int64_t       altitude                  = 0;    // MAX_WINDOW_SAMPLES of mm overflow a long above ~2147 m
     long          pressure                  = 0;
     long          rssi                      = 0;
     long          high_temperature          = LONG_MIN;
@@ -87,49 +222,305 @@ typedef struct samples_type {
     long          low_pressure              = LONG_MAX;
     long          low_rssi                  = LONG_MAX;
     short         sample_count              = 0;
-    unsigned long last_update               = ULONG_MAX;
-    unsigned long last_pressure_calibration = ULONG_MAX;
 } SAMPLES_TYPE;
 
+// the window itself -- every sample tick counts here whether or not a sensor
+// read, so one failing sensor cannot hold up the others or the device sensors
+typedef struct window_ticks_type {
+    long          rssi                      = 0;
+    long          high_rssi                 = LONG_MIN;
+    long          low_rssi                  = LONG_MAX;
+    short         sample_count              = 0;
+} WINDOW_TICKS_TYPE;
+
+// seq(0) uptime ms(1) count(2) then [avg, low, high] for temperature(3)
+// humidity(4) pressure(5) altitude(6) rssi(7) and the sensor index(8)
+#define RAW_WINDOW_MAP_PAIRS           9
+#define RAW_WINDOW_MAX_LEN             96
+
+// a streaming estimate reuses the raw window keys with scalar values:
+// uptime ms(1) temperature(3) humidity(4) pressure(5) altitude(6) sensor(8)
+#define FAST_SAMPLE_MAP_PAIRS          6
+#define FAST_SAMPLE_MAX_LEN            40
+
+// an spi sensor (when a chip select is configured) takes the first pipeline;
+// a second i2c bus is only probed on esp32 when its pins are configured
+#if defined esp32 && defined BME280_WIRE1_SDA && defined BME280_WIRE1_SCL
+    #define SENSOR_BUS_COUNT           2
+#else
+    #define SENSOR_BUS_COUNT           1
+#endif
+
+#define SENSOR_ADDRESS_COUNT           2
+#define MAX_SENSOR_PIPELINES           (SENSOR_BUS_COUNT * SENSOR_ADDRESS_COUNT + 1)
+
+TwoWire* const SENSOR_BUSES[SENSOR_BUS_COUNT] = {
+    &Wire,
+#if SENSOR_BUS_COUNT > 1
+    &Wire1,
+#endif
+};
+
+// the library default (0x77) is probed first so a single sensor keeps pipeline 0
+const uint8_t SENSOR_ADDRESSES[SENSOR_ADDRESS_COUNT] = { BME280_ADDRESS, BME280_ADDRESS_ALTERNATE };
+
 BME280_CONFIG_TYPE bme280_config;
-SAMPLES_TYPE       samples;
+unsigned long      last_update               = ULONG_MAX;
+unsigned long      last_pressure_calibration = ULONG_MAX;
+unsigned long      window_sequence           = 0;
+unsigned long      measurement_budget        = 0;
+unsigned long      conversion_start          = 0;
+bool               conversion_pending        = false;
+unsigned long      high_rate_period          = 0;
+unsigned long      next_high_rate_sample     = 0;
+estimator_mode     streaming_mode            = ESTIMATOR_OFF;
+unsigned long      sample_interval           = DEFAULT_PUBLISH_INTERVAL / DEFAULT_SAMPLES_PER_PUBLISH;
+unsigned long      window_start              = 0;
+WINDOW_TICKS_TYPE  window_ticks;
+unsigned long      warmup_interval           = 0;                   // back-to-back cadence until the first publish, 0 once done
+bool               adaptive_sampling         = false;
+AdaptiveSampler    adaptive;
 
-const float  getSeaLevelPressure();
-const bool   isNumeric(const String str);
-const String toFloatStr(const float value, const short decimal_places);
-const bool   isSampleValid(const float value);
-const String escParam(const char *param_name);
-void         printHeapStats();
+// pressure noise is tracked on the first pipeline only
+typedef struct high_rate_stats_type {
+    unsigned long raw_samples               = 0;
+    unsigned long outputs                   = 0;
+    unsigned long overruns                  = 0;
+    unsigned long filter_micros             = 0;
+    unsigned long window_start              = 0;
+    double        raw_sum                   = 0;
+    double        raw_sum_sq                = 0;
+    double        out_sum                   = 0;
+    double        out_sum_sq                = 0;
+} HIGH_RATE_STATS_TYPE;
 
-Adafruit_BME280  bme; // use I2C interface
-Adafruit_Sensor* bme_temp = bme.getTemperatureSensor();
-Adafruit_Sensor* bme_pressure = bme.getPressureSensor();
-Adafruit_Sensor* bme_humidity = bme.getHumiditySensor();
+HIGH_RATE_STATS_TYPE high_rate_stats;
+InfluxExporter     influx;
 
 const float HPA_TO_INHG                  = 0.02952998057228486;
 const float DEFAULT_SEALEVELPRESSURE_HPA = 1013.25;
 const float INVALID_SEALEVELPRESSURE_HPA = SHRT_MIN;
 float SEALEVELPRESSURE_HPA               = DEFAULT_SEALEVELPRESSURE_HPA;
 
-HADevice device;
-WiFiClient wifiClient;
-HAMqtt mqtt(wifiClient, device, 10);
+// the last hypsometric reduction from a configured station elevation
+float local_sea_level_hpa                = INVALID_SEALEVELPRESSURE_HPA;
+NwsStations nwsStations;
+
+// nws refresh while it is the sea level source, and while it only cross-checks the local value
+#define NWS_CALIBRATION_INTERVAL       300000
+#define NWS_CROSS_CHECK_INTERVAL       3600000
 
 byte deviceId[40];
 char deviceName[40];
 
-char tempSensorName[80];
-char humidSensorName[80];
-char presSensorName[80];
-char altSensorName[80];
-char rssiSensorName[80];
-char seaLevelPresSensorName[80];
-char ipAddressSensorName[80];
-
-HASensorNumber* tempSensor;
-HASensorNumber* humidSensor;
-HASensorNumber* presSensor;
-HASensorNumber* altSensor;
-HASensorNumber* rssiSensor;
-HASensorNumber* seaLevelPresSensor;
-HASensor* ipAddressSensor;
+// channels of a BME280_READING_TYPE that get filtered sample by sample
+enum reading_channel {
+    READING_TEMPERATURE,
+    READING_PRESSURE,
+    READING_HUMIDITY,
+    READING_CHANNELS
+};
+
+enum sensor_channel {
+    TEMPERATURE_CHANNEL,
+    HUMIDITY_CHANNEL,
+    PRESSURE_CHANNEL,
+    ALTITUDE_CHANNEL,
+    RSSI_CHANNEL,
+    SEA_LEVEL_PRESSURE_CHANNEL,
+    SAMPLE_RATE_CHANNEL,
+    DUTY_CYCLE_CHANNEL,
+    SENSOR_CHANNELS
+};
+
+// channels before RSSI_CHANNEL are published once per sensor pipeline,
+// the remainder once per device
+#define PIPELINE_CHANNELS              RSSI_CHANNEL
+#define DEVICE_CHANNELS                (SENSOR_CHANNELS - PIPELINE_CHANNELS)
+#define HA_NUMBER_SENSORS              (MAX_SENSOR_PIPELINES * PIPELINE_CHANNELS + DEVICE_CHANNELS)
+#define HA_DEVICE_TYPES                (HA_NUMBER_SENSORS + 1)
+
+typedef struct sensor_descriptor_type {
+    const char*                     suffix;
+    const char*                     device_class;
+    const char*                     name;
+    const char*                     unit;
+    HASensorNumber::NumberPrecision precision;
+    const char*                     icon;
+} SENSOR_DESCRIPTOR_TYPE;
+
+// one row per published channel, indexed by sensor_channel
+// (suffixes are part of the HA unique id -- do not "fix" the humdity typo)
+constexpr SENSOR_DESCRIPTOR_TYPE SENSOR_DESCRIPTORS[SENSOR_CHANNELS] = {
+    { "_temperature_sensor",        "temperature",          "Temperature",         "F",    HASensorNumber::PrecisionP1, nullptr },
+    { "_humdity_sensor",            "humidity",             "Humidity",            "%",    HASensorNumber::PrecisionP0, nullptr },
+    { "_pressure_sensor",           "atmospheric_pressure", "Barometer",           "inHg", HASensorNumber::PrecisionP2, nullptr },
+    { "_altitude_sensor",           nullptr,                "Altitude",            "M",    HASensorNumber::PrecisionP1, "mdi:waves-arrow-up" },
+    { "_rssi_sensor",               "signal_strength",      "rssi",                "dB",   HASensorNumber::PrecisionP0, nullptr },
+    { "_sea_level_pressure_sensor", "atmospheric_pressure", "Sea Level Barometer", "inHg", HASensorNumber::PrecisionP2, nullptr },
+    { "_sample_rate_sensor",        nullptr,                "Sample Rate",         "/min", HASensorNumber::PrecisionP1, "mdi:speedometer" },
+    { "_duty_cycle_sensor",         nullptr,                "Duty Cycle",          "%",    HASensorNumber::PrecisionP1, "mdi:sleep" },
+};
+
+constexpr SENSOR_DESCRIPTOR_TYPE IP_ADDRESS_DESCRIPTOR = { "_ip_address_sensor", nullptr, "IP Address", nullptr, HASensorNumber::PrecisionP0, "mdi:ip" };
+
+constexpr size_t constStrLen(const char* str) {
+    return *str ? 1 + constStrLen(str + 1) : 0;
+}
+
+constexpr size_t sensorSuffixesLen(const size_t channel, const size_t channels) {
+    return channel == channels ? 0 : constStrLen(SENSOR_DESCRIPTORS[channel].suffix) + sensorSuffixesLen(channel + 1, channels);
+}
+
+constexpr size_t sensorNamesLen(const size_t channel, const size_t channels) {
+    return channel == channels ? 0 : constStrLen(SENSOR_DESCRIPTORS[channel].name) + sensorNamesLen(channel + 1, channels);
+}
+
+// every unique id is "<deviceName>[_<n>]<suffix>\0" packed back to back;
+// pipelines after the first also need a "<name> <n>\0" display name
+constexpr size_t SENSOR_NAME_ARENA_LEN = (HA_NUMBER_SENSORS + 1) * sizeof(deviceName) +
+                                         sensorSuffixesLen(0, SENSOR_CHANNELS) + constStrLen(IP_ADDRESS_DESCRIPTOR.suffix) +
+                                         (MAX_SENSOR_PIPELINES - 1) * (sensorSuffixesLen(0, PIPELINE_CHANNELS) + PIPELINE_CHANNELS * 2 +
+                                                                       sensorNamesLen(0, PIPELINE_CHANNELS) + PIPELINE_CHANNELS * 3);
+
+char   sensorNameArena[SENSOR_NAME_ARENA_LEN];
+size_t sensorNameArenaUsed = 0;
+
+// sensors are placement constructed in setup() once the hostname is known
+alignas(HASensorNumber) byte sensorStorage[HA_NUMBER_SENSORS][sizeof(HASensorNumber)];
+alignas(HASensor)       byte ipAddressSensorStorage[sizeof(HASensor)];
+tiny_int                     sensorStorageUsed = 0;
+
+typedef struct sensor_pipeline_type {
+    BME280Sensor     bme;
+    TwoWire*         bus                        = nullptr;     // nullptr when on spi
+    uint8_t          address                    = 0;           // chip select pin when on spi
+    SAMPLES_TYPE     samples;
+    BME280_READING_TYPE last_reading            = {};
+    float            final_temperature          = 0.0;
+    float            final_humidity             = 0.0;
+    float            final_altitude             = 0.0;
+    float            final_pressure             = 0.0;
+    float            stream_temperature         = 0.0;
+    float            stream_humidity            = 0.0;
+    float            stream_altitude            = 0.0;
+    float            stream_pressure            = 0.0;
+    HASensorNumber*  sensors[PIPELINE_CHANNELS];
+    CicDecimator<>   decimators[READING_CHANNELS];
+    StreamEstimator  estimators[READING_CHANNELS];
+} SENSOR_PIPELINE_TYPE;
+
+SENSOR_PIPELINE_TYPE pipelines[MAX_SENSOR_PIPELINES];
+tiny_int             pipeline_count = 0;
+
+#define SENSOR_BUS_SPI                 0xFF
+
+// everything a radio-off sample wake needs without Bootstrap's config, the
+// window accumulated so far and the last published readings.  Lives in rtc
+// memory across deep sleep and warm reboots (ota, watchdog, exceptions).
+typedef struct retained_state_type {
+    DUTY_CYCLE_STATE_TYPE cycle;                      // must stay first -- carries the crc
+    float          sea_level_hpa;
+    unsigned long  sample_interval;
+    unsigned long  spi_clock;
+    uint32_t       mqtt_server_ip;                    // resolved broker, skips dns on the next publish wake
+    unsigned long  calibration_age;                   // ms since the sea level fetch, ULONG_MAX if never
+    unsigned long  window_age;                        // ms since the window in samples opened
+    float          final_values[MAX_SENSOR_PIPELINES][PIPELINE_CHANNELS];
+    short          last_rssi;
+    short          final_rssi;
+    bool           snapshot_valid;
+    bool           deep_sleep;                        // sealed by a deep sleep build, so sample wakes are expected
+    tiny_int       samples_per_publish;
+    tiny_int       osrs_temperature;
+    tiny_int       osrs_pressure;
+    tiny_int       osrs_humidity;
+    tiny_int       iir_filter;
+    tiny_int       pipeline_count;
+    uint8_t        pipeline_bus[MAX_SENSOR_PIPELINES]; // SENSOR_BUS_SPI for the spi sensor
+    uint8_t        pipeline_address[MAX_SENSOR_PIPELINES];
+    uint8_t        wifi_channel;
+    uint8_t        wifi_bssid[6];
+    WINDOW_TICKS_TYPE window_ticks;
+    SAMPLES_TYPE   samples[MAX_SENSOR_PIPELINES];
+} RETAINED_STATE_TYPE;
+
+#ifdef esp32
+    // raw words so no constructor clears it on wake
+    RTC_NOINIT_ATTR uint32_t rtcRetained[(sizeof(RETAINED_STATE_TYPE) + 3) / 4];
+#else
+    // the first 128 bytes of user rtc memory belong to eboot (ota)
+    #define RTC_RETAINED_OFFSET        32
+    #define RTC_RETAINED_LEN           384
+    static_assert(sizeof(RETAINED_STATE_TYPE) <= RTC_RETAINED_LEN, "retained state does not fit in rtc user memory");
+#endif
+
+RETAINED_STATE_TYPE retained;
+DutyCycle           dutyCycle;
+bool                deep_sleep                = false;
+bool                snapshot_pending          = false;
+radio_sleep_mode    radio_sleep               = RADIO_SLEEP_OFF;
+unsigned long       radio_idle_millis         = 0;
+bool                cycle_sampled             = false;
+
+// completed windows for /api/history; async_tcp serves it from another task on the esp32
+WindowHistory       history;
+#ifdef esp32
+    SemaphoreHandle_t history_mutex;
+#endif
+
+HASensorNumber* deviceSensors[DEVICE_CHANNELS];
+HASensor*       ipAddressSensor;
+
+HADevice device;
+WiFiClient wifiClient;
+HAMqtt mqtt(wifiClient, device, HA_DEVICE_TYPES);
+
+const float  getSeaLevelPressure();
+const bool   fetchObservation(const char* station, NWS_OBSERVATION_TYPE* observation);
+void         logNwsStations();
+void         deriveSeaLevelPressure(const SAMPLES_TYPE& samples);
+void         crossCheckSeaLevel();
+const bool   hasSeaLevelSource();
+const bool   isNumeric(const String str);
+const String toFloatStr(const float value, const short decimal_places);
+const bool   isSampleValid(const float value);
+const float  pressureToAltitude(const long pressure);
+const String escParam(const char *param_name);
+const char*  packSensorName(const char* suffix, const tiny_int pipeline);
+const char*  packSensorLabel(const char* name, const tiny_int pipeline);
+HASensorNumber* createSensor(const SENSOR_DESCRIPTOR_TYPE& descriptor, const tiny_int pipeline);
+tiny_int     discoverSensors();
+void         configureSensors();
+void         collectSamples(const unsigned long sysmillis);
+void         collectHighRateSample(const unsigned long sysmillis);
+void         publishIfWindowComplete(const unsigned long sysmillis);
+const bool   isWindowComplete(const unsigned long sysmillis);
+const unsigned long currentSampleInterval();
+void         logHighRateStats(const unsigned long sysmillis);
+void         samplePipeline(SENSOR_PIPELINE_TYPE& pipeline, const long currentRssi);
+void         updateEstimators(SENSOR_PIPELINE_TYPE& pipeline, const BME280_READING_TYPE& reading);
+void         publishStreamingEstimates(const unsigned long sysmillis);
+void         publishFastSample(const SENSOR_PIPELINE_TYPE& pipeline, const tiny_int index, const unsigned long sysmillis);
+void         countWindowTick(const long currentRssi);
+void         accumulateReading(SENSOR_PIPELINE_TYPE& pipeline, const BME280_READING_TYPE& reading, const long currentRssi);
+void         publishPipeline(SENSOR_PIPELINE_TYPE& pipeline, const tiny_int index, const unsigned long sysmillis);
+void         publishRawWindow(const WINDOW_TYPE& window);
+void         lockHistory();
+void         unlockHistory();
+void         handleHistoryRequest(AsyncWebServerRequest* request);
+void         printHeapStats();
+const bool   loadRetainedState();
+void         saveRetainedState();
+void         saveRetainedWindow();
+void         restoreRetainedState();
+void         publishSnapshot();
+void         setPipelineValues(SENSOR_PIPELINE_TYPE& pipeline);
+const bool   isDeepSleepWake();
+void         sampleWake();
+void         handleDutyCycle(const unsigned long sysmillis);
+void         takeForcedSample(const long currentRssi);
+void         enterDeepSleep(const unsigned long radioMillis);
+void         calibrateSeaLevel(const unsigned long sysmillis);
+void         idleUntilNextEvent();
+void         setRadioSleep(const bool sleep);
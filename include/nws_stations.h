@@ -0,0 +1,71 @@
+/***************************************************************************
+Copyright © 2023 Shell M. Shrader <shell at shellware dot com>
+----------------------------------------------------------------------------
+This work is free. You can redistribute it and/or modify it under the
+terms of the Do What The Fuck You Want To Public License, Version 2,
+as published by Sam Hocevar. See the COPYING file for more details.
+****************************************************************************/
+#ifndef NWS_STATIONS_H
+#define NWS_STATIONS_H
+
+#include <stdint.h>
+
+#define NWS_MAX_STATIONS               6
+#define NWS_STATION_ID_LEN             8        // icao ids are 4, a few coops run longer
+
+// consecutive failures (errors or null readings) that open a station's breaker,
+// then how long it stays open -- doubling on every failed half-open retry
+#define NWS_BREAKER_THRESHOLD          2
+#define NWS_BREAKER_BASE_MS            600000UL     // 10 minutes
+#define NWS_BREAKER_MAX_MS             21600000UL   // 6 hours
+
+// an observation older than this (by the server's clock) sends us on to the next station
+#define NWS_MAX_OBSERVATION_AGE        5400         // seconds
+
+typedef struct nws_station_type {
+    char          id[NWS_STATION_ID_LEN];
+    uint16_t      attempts;
+    uint16_t      successes;
+    uint32_t      latency_total;    // ms over every attempt
+    uint32_t      last_latency;
+    uint8_t       failures;         // consecutive
+    uint32_t      opened_at;        // millis when the breaker last opened
+    uint32_t      open_for;         // ms, 0 while closed
+} NWS_STATION_TYPE;
+
+typedef struct nws_observation_type {
+    float         sea_level_hpa;
+    int32_t       observed;         // epoch seconds, 0 if unknown
+    int32_t       server_time;      // from the Date header, 0 if missing
+} NWS_OBSERVATION_TYPE;
+
+// Ordered list of NWS observation stations with a circuit breaker and
+// success / latency accounting per station.  A station that keeps failing
+// or reporting null is skipped until its breaker times out, then gets a
+// single half-open try.  No Arduino dependencies, so the breaker and the
+// timestamp parsing can be exercised on the host.
+class NwsStations {
+    public:
+        NwsStations();
+        uint8_t     parse(const char* list);
+        uint8_t     getCount() const;
+        const char* getId(uint8_t index) const;
+        bool        isAvailable(uint8_t index, uint32_t now) const;
+        uint32_t    getRetryIn(uint8_t index, uint32_t now) const;
+        void        recordSuccess(uint8_t index, uint32_t latency);
+        void        recordFailure(uint8_t index, uint32_t latency, uint32_t now);
+        uint8_t     getSuccessRate(uint8_t index) const;
+        uint32_t    getAverageLatency(uint8_t index) const;
+        uint32_t    getLatestLatency(uint8_t index) const;
+
+        static int32_t parseTimestamp(const char* iso);
+        static int32_t parseHttpDate(const char* date);
+
+    protected:
+        NWS_STATION_TYPE stations[NWS_MAX_STATIONS];
+        uint8_t          count;
+
+        static int32_t   toEpoch(int32_t year, uint8_t month, uint8_t day, uint8_t hour, uint8_t minute, uint8_t second);
+};
+
+#endif
@@ -0,0 +1,21 @@
+/***************************************************************************
+Copyright © 2023 Shell M. Shrader <shell at shellware dot com>
+----------------------------------------------------------------------------
+This work is free. You can redistribute it and/or modify it under the
+terms of the Do What The Fuck You Want To Public License, Version 2,
+as published by Sam Hocevar. See the COPYING file for more details.
+****************************************************************************/
+#ifndef SEA_LEVEL_H
+#define SEA_LEVEL_H
+
+#define STANDARD_GRAVITY               9.80665  // m/s^2
+#define DRY_AIR_GAS_CONSTANT           287.05   // J/(kg K)
+#define STANDARD_LAPSE_RATE            0.0065   // K/m
+
+// Reduces a station pressure to sea level from a configured elevation with
+// the hypsometric equation, taking the layer's mean temperature from the
+// station reading and the standard lapse rate.  No Arduino dependencies,
+// so it is checked against reference pressures on the host.
+float stationToSeaLevelPressure(float stationHpa, float celsius, float elevation);
+
+#endif
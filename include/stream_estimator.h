@@ -0,0 +1,51 @@
+/***************************************************************************
+Copyright © 2023 Shell M. Shrader <shell at shellware dot com>
+----------------------------------------------------------------------------
+This work is free. You can redistribute it and/or modify it under the
+terms of the Do What The Fuck You Want To Public License, Version 2,
+as published by Sam Hocevar. See the COPYING file for more details.
+****************************************************************************/
+#ifndef STREAM_ESTIMATOR_H
+#define STREAM_ESTIMATOR_H
+
+#include <stdint.h>
+
+#define DEFAULT_EMA_ALPHA              0.2
+#define DEFAULT_KALMAN_Q               1.0
+#define DEFAULT_KALMAN_R               100.0
+
+enum estimator_mode {
+    ESTIMATOR_OFF,
+    ESTIMATOR_EMA,
+    ESTIMATOR_KALMAN
+};
+
+// O(1) per sample smoother for one channel.  EMA blends each reading in
+// with a fixed alpha; the scalar Kalman filter models the channel as a
+// random walk with process noise q and measurement noise r.  Its gain
+// settles where K^2 / (1 - K) = q / r, so it converges to an EMA with an
+// alpha of about sqrt(q / r) when q is small next to r (q = 1, r = 100
+// settles at 0.095), but it trusts its first readings more.
+class StreamEstimator {
+    public:
+        void   configure(estimator_mode mode, float alpha, float q, float r);
+        void   reset();
+        float  update(float measurement);
+        float  getValue() const;
+        float  getVariance() const;
+        bool   isPrimed() const;
+
+        static const char* nameFromMode(estimator_mode mode);
+        static int8_t      modeFromName(const char* name);
+
+    protected:
+        estimator_mode mode     = ESTIMATOR_OFF;
+        float          alpha    = DEFAULT_EMA_ALPHA;
+        float          q        = DEFAULT_KALMAN_Q;
+        float          r        = DEFAULT_KALMAN_R;
+        float          estimate = 0;
+        float          variance = 0;
+        bool           primed   = false;
+};
+
+#endif
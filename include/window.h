@@ -0,0 +1,33 @@
+/***************************************************************************
+Copyright © 2023 Shell M. Shrader <shell at shellware dot com>
+----------------------------------------------------------------------------
+This work is free. You can redistribute it and/or modify it under the
+terms of the Do What The Fuck You Want To Public License, Version 2,
+as published by Sam Hocevar. See the COPYING file for more details.
+****************************************************************************/
+#ifndef WINDOW_H
+#define WINDOW_H
+
+#include <stdint.h>
+
+// a completed aggregation window in the same integer units SAMPLES_TYPE
+// accumulates (milli-C, milli-%, milli-hPa, millimeters and |dBm| for rssi)
+typedef struct window_channel_type {
+    long          average;
+    long          low;
+    long          high;
+} WINDOW_CHANNEL_TYPE;
+
+typedef struct window_type {
+    unsigned long       sequence;
+    uint8_t             sensor;
+    unsigned long       timestamp;
+    short               sample_count;
+    WINDOW_CHANNEL_TYPE temperature;
+    WINDOW_CHANNEL_TYPE humidity;
+    WINDOW_CHANNEL_TYPE pressure;
+    WINDOW_CHANNEL_TYPE altitude;
+    WINDOW_CHANNEL_TYPE rssi;
+} WINDOW_TYPE;
+
+#endif
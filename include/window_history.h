@@ -0,0 +1,94 @@
+/***************************************************************************
+Copyright © 2023 Shell M. Shrader <shell at shellware dot com>
+----------------------------------------------------------------------------
+This work is free. You can redistribute it and/or modify it under the
+terms of the Do What The Fuck You Want To Public License, Version 2,
+as published by Sam Hocevar. See the COPYING file for more details.
+****************************************************************************/
+#ifndef WINDOW_HISTORY_H
+#define WINDOW_HISTORY_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "window.h"
+
+// ring capacity in bytes; see README for entries per KB
+#ifndef WINDOW_HISTORY_SIZE
+  #ifdef esp32
+    #define WINDOW_HISTORY_SIZE        32768
+  #else
+    #define WINDOW_HISTORY_SIZE        8192
+  #endif
+#endif
+
+#define WINDOW_HISTORY_CHANNELS        5        // temperature, humidity, pressure, altitude, rssi
+#define WINDOW_HISTORY_ALL_CHANNELS    ((1 << WINDOW_HISTORY_CHANNELS) - 1)
+#define WINDOW_HISTORY_SENSOR_BITS     3
+#define WINDOW_HISTORY_MAX_ENTRY       96       // 18 varints of at most 5 bytes
+#define WINDOW_HISTORY_ROW_LEN         256      // one json row, or the preamble
+
+// decoder state: the last window decoded and where the next entry starts
+typedef struct window_history_cursor_type {
+    WINDOW_TYPE   window;
+    uint32_t      interval;         // ms between the last two windows
+    uint32_t      entry;            // absolute index of the next entry
+    size_t        pos;
+} WINDOW_HISTORY_CURSOR_TYPE;
+
+typedef enum {
+    HISTORY_QUERY_PREAMBLE,
+    HISTORY_QUERY_ROWS,
+    HISTORY_QUERY_CLOSE,
+    HISTORY_QUERY_DONE
+} history_query_stage;
+
+typedef struct window_history_query_type {
+    uint32_t      from;             // window timestamps (millis), inclusive
+    uint32_t      to;
+    uint32_t      now;
+    uint8_t       channels;         // bit i selects WINDOW_HISTORY_CHANNEL_NAMES[i]
+    uint8_t       stage;
+    uint32_t      rows;
+    WINDOW_HISTORY_CURSOR_TYPE cursor;
+} WINDOW_HISTORY_QUERY_TYPE;
+
+extern const char* const WINDOW_HISTORY_CHANNEL_NAMES[WINDOW_HISTORY_CHANNELS];
+
+// Fixed-size ring of completed windows.  Each entry is stored as zigzag
+// varints relative to the entry before it: the change in sample count and
+// timestamp interval, then per channel the change in average and in the
+// spread of low and high around it.  A minute of slowly moving weather
+// costs a byte or two per value.  The ring also keeps the decoded state
+// of the entry just before its oldest, so evicting needs no keyframes and
+// a query decodes forward from the tail with a single cursor.
+// readQuery() renders a query as json a chunk at a time, so a response
+// never holds more than one row.  No Arduino dependencies.
+class WindowHistory {
+    public:
+        WindowHistory();
+        void        clear();
+        void        push(const WINDOW_TYPE& window);
+        uint32_t    getCount() const;
+        size_t      getBytesUsed() const;
+        uint32_t    getEvicted() const;
+        void        first(WINDOW_HISTORY_CURSOR_TYPE& cursor) const;
+        bool        next(WINDOW_HISTORY_CURSOR_TYPE& cursor, WINDOW_TYPE& window) const;
+        void        beginQuery(WINDOW_HISTORY_QUERY_TYPE& query, uint32_t from, uint32_t to, uint8_t channels, uint32_t now) const;
+        size_t      readQuery(WINDOW_HISTORY_QUERY_TYPE& query, char* out, size_t capacity) const;
+        bool        isQueryDone(const WINDOW_HISTORY_QUERY_TYPE& query) const;
+
+        static uint8_t parseChannels(const char* list);
+
+    protected:
+        size_t      encode(const WINDOW_HISTORY_CURSOR_TYPE& previous, const WINDOW_TYPE& window, uint8_t* out) const;
+        void        decode(WINDOW_HISTORY_CURSOR_TYPE& cursor) const;
+        void        evict();
+        size_t      formatRow(WINDOW_HISTORY_QUERY_TYPE& query, char* row, size_t capacity) const;
+        uint8_t     ring[WINDOW_HISTORY_SIZE];
+        size_t      used;
+        WINDOW_HISTORY_CURSOR_TYPE oldest;   // state before the oldest entry
+        WINDOW_HISTORY_CURSOR_TYPE newest;   // state after the newest entry
+};
+
+#endif
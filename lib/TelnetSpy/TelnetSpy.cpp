@@ -24,6 +24,117 @@ extern "C" {
 
 static TelnetSpy* actualObject = NULL;
 
+static const uint8_t NVT_NOP[] = { 255, 241 };
+static const char LEVEL_NAMES[] = "EWID";
+static const char LEVEL_KEYS[] = "ewid";
+static const uint8_t DEFAULT_RECORD_TAG = TELNETSPY_LEVEL_INFO << 5;
+static const uint8_t NVT_NULL[] = { 0 };
+
+// Argument of a printf conversion as stored in a deferred record: integers as zigzag
+// varints, floating point as a size byte and a float (if it holds the value exactly)
+// or double, strings with their terminating zero, pointers as integers
+enum { DEFER_NONE, DEFER_SKIP, DEFER_INT, DEFER_LONG, DEFER_LLONG, DEFER_SIZE, DEFER_DOUBLE, DEFER_LDOUBLE, DEFER_STRING, DEFER_POINTER };
+
+// Reads the conversion following a '%' in a flash format: returns its length up to and
+// including the conversion character, the type of its argument and how many '*' (int)
+// arguments come first
+static uint8_t parseConversion(PGM_P spec, uint8_t& type, uint8_t& stars) {
+	uint8_t len = 0;
+	uint8_t longs = 0;
+	bool sized = false;
+	bool longDouble = false;
+	stars = 0;
+	for (;;) {
+		char c = pgm_read_byte(&spec[len++]);
+		switch (c) {
+			case '*': stars++; break;
+			case 'l': longs++; break;
+			case 'j': longs = 2; break;
+			case 'z': case 't': sized = true; break;
+			case 'L': longDouble = true; break;
+			case 'd': case 'i': case 'u': case 'o': case 'x': case 'X': case 'c':
+				type = (longs > 1) ? DEFER_LLONG : longs ? DEFER_LONG : sized ? DEFER_SIZE : DEFER_INT;
+				return len;
+			case 'f': case 'F': case 'e': case 'E': case 'g': case 'G': case 'a': case 'A':
+				type = longDouble ? DEFER_LDOUBLE : DEFER_DOUBLE;
+				return len;
+			case 's': type = DEFER_STRING; return len;
+			case 'p': type = DEFER_POINTER; return len;
+			case 'n': type = DEFER_SKIP; return len;
+			case '\0': type = DEFER_NONE; return len - 1;
+			default:
+				// flags, width, precision and 'h' go on, anything else ends it ("%%")
+				if (!strchr("-+ #0123456789.h", c)) {
+					type = DEFER_NONE;
+					return len;
+				}
+		}
+	}
+}
+
+static bool putDeferred(char* payload, uint16_t& len, const void* data, uint16_t size) {
+	if (len + size > TELNETSPY_RECORD_LINE_LEN) {
+		return false;
+	}
+	memcpy(&payload[len], data, size);
+	len += size;
+	return true;
+}
+
+static bool putVarint(char* payload, uint16_t& len, int64_t value) {
+	uint64_t zigzag = ((uint64_t) value << 1) ^ (uint64_t) (value >> 63);
+	uint8_t bytes[10];
+	uint8_t n = 0;
+	do {
+		bytes[n] = zigzag & 0x7F;
+		zigzag >>= 7;
+		bytes[n++] |= zigzag ? 0x80 : 0;
+	} while (zigzag);
+	return putDeferred(payload, len, bytes, n);
+}
+
+static bool getVarint(const uint8_t* payload, uint8_t len, uint8_t& at, int64_t& value) {
+	uint64_t zigzag = 0;
+	uint8_t shift = 0;
+	uint8_t b;
+	do {
+		if ((at >= len) || (shift > 63)) {
+			return false;
+		}
+		b = payload[at++];
+		zigzag |= (uint64_t) (b & 0x7F) << shift;
+		shift += 7;
+	} while (b & 0x80);
+	value = (int64_t) (zigzag >> 1) ^ -(int64_t) (zigzag & 1);
+	return true;
+}
+
+// Receive parser for the telnet NVT protocol (RFC854). Every received byte falls in
+// one class, and NVT_TRANSITIONS[state][class] gives the next state in the low nibble
+// and what to do with the byte in the high nibble.
+enum { NVT_DATA, NVT_IAC, NVT_OPTION, NVT_SB, NVT_SB_IAC, NVT_STATES };
+enum { NVT_C_DATA, NVT_C_IAC, NVT_C_SE, NVT_C_SB, NVT_C_WWDD, NVT_C_CMD, NVT_CLASSES };
+enum { NVT_A_SKIP = 0x00, NVT_A_KEEP = 0x10, NVT_A_COMMAND = 0x20, NVT_A_SAVE = 0x30, NVT_A_OPTION = 0x40 };
+
+// Class of the bytes 240 (SE) to 255 (IAC), everything below is data
+static const uint8_t NVT_CLASS[16] = {
+	NVT_C_SE,                                                // 240 SE
+	NVT_C_CMD, NVT_C_CMD, NVT_C_CMD, NVT_C_CMD, NVT_C_CMD,   // 241 NOP, DM, BRK, IP, AO
+	NVT_C_CMD, NVT_C_CMD, NVT_C_CMD, NVT_C_CMD,              // 246 AYT, EC, EL, GA
+	NVT_C_SB,                                                // 250 SB
+	NVT_C_WWDD, NVT_C_WWDD, NVT_C_WWDD, NVT_C_WWDD,          // 251 WILL, WON'T, DO, DON'T
+	NVT_C_IAC                                                // 255 IAC
+};
+
+static const uint8_t NVT_TRANSITIONS[NVT_STATES][NVT_CLASSES] = {
+	//           DATA                       IAC                         SE                      SB                      WWDD                        CMD
+	/* DATA   */ { NVT_DATA | NVT_A_KEEP,   NVT_IAC,                    NVT_DATA | NVT_A_KEEP,  NVT_DATA | NVT_A_KEEP,  NVT_DATA | NVT_A_KEEP,     NVT_DATA | NVT_A_KEEP },
+	/* IAC    */ { NVT_DATA,                NVT_DATA | NVT_A_KEEP,      NVT_DATA,               NVT_SB,                 NVT_OPTION | NVT_A_SAVE,    NVT_DATA | NVT_A_COMMAND },
+	/* OPTION */ { NVT_DATA | NVT_A_OPTION, NVT_DATA | NVT_A_OPTION,    NVT_DATA | NVT_A_OPTION, NVT_DATA | NVT_A_OPTION, NVT_DATA | NVT_A_OPTION, NVT_DATA | NVT_A_OPTION },
+	/* SB     */ { NVT_SB,                  NVT_SB_IAC,                 NVT_SB,                 NVT_SB,                 NVT_SB,                     NVT_SB },
+	/* SB_IAC */ { NVT_SB,                  NVT_SB,                     NVT_DATA,               NVT_SB,                 NVT_SB,                     NVT_SB }
+};
+
 
 static void TelnetSpy_putc(char c) {
 	if (NULL != actualObject) {
@@ -31,7 +142,7 @@ static void TelnetSpy_putc(char c) {
 	}
 }
 
-static void TelnetSpy_ignore_putc(char c) {;
+static void TelnetSpy_ignore_putc(char) {
 }
 
 TelnetSpy::TelnetSpy() {
@@ -42,7 +153,45 @@ TelnetSpy::TelnetSpy() {
 	firstMainLoop = true;
 	usedSer = &Serial;
 	storeOffline = true;
-	connected = false;
+	maxClients = TELNETSPY_MAX_CLIENTS;
+	activeClients = 0;
+	for (uint8_t i = 0; i < TELNETSPY_MAX_CLIENTS; i++) {
+		sessions[i].connected = false;
+		sessions[i].nvtDetected = false;
+		sessions[i].nvtState = NVT_DATA;
+		sessions[i].nvtCommand = 0;
+		sessions[i].cursor = 0;
+		sessions[i].dropped = 0;
+		sessions[i].waitRef = 0xFFFFFFFF;
+		sessions[i].pingRef = 0xFFFFFFFF;
+		sessions[i].cursorMillis = 0;
+		sessions[i].cursorTag = DEFAULT_RECORD_TAG;
+		sessions[i].recordOffset = 0;
+		sessions[i].maxLevel = TELNETSPY_LEVEL_DEBUG;
+		sessions[i].subsystems = 0xFFFFFFFF;
+		sessions[i].inCommand = false;
+		sessions[i].commandLen = 0;
+	}
+	recordMode = false;
+	recordTag = DEFAULT_RECORD_TAG;
+	lineLen = 0;
+	lastRecordMillis = 0;
+	lastRecordTag = DEFAULT_RECORD_TAG;
+	tailMillis = 0;
+	tailTag = DEFAULT_RECORD_TAG;
+	subsystemNames = NULL;
+	subsystemCount = 0;
+	serialMirror = TELNETSPY_MIRROR_SYNC;
+	serialReader.cursor = 0;
+	serialReader.dropped = 0;
+	serialReader.cursorMillis = 0;
+	serialReader.cursorTag = DEFAULT_RECORD_TAG;
+	serialReader.recordOffset = 0;
+	serialReader.maxLevel = TELNETSPY_LEVEL_DEBUG;
+	serialReader.subsystems = 0xFFFFFFFF;
+	serialStallMicros = 0;
+	serialStallStart = 0;
+	serialStalled = false;
 	callbackConnect = NULL;
 	callbackDisconnect = NULL;
     callbackNvtBRK = NULL;
@@ -62,11 +211,23 @@ TelnetSpy::TelnetSpy() {
 	collectingTime = TELNETSPY_COLLECTING_TIME;
 	maxBlockSize = TELNETSPY_MAX_BLOCK_SIZE;
 	pingTime = TELNETSPY_PING_TIME;
-	pingRef = 0xFFFFFFFF;
-	waitRef = 0xFFFFFFFF;
-    nvtDetected = false;
 	telnetBuf = NULL;
 	bufLen = 0;
+	bufMask = 0;
+	bufHead = 0;
+	bufTail = 0;
+	dbgHead = 0;
+	dbgTail = 0;
+	dbgDropped = 0;
+	lineHead = 0;
+	lineTail = 0;
+	droppedBytes = 0;
+	droppedLines = 0;
+	pendingDrop = 0;
+	partialWrites = 0;
+	sendStalls = 0;
+	lastHandleMicros = 0;
+	maxHandleMicros = 0;
 	uint16_t size = TELNETSPY_BUFFER_LEN;
 	while (!setBufferSize(size)) {
 		size = size >> 1;
@@ -96,15 +257,7 @@ TelnetSpy::~TelnetSpy() {
 void TelnetSpy::setPort(uint16_t portToUse) {
 	port = portToUse;
 	if (listening) {
-		if (client.connected()) {
-            sendBlock();
-			client.flush();
-			client.stop();
-		}
-		if (connected && (callbackDisconnect != NULL)) {
-			callbackDisconnect();
-		}
-		connected = false;
+		disconnectClient();
 		telnetServer->close();
 		delete telnetServer;
 		telnetServer = new WiFiServer(port);
@@ -156,11 +309,9 @@ void TelnetSpy::setMaxBlockSize(uint16_t maxSize) {
 }
 
 bool TelnetSpy::setBufferSize(uint16_t newSize) {
-	if (telnetBuf && (bufLen == newSize)) {
-		return true;
-	}
 	if (newSize == 0) {
 		bufLen = 0;
+		bufMask = 0;
 		if (telnetBuf) {
 			free(telnetBuf);
 			telnetBuf = NULL;
@@ -170,59 +321,65 @@ bool TelnetSpy::setBufferSize(uint16_t newSize) {
 		}
 		return true;
 	}
+	// Round down to a power of two, so the free running indices are masked instead of wrapped
 	newSize = max(newSize, minBlockSize);
-	uint16_t oldBufLen = bufLen;
-	bufLen = newSize;
-	uint16_t tmp;
-	if (!telnetBuf || (bufUsed == 0)) {
-		bufRdIdx = 0;
-		bufWrIdx = 0;
-		bufUsed = 0;
-	} else {
-		if (bufLen < oldBufLen) {
-			if (bufRdIdx < bufWrIdx) {
-				if (bufWrIdx > bufLen) {
-					tmp = min(bufLen, (uint16_t) (bufWrIdx - max(bufLen, bufRdIdx)));
-					memcpy(telnetBuf, &telnetBuf[bufWrIdx - tmp], tmp);
-					bufWrIdx = tmp;
-					if (bufWrIdx > bufRdIdx) {
-						bufRdIdx = bufWrIdx;
-					} else {
-						if (bufRdIdx > bufLen) {
-							bufRdIdx = 0;
-						}
-					}
-					if (bufRdIdx == bufWrIdx) {
-						bufUsed = bufLen;
-					} else {
-						bufUsed = bufWrIdx - bufRdIdx;
-					}
-				}
-			} else {
-				if (bufWrIdx > bufLen) {
-					memcpy(telnetBuf, &telnetBuf[bufWrIdx - bufLen], bufLen);
-					bufRdIdx = 0;
-					bufWrIdx = 0;
-					bufUsed = bufLen;
-				} else {
-					tmp = min(bufLen - bufWrIdx, oldBufLen - bufRdIdx);
-					memcpy(&telnetBuf[bufLen - tmp], &telnetBuf[oldBufLen - tmp], tmp);
-					bufRdIdx = bufLen - tmp;
-					bufUsed = bufWrIdx + tmp;
-				}
-			}
-		}
+	uint16_t size = 1;
+	while (size <= (newSize >> 1)) {
+		size <<= 1;
 	}
-	char* temp = (char*) realloc(telnetBuf, bufLen);
+	if (telnetBuf && (bufLen == size)) {
+		return true;
+	}
+	char* temp = (char*) malloc(size);
 	if (!temp) {
 		return false;
 	}
+	bool fresh = !telnetBuf;
+	// Preserve the youngest data that fits, whole records only in record mode
+	while (telnetBuf && recordMode && (telnetUsed() > size)) {
+		discardOldestLine();
+	}
+	for (uint8_t i = 0; i <= TELNETSPY_MAX_CLIENTS; i++) {
+		Reader* reader = activeReader(i);
+		if (reader) {
+			catchUp(*reader);
+		}
+	}
+	uint32_t head = bufHead.load(std::memory_order_relaxed);
+	uint16_t keep = telnetBuf ? min(telnetUsed(), size) : 0;
+	for (uint16_t i = 0; i < keep; i++) {
+		temp[i] = telnetBuf[(head - keep + i) & bufMask];
+	}
+	if (telnetBuf) {
+		free(telnetBuf);
+	}
 	telnetBuf = temp;
-	if (telnetBuf && (bufLen > oldBufLen) && (bufRdIdx > bufWrIdx)) {
-		tmp = bufLen - (oldBufLen - bufRdIdx);
-		memcpy(&telnetBuf[tmp], &telnetBuf[bufRdIdx], oldBufLen - bufRdIdx);
-		bufRdIdx = tmp;
+	bufLen = size;
+	bufMask = size - 1;
+	bufTail.store(0, std::memory_order_relaxed);
+	bufHead.store(keep, std::memory_order_release);
+	// Same for the reader cursors; a reader further behind than that misses the rest
+	for (uint8_t i = 0; i <= TELNETSPY_MAX_CLIENTS; i++) {
+		Reader* reader = activeReader(i);
+		if (reader) {
+			uint32_t behind = head - reader->cursor;
+			if (behind > keep) {
+				reader->dropped += behind - keep;
+				behind = keep;
+			}
+			reader->cursor = keep - behind;
+		}
+	}
+	if (fresh) {
+		// The asynchronous mirror starts on the new buffer
+		serialReader.cursor = keep;
+		serialReader.dropped = 0;
+		serialReader.recordOffset = 0;
 	}
+	// Rebuild the line index for the renumbered data
+	lineHead = 0;
+	lineTail = 0;
+	indexLines(telnetBuf, keep, 0);
 	if (telnetServer) {
 		telnetServer->setNoDelay(true);
 	}
@@ -246,10 +403,10 @@ bool TelnetSpy::getStoreOffline() {
 
 void TelnetSpy::setPingTime(uint16_t pngTime) {
 	pingTime = pngTime;
-	if (pingTime == 0) {
-		pingRef = 0xFFFFFFFF;
-	} else {
-		pingRef = (millis() & 0x7FFFFFF) + pingTime;
+	for (uint8_t i = 0; i < TELNETSPY_MAX_CLIENTS; i++) {
+		if (sessions[i].connected) {
+			schedulePing(sessions[i]);
+		}
 	}
 }
 
@@ -288,56 +445,52 @@ void TelnetSpy::setSerial(HardwareSerial* usedSerial) {
 }
 
 size_t TelnetSpy::write (uint8_t data) {
+	return write(&data, 1);
+}
+
+// Same as write(uint8_t) for a whole block: one copy into the ring buffer and one
+// call to the serial port instead of a call per byte.
+size_t TelnetSpy::write (const uint8_t* data, size_t size) {
+	if (size == 0) {
+		return 0;
+	}
+	drainDebugBuf();
 	if (telnetBuf) {
-		if (storeOffline || client.connected()) {
-			if (bufUsed == bufLen) {
-				if (client.connected()) {
-					sendBlock();
-				}
-				if (bufUsed == bufLen) {
-					char c;
-					while (bufUsed > 0) {
-						c = pullTelnetBuf();
-						if (c == '\n') {
-							break;
-						}
-					}
-					if (peekTelnetBuf() == '\r') {
-						pullTelnetBuf();
-					}
-				}
-			}
-			addTelnetBuf(data);
+		if (storeOffline || (activeClients > 0) || serialQueued()) {
+			storeTelnetBuf(data, size);
 		}
 	} else {
-		if (client.connected()) {
-			client.write(data);
+		for (uint8_t i = 0; i < TELNETSPY_MAX_CLIENTS; i++) {
+			if (sessions[i].connected) {
+				sessions[i].client.write(data, size);
+			}
 		}
 	}
-	if (usedSer) {
-		return usedSer->write(data);
+	if (serialQueued()) {
+		drainSerial();
+	} else if (usedSer && (serialMirror != TELNETSPY_MIRROR_OFF)) {
+		return writeSerial(data, size);
 	}
-	return 1;
+	return size;
 }
 
+// Called from the os_printf hook, which can interrupt write() and handle(). It is the
+// only producer of the small debug ring; the main task moves its content into the
+// telnet buffer (see drainDebugBuf), so no lock is needed on either ring.
 void TelnetSpy::debugWrite (uint8_t data) {
 	if (telnetBuf) {
-		if (storeOffline || client.connected()) {
-			if (bufUsed == bufLen) {
-				char c;
-				while (bufUsed > 0) {
-					c = pullTelnetBuf();
-					if (c == '\n') {
-						break;
-					}
-				}
-				if (peekTelnetBuf() == '\r') {
-					pullTelnetBuf();
-				}
-			}
-			addTelnetBuf(data);
+		uint32_t head = dbgHead.load(std::memory_order_relaxed);
+		if (head - dbgTail.load(std::memory_order_acquire) < TELNETSPY_DEBUG_BUFFER_LEN) {
+			dbgBuf[head & (TELNETSPY_DEBUG_BUFFER_LEN - 1)] = data;
+			dbgHead.store(head + 1, std::memory_order_release);
+		} else {
+			dbgDropped.fetch_add(1, std::memory_order_relaxed);
 		}
 	}
+	// The asynchronous mirror gets it from the telnet buffer
+	if ((serialMirror == TELNETSPY_MIRROR_OFF) || (telnetBuf && (serialMirror == TELNETSPY_MIRROR_ASYNC))) {
+		return;
+	}
 #ifdef ESP8266
     ets_putc(data);
 #else
@@ -352,7 +505,7 @@ int TelnetSpy::available (void) {
 			return avail;
 		}
 	}
-	if (client.connected()) {
+	if (activeClients > 0) {
 		return telnetAvailable();
 	}
 	return 0;
@@ -366,7 +519,7 @@ int TelnetSpy::read (void) {
 			return val;
 		}
 	}
-	if (client.connected()) {
+	if (activeClients > 0) {
 		if (telnetAvailable()) {
             if (recBuf) {
                 if (recUsed == 0) {
@@ -381,7 +534,7 @@ CRITCAL_SECTION_START
 CRITCAL_SECTION_END
                 }
             } else {
-			    val = client.read();
+			    val = inputSession()->client.read();
             }
 		}
 	}
@@ -396,12 +549,12 @@ int TelnetSpy::peek (void) {
 			return val;
 		}
 	}
-	if (client.connected()) {
+	if (activeClients > 0) {
 		if (telnetAvailable()) {
             if (recBuf) {
                 val = recBuf[recRdIdx];
             } else {
-			    val = client.peek();
+			    val = inputSession()->client.peek();
             }
 		}
 	}
@@ -409,13 +562,21 @@ int TelnetSpy::peek (void) {
 }
 
 void TelnetSpy::flush (void) {
+	drainDebugBuf();
+	unsigned long flushStart = millis();
+	while ((getSerialBacklog() > 0) && (millis() - flushStart < TELNETSPY_SERIAL_FLUSH_TIME)) {
+		drainSerial();
+		yield();
+	}
 	if (usedSer) {
 		usedSer->flush();
 	}
-	if (client.connected()) {
-        sendBlock();
-        client.flush();
-    }
+	for (uint8_t i = 0; i < TELNETSPY_MAX_CLIENTS; i++) {
+		if (sessions[i].connected) {
+			sendBlock(sessions[i]);
+			sessions[i].client.flush();
+		}
+	}
 }
 
 #ifdef ESP8266
@@ -447,18 +608,12 @@ void TelnetSpy::end() {
 	if (usedSer) {
 		usedSer->end();
 	}
-	if (client.connected()) {
-        sendBlock();
-		client.flush();
-		client.stop();
+	disconnectClient();
+	if (telnetServer) {
+		telnetServer->close();
+		delete telnetServer;
+		telnetServer = NULL;
 	}
-	if (connected && (callbackDisconnect != NULL)) {
-		callbackDisconnect();
-	}	
-	connected = false;
-	telnetServer->close();
-	delete telnetServer;
-	telnetServer = NULL;
 	listening = false;
 	started = false;
 }
@@ -500,10 +655,10 @@ bool TelnetSpy::isRxEnabled(void) {
 #endif
 
 int TelnetSpy::availableForWrite(void) {
-	if (usedSer) {
-		return min(usedSer->availableForWrite(), bufLen - bufUsed);
+	if (usedSer && (serialMirror == TELNETSPY_MIRROR_SYNC)) {
+		return min(usedSer->availableForWrite(), bufLen - telnetUsed());
 	}
-	return bufLen - bufUsed;
+	return bufLen - telnetUsed();
 }
 
 TelnetSpy::operator bool() const {
@@ -539,91 +694,712 @@ uint32_t TelnetSpy::baudRate(void) {
 	return 115200;
 }
 
-void TelnetSpy::sendBlock() {
-CRITCAL_SECTION_START
-	uint16_t len = bufUsed;
-	if (len > maxBlockSize) {
-		len = maxBlockSize;
+// Consumer side of the telnet ring for one client: only handle() and the disconnect
+// paths call it. Never blocks: it writes no more than the client's TCP send window
+// takes, both ring segments in one pass, and stops early once TELNETSPY_SEND_BUDGET_US
+// is spent.
+void TelnetSpy::sendBlock(Session& session) {
+	uint32_t started = micros();
+	catchUp(session);
+	if ((bufHead.load(std::memory_order_acquire) == session.cursor) && (session.dropped == 0)) {
+		return;
 	}
-	len = min(len, (uint16_t) (bufLen - bufRdIdx));
-	uint16_t idx = bufRdIdx;
-CRITCAL_SECTION_END
-    if (len == 0) {
-        return;
-    }
-	client.write(&telnetBuf[idx], len);
-CRITCAL_SECTION_START
-	bufRdIdx += len;
-	if (bufRdIdx >= bufLen) {
-		bufRdIdx = 0;
+#ifdef ESP8266
+	size_t window = session.client.availableForWrite();
+#else
+	// The ESP32 WiFiClient cannot report its send window; its write() uses a select() timeout
+	size_t window = maxBlockSize;
+#endif
+	if (window == 0) {
+		sendStalls++;
+		return;
+	}
+	uint32_t sent = sendReader(session, session.client, window, started);
+	releaseSent();
+	if (sent == 0) {
+		return;
 	}
-	bufUsed -= len;
-	if (bufUsed == 0) {
-		bufRdIdx = 0;
-		bufWrIdx = 0;
+	session.waitRef = 0xFFFFFFFF;
+	if (session.pingRef != 0xFFFFFFFF) {
+		schedulePing(session);
 	}
-CRITCAL_SECTION_END
-	waitRef = 0xFFFFFFFF;
-	if (pingRef != 0xFFFFFFFF) {
-		pingRef = (millis() & 0x7FFFFFF) + pingTime;
-		if (pingRef > 0x7FFFFFFF) {
-			pingRef -= 0x80000000;
+}
+
+// Writes no more than window to out from the reader's cursor: first where output went
+// missing, right where the gap is, then raw blocks or rendered records. Returns the
+// bytes written.
+uint32_t TelnetSpy::sendReader(Reader& reader, Print& out, size_t window, uint32_t started) {
+	uint32_t written = 0;
+	if (reader.dropped > 0) {
+		char marker[48];
+		int markerLen = min(snprintf(marker, sizeof(marker), TELNETSPY_DROP_MARKER, (unsigned long) reader.dropped), (int) sizeof(marker) - 1);
+		if ((size_t) markerLen > window) {
+			// Next time, ahead of the same data
+			return 0;
+		}
+		written = out.write((const uint8_t*) marker, markerLen);
+		window -= written;
+		reader.dropped = 0;
+	}
+	if (recordMode) {
+		return written + sendRecords(reader, out, window, started);
+	}
+	uint32_t budget = min(bufHead.load(std::memory_order_acquire) - reader.cursor, (uint32_t) window);
+	uint32_t sent = 0;
+	while (sent < budget) {
+		uint16_t idx = (reader.cursor + sent) & bufMask;
+		uint16_t len = min(budget - sent, (uint32_t) (bufLen - idx));
+		len = min(len, maxBlockSize);
+		size_t n = out.write(&telnetBuf[idx], len);
+		sent += n;
+		if (n < len) {
+			// The stack took less than it offered; the rest stays queued
+			partialWrites++;
+			break;
+		}
+		if (micros() - started >= TELNETSPY_SEND_BUDGET_US) {
+			break;
 		}
 	}
+	reader.cursor += sent;
+	return written + sent;
 }
 
-void TelnetSpy::addTelnetBuf(char c) {
-CRITCAL_SECTION_START
-	telnetBuf[bufWrIdx] = c;
-	if (bufUsed == bufLen) {
-		bufRdIdx++;
-		if (bufRdIdx >= bufLen) {
-			bufRdIdx = 0;
+void TelnetSpy::sendAll() {
+	for (uint8_t i = 0; i < TELNETSPY_MAX_CLIENTS; i++) {
+		if (sessions[i].connected) {
+			sendBlock(sessions[i]);
 		}
-	} else {
-		bufUsed++;
 	}
-	bufWrIdx++;
-	if (bufWrIdx >= bufLen) {
-		bufWrIdx = 0;
+}
+
+// Free what every reader has been sent: the tail follows the slowest cursor. Without
+// clients nothing is freed, so the next one gets what was collected, unless nothing is
+// stored for it. Records are kept as history for replays until the producer needs the
+// room.
+void TelnetSpy::releaseSent() {
+	if (recordMode) {
+		return;
+	}
+	uint32_t head = bufHead.load(std::memory_order_acquire);
+	uint32_t tail = bufTail.load(std::memory_order_acquire);
+	Reader* slowest = NULL;
+	if ((activeClients > 0) || !storeOffline) {
+		for (uint8_t i = 0; i <= TELNETSPY_MAX_CLIENTS; i++) {
+			Reader* reader = activeReader(i);
+			if (reader && ((slowest == NULL) || (head - reader->cursor > head - slowest->cursor))) {
+				slowest = reader;
+			}
+		}
+	}
+	if ((slowest != NULL) && ((int32_t) (slowest->cursor - tail) > 0)) {
+		advanceTail(slowest->cursor);
 	}
-CRITCAL_SECTION_END
 }
 
-char TelnetSpy::pullTelnetBuf() {
-	if (bufUsed == 0) {
-		return 0;
+// Move a reader which fell behind the tail up to it; what it missed is reported with
+// its next block
+void TelnetSpy::catchUp(Reader& reader) {
+	uint32_t tail = bufTail.load(std::memory_order_acquire);
+	if ((int32_t) (tail - reader.cursor) > 0) {
+		reader.dropped += tail - reader.cursor;
+		reader.cursor = tail;
+		reader.cursorMillis = tailMillis;
+		reader.cursorTag = tailTag;
+		reader.recordOffset = 0;
 	}
-CRITCAL_SECTION_START
-	char c = telnetBuf[bufRdIdx++]; 
-	if (bufRdIdx >= bufLen) {
-		bufRdIdx = 0;
+}
+
+// Renders records from the reader's cursor, skipping those its filter hides. A record
+// goes out whole, unless it is the first and does not fit the window at all (a serial
+// FIFO can be smaller than a line). Returns the bytes written.
+uint32_t TelnetSpy::sendRecords(Reader& reader, Print& out, size_t window, uint32_t started) {
+	uint32_t head = bufHead.load(std::memory_order_acquire);
+	uint32_t written = 0;
+	char line[max(TELNETSPY_RECORD_LINE_LEN, TELNETSPY_DEFERRED_TEXT_LEN) + 40];
+	while (reader.cursor != head) {
+		uint8_t len;
+		uint8_t tag = reader.cursorTag;
+		uint32_t delta;
+		uint8_t headerLen = readRecordHeader(reader.cursor, len, tag, delta);
+		uint32_t stamp = reader.cursorMillis + delta;
+		uint8_t level = (tag >> 5) & 3;
+		uint8_t subsystem = tag & 0x1F;
+		if ((level <= reader.maxLevel) && (reader.subsystems & (1UL << subsystem))) {
+			int n = snprintf(line, sizeof(line), "[%7lu.%03lu] %c ", (unsigned long) (stamp / 1000), (unsigned long) (stamp % 1000), LEVEL_NAMES[level]);
+			if ((subsystem < subsystemCount) && subsystemNames[subsystem]) {
+				n += snprintf(&line[n], sizeof(line) - n, "%s: ", subsystemNames[subsystem]);
+			} else if (subsystem != 0) {
+				n += snprintf(&line[n], sizeof(line) - n, "#%u: ", subsystem);
+			}
+			if (tag & TELNETSPY_RECORD_DEFERRED) {
+				n = min(n, (int) (sizeof(line) - TELNETSPY_DEFERRED_TEXT_LEN - 2));
+				n += renderDeferred(reader.cursor + headerLen, len, &line[n], TELNETSPY_DEFERRED_TEXT_LEN);
+				while ((n > 0) && ((line[n - 1] == '\n') || (line[n - 1] == '\r'))) {
+					n--;
+				}
+			} else {
+				n = min(n, (int) (sizeof(line) - len - 2));
+				for (uint8_t i = 0; i < len; i++) {
+					line[n++] = telnetBuf[(reader.cursor + headerLen + i) & bufMask];
+				}
+			}
+			line[n++] = '\r';
+			line[n++] = '\n';
+			size_t rest = n - reader.recordOffset;
+			size_t chunk = rest;
+			if (rest > window) {
+				if ((written > 0) || (window == 0)) {
+					break;
+				}
+				chunk = window;
+			}
+			size_t sent = out.write((const uint8_t*) &line[reader.recordOffset], chunk);
+			window -= sent;
+			written += sent;
+			if (sent < rest) {
+				// Resumed mid record next time
+				reader.recordOffset += sent;
+				if (sent < chunk) {
+					partialWrites++;
+				}
+				break;
+			}
+			reader.recordOffset = 0;
+		}
+		reader.cursor += headerLen + len;
+		reader.cursorMillis = stamp;
+		reader.cursorTag = tag;
+		if (micros() - started >= TELNETSPY_SEND_BUDGET_US) {
+			break;
+		}
 	}
-	bufUsed--;
-CRITCAL_SECTION_END
-	return c;
+	return written;
 }
 
-char TelnetSpy::peekTelnetBuf() {
-	if (bufUsed == 0) {
+uint16_t TelnetSpy::telnetUsed() {
+	return bufHead.load(std::memory_order_acquire) - bufTail.load(std::memory_order_acquire);
+}
+
+// Producer side: make room (sending first if a client is there, then dropping the
+// oldest lines) and append. Only the youngest bufLen bytes of a larger block survive.
+void TelnetSpy::storeTelnetBuf(const uint8_t* data, size_t size) {
+	if (recordMode) {
+		assembleRecord(data, size);
+		return;
+	}
+	if (size >= bufLen) {
+		noteDropped(telnetUsed(), 0, true);
+		noteDropped(size - bufLen, 1, false);
+		data = &data[size - bufLen];
+		size = bufLen;
+		advanceTail(bufHead.load(std::memory_order_relaxed));
+	}
+	makeRoom(size);
+	addTelnetBuf(data, size);
+}
+
+void TelnetSpy::makeRoom(size_t size) {
+	if ((size_t) (bufLen - telnetUsed()) < size) {
+		if (activeClients > 0) {
+			sendAll();
+		}
+		drainSerial();
+	}
+	while (((size_t) (bufLen - telnetUsed()) < size) && (telnetUsed() > 0)) {
+		discardOldestLine();
+	}
+}
+
+// Record mode producer: collect a line, store it as one record at its end (or when it
+// gets too long, keeping the tag for the rest)
+void TelnetSpy::assembleRecord(const uint8_t* data, size_t size) {
+	while (size > 0) {
+		const uint8_t* nl = (const uint8_t*) memchr(data, '\n', size);
+		size_t n = nl ? nl - data : size;
+		size_t room = TELNETSPY_RECORD_LINE_LEN - lineLen;
+		if (n > room) {
+			memcpy(&lineBuf[TELNETSPY_RECORD_HEADER_MAX + lineLen], data, room);
+			lineLen += room;
+			storeRecord();
+			data += room;
+			size -= room;
+			continue;
+		}
+		memcpy(&lineBuf[TELNETSPY_RECORD_HEADER_MAX + lineLen], data, n);
+		lineLen += n;
+		if (!nl) {
+			return;
+		}
+		storeRecord();
+		recordTag = DEFAULT_RECORD_TAG;
+		data += n + 1;
+		size -= n + 1;
+	}
+}
+
+void TelnetSpy::storeRecord() {
+	uint16_t len = lineLen;
+	lineLen = 0;
+	if ((len > 0) && (lineBuf[TELNETSPY_RECORD_HEADER_MAX + len - 1] == '\r')) {
+		len--;
+	}
+	commitRecord(len, recordTag);
+}
+
+// Header: payload length with bit 7 set if the tag (level << 5 | subsystem, plus
+// TELNETSPY_RECORD_DEFERRED) follows, which it only does when it differs from the
+// previous record's, then the milliseconds since the previous record as a varint. A
+// block of lines with the same tag costs two or three bytes per line, against two for
+// the CR LF it replaces. The header is written right in front of the payload in
+// lineBuf, so the record goes into the ring with one copy.
+void TelnetSpy::commitRecord(uint16_t len, uint8_t tag) {
+	len = min(len, (uint16_t) (bufLen - TELNETSPY_RECORD_HEADER_MAX));
+	uint32_t now = millis();
+	uint32_t delta = now - lastRecordMillis;
+	lastRecordMillis = now;
+	uint8_t header[TELNETSPY_RECORD_HEADER_MAX];
+	uint8_t headerLen = 0;
+	header[headerLen++] = len;
+	if (tag != lastRecordTag) {
+		header[0] |= 0x80;
+		header[headerLen++] = tag;
+		lastRecordTag = tag;
+	}
+	do {
+		header[headerLen] = delta & 0x7F;
+		delta >>= 7;
+		header[headerLen++] |= delta ? 0x80 : 0;
+	} while (delta);
+	uint8_t* record = (uint8_t*) &lineBuf[TELNETSPY_RECORD_HEADER_MAX - headerLen];
+	memcpy(record, header, headerLen);
+	makeRoom(headerLen + len);
+	addTelnetBuf(record, headerLen + len);
+}
+
+// A deferred record holds the format's address and its arguments, see DEFER_NONE. An
+// argument which does not fit ends the record; rendering stops there.
+void TelnetSpy::storeDeferred(PGM_P format, va_list args) {
+	if (lineLen > 0) {
+		// The text line written so far ends before it
+		storeRecord();
+	}
+	char* payload = &lineBuf[TELNETSPY_RECORD_HEADER_MAX];
+	uint16_t len = 0;
+	bool fits = putDeferred(payload, len, &format, sizeof(format));
+	PGM_P p = format;
+	char c;
+	while (fits && ((c = pgm_read_byte(p++)) != '\0')) {
+		if (c != '%') {
+			continue;
+		}
+		uint8_t type;
+		uint8_t stars;
+		p += parseConversion(p, type, stars);
+		while (fits && (stars-- > 0)) {
+			fits = putVarint(payload, len, va_arg(args, int));
+		}
+		if (!fits) {
+			break;
+		}
+		switch (type) {
+			case DEFER_INT:
+				fits = putVarint(payload, len, va_arg(args, int));
+				break;
+			case DEFER_LONG:
+				fits = putVarint(payload, len, va_arg(args, long));
+				break;
+			case DEFER_LLONG:
+				fits = putVarint(payload, len, va_arg(args, long long));
+				break;
+			case DEFER_SIZE:
+				fits = putVarint(payload, len, (int64_t) va_arg(args, size_t));
+				break;
+			case DEFER_POINTER:
+				fits = putVarint(payload, len, (int64_t) (uintptr_t) va_arg(args, void*));
+				break;
+			case DEFER_SKIP:
+				va_arg(args, void*);
+				break;
+			case DEFER_DOUBLE:
+			case DEFER_LDOUBLE: {
+				double d = (type == DEFER_LDOUBLE) ? (double) va_arg(args, long double) : va_arg(args, double);
+				float f = d;
+				uint8_t size = ((double) f == d) ? sizeof(f) : sizeof(d);
+				fits = putDeferred(payload, len, &size, 1) &&
+					   putDeferred(payload, len, (size == sizeof(f)) ? (const void*) &f : (const void*) &d, size);
+				break;
+			}
+			case DEFER_STRING: {
+				const char* str = va_arg(args, const char*);
+				if (str == NULL) {
+					str = "(null)";
+				}
+				uint16_t room = TELNETSPY_RECORD_LINE_LEN - len;
+				if (room == 0) {
+					fits = false;
+					break;
+				}
+				uint16_t n = strnlen(str, room - 1);
+				putDeferred(payload, len, str, n);
+				payload[len++] = '\0';
+				break;
+			}
+		}
+	}
+	commitRecord(len, recordTag | TELNETSPY_RECORD_DEFERRED);
+	recordTag = DEFAULT_RECORD_TAG;
+}
+
+// Formats the deferred record with the payload at pos into text (at most size - 1
+// characters, zero terminated). A '\n' of the format becomes CR LF, a trailing one
+// is left to the caller. Returns the length.
+uint16_t TelnetSpy::renderDeferred(uint32_t pos, uint8_t len, char* text, uint16_t size) {
+	uint8_t payload[TELNETSPY_RECORD_LINE_LEN];
+	for (uint8_t i = 0; i < len; i++) {
+		payload[i] = telnetBuf[(pos + i) & bufMask];
+	}
+	PGM_P format;
+	uint16_t n = 0;
+	text[0] = '\0';
+	if (len < sizeof(format)) {
 		return 0;
 	}
-CRITCAL_SECTION_START
-    char c = telnetBuf[bufRdIdx];
-CRITCAL_SECTION_END
-    return c;
+	memcpy(&format, payload, sizeof(format));
+	uint8_t at = sizeof(format);
+	char c;
+	while ((n < size - 1) && ((c = pgm_read_byte(format++)) != '\0')) {
+		if (c != '%') {
+			if ((c == '\n') && (pgm_read_byte(format) != '\0')) {
+				text[n++] = '\r';
+				if (n == size - 1) {
+					break;
+				}
+			}
+			text[n++] = c;
+			continue;
+		}
+		uint8_t type;
+		uint8_t stars;
+		uint8_t specLen = parseConversion(format, type, stars);
+		// The conversion in RAM, with the '*' arguments written in
+		char spec[24];
+		uint8_t specPos = 0;
+		spec[specPos++] = '%';
+		bool valid = true;
+		for (uint8_t i = 0; valid && (i < specLen); i++) {
+			c = pgm_read_byte(&format[i]);
+			int64_t star;
+			if (c != '*') {
+				valid = specPos < sizeof(spec) - 1;
+				spec[specPos++] = c;
+			} else if ((valid = getVarint(payload, len, at, star))) {
+				int w = snprintf(&spec[specPos], sizeof(spec) - specPos, "%d", (int) star);
+				valid = (w > 0) && (specPos + w < (int) sizeof(spec) - 1);
+				specPos += w;
+			}
+		}
+		format += specLen;
+		if (!valid) {
+			break;
+		}
+		spec[specPos] = '\0';
+		int64_t value = 0;
+		int w = 0;
+		switch (type) {
+			case DEFER_NONE:
+				if (spec[specPos - 1] == '%') {
+					text[n] = '%';
+					w = 1;
+				}
+				break;
+			case DEFER_SKIP:
+				break;
+			case DEFER_INT:
+			case DEFER_LONG:
+			case DEFER_LLONG:
+			case DEFER_SIZE:
+			case DEFER_POINTER:
+				if (!getVarint(payload, len, at, value)) {
+					valid = false;
+				} else if (type == DEFER_INT) {
+					w = snprintf(&text[n], size - n, spec, (int) value);
+				} else if (type == DEFER_LONG) {
+					w = snprintf(&text[n], size - n, spec, (long) value);
+				} else if (type == DEFER_LLONG) {
+					w = snprintf(&text[n], size - n, spec, (long long) value);
+				} else if (type == DEFER_SIZE) {
+					w = snprintf(&text[n], size - n, spec, (size_t) value);
+				} else {
+					w = snprintf(&text[n], size - n, spec, (void*) (uintptr_t) value);
+				}
+				break;
+			case DEFER_DOUBLE:
+			case DEFER_LDOUBLE: {
+				float f;
+				double d;
+				if ((at < len) && (payload[at] == sizeof(f)) && (at + 1 + sizeof(f) <= len)) {
+					memcpy(&f, &payload[at + 1], sizeof(f));
+					d = f;
+				} else if ((at < len) && (payload[at] == sizeof(d)) && (at + 1 + sizeof(d) <= len)) {
+					memcpy(&d, &payload[at + 1], sizeof(d));
+				} else {
+					valid = false;
+					break;
+				}
+				at += 1 + payload[at];
+				if (type == DEFER_LDOUBLE) {
+					w = snprintf(&text[n], size - n, spec, (long double) d);
+				} else {
+					w = snprintf(&text[n], size - n, spec, d);
+				}
+				break;
+			}
+			case DEFER_STRING: {
+				const char* str = (const char*) &payload[at];
+				uint8_t strLen = strnlen(str, len - at);
+				if (at + strLen >= len) {
+					valid = false;
+					break;
+				}
+				at += strLen + 1;
+				w = snprintf(&text[n], size - n, spec, str);
+				break;
+			}
+		}
+		if (!valid) {
+			break;
+		}
+		n += min(max(w, 0), size - 1 - n);
+	}
+	text[n] = '\0';
+	return n;
+}
+
+uint8_t TelnetSpy::readRecordHeader(uint32_t pos, uint8_t& len, uint8_t& tag, uint32_t& delta) {
+	len = telnetBuf[pos & bufMask];
+	uint8_t headerLen = 1;
+	if (len & 0x80) {
+		len &= 0x7F;
+		tag = telnetBuf[(pos + headerLen++) & bufMask];
+	}
+	delta = 0;
+	uint8_t shift = 0;
+	uint8_t b;
+	do {
+		b = telnetBuf[(pos + headerLen++) & bufMask];
+		delta |= (uint32_t) (b & 0x7F) << shift;
+		shift += 7;
+	} while ((b & 0x80) && (headerLen < TELNETSPY_RECORD_HEADER_MAX));
+	return headerLen;
+}
+
+// Caller guarantees room: size <= bufLen - telnetUsed(). The bytes are published
+// by the release store of the head, so the consumer never sees them half written.
+void TelnetSpy::addTelnetBuf(const uint8_t* data, uint16_t size) {
+	uint32_t head = bufHead.load(std::memory_order_relaxed);
+	uint16_t idx = head & bufMask;
+	uint16_t first = min(size, (uint16_t) (bufLen - idx));
+	memcpy(&telnetBuf[idx], data, first);
+	memcpy(telnetBuf, &data[first], size - first);
+	if (!recordMode) {
+		indexLines(data, size, head);
+	}
+	bufHead.store(head + size, std::memory_order_release);
+}
+
+// Producer side: remember where each line in data (stored at offset) starts, so the
+// oldest line can be dropped without scanning. A full index forgets its oldest entry,
+// which only makes the next drop coarser.
+void TelnetSpy::indexLines(const void* data, uint16_t size, uint32_t offset) {
+	const char* start = (const char*) data;
+	const char* end = start + size;
+	const char* nl;
+	while ((start < end) && ((nl = (const char*) memchr(start, '\n', end - start)) != NULL)) {
+		start = nl + 1;
+		if ((uint16_t) (lineHead - lineTail) == TELNETSPY_LINE_INDEX_LEN) {
+			lineTail++;
+		}
+		lineStarts[lineHead++ & (TELNETSPY_LINE_INDEX_LEN - 1)] = offset + (start - (const char*) data);
+	}
+}
+
+// Readers notice bytes dropped from the ring by their cursor falling behind the tail;
+// bytes which were never stored have to be reported to each of them.
+void TelnetSpy::noteDropped(uint32_t bytes, uint16_t lines, bool stored) {
+	if (bytes == 0) {
+		return;
+	}
+	droppedBytes += bytes;
+	droppedLines += lines;
+	if (activeClients == 0) {
+		pendingDrop.fetch_add(bytes, std::memory_order_relaxed);
+	} else if (!stored) {
+		for (uint8_t i = 0; i < TELNETSPY_MAX_CLIENTS; i++) {
+			if (sessions[i].connected) {
+				sessions[i].dropped += bytes;
+			}
+		}
+	}
+	if (!stored && serialQueued()) {
+		serialReader.dropped += bytes;
+	}
+}
+
+// Make room by dropping the oldest line (including a trailing '\r'), or everything if
+// there is no line end. Index entries the consumer already sent past are skipped, so
+// this is O(1) amortized.
+void TelnetSpy::discardOldestLine() {
+	uint32_t head = bufHead.load(std::memory_order_relaxed);
+	uint32_t tail = bufTail.load(std::memory_order_acquire);
+	uint32_t drop = head;
+	if (recordMode) {
+		// A record is a line, and its header says how long it is. Old history going is
+		// no loss, only a record a reader has not been sent yet is.
+		uint8_t len;
+		uint32_t delta;
+		uint8_t headerLen = readRecordHeader(tail, len, tailTag, delta);
+		drop = tail + headerLen + len;
+		for (uint8_t i = 0; i <= TELNETSPY_MAX_CLIENTS; i++) {
+			Reader* reader = activeReader(i);
+			if (reader && ((int32_t) (drop - reader->cursor) > 0)) {
+				noteDropped(headerLen + len, 1, true);
+				break;
+			}
+		}
+		tailMillis += delta;
+		advanceTail(drop);
+		return;
+	}
+	while (lineTail != lineHead) {
+		uint32_t start = lineStarts[lineTail++ & (TELNETSPY_LINE_INDEX_LEN - 1)];
+		if ((int32_t) (start - tail) > 0) {
+			drop = start;
+			break;
+		}
+	}
+	if ((drop != head) && (telnetBuf[drop & bufMask] == '\r')) {
+		drop++;
+	}
+	noteDropped(drop - tail, 1, true);
+	advanceTail(drop);
+}
+
+// Both sides move the tail forward, so it only ever moves to whichever target is further
+void TelnetSpy::advanceTail(uint32_t target) {
+	uint32_t tail = bufTail.load(std::memory_order_relaxed);
+	while (((int32_t) (target - tail) > 0) &&
+		   !bufTail.compare_exchange_weak(tail, target, std::memory_order_acq_rel, std::memory_order_relaxed)) {
+	}
+}
+
+// Main task: move what the os_printf hook queued into the telnet buffer
+void TelnetSpy::drainDebugBuf() {
+	uint32_t tail = dbgTail.load(std::memory_order_relaxed);
+	uint32_t head = dbgHead.load(std::memory_order_acquire);
+	while (tail != head) {
+		uint16_t idx = tail & (TELNETSPY_DEBUG_BUFFER_LEN - 1);
+		uint16_t len = min(head - tail, (uint32_t) (TELNETSPY_DEBUG_BUFFER_LEN - idx));
+		if (telnetBuf && (storeOffline || (activeClients > 0) || serialQueued())) {
+			storeTelnetBuf((const uint8_t*) &dbgBuf[idx], len);
+		}
+		tail += len;
+		dbgTail.store(tail, std::memory_order_release);
+	}
+	if (dbgDropped.load(std::memory_order_relaxed) > 0) {
+		noteDropped(dbgDropped.exchange(0, std::memory_order_relaxed), 0, false);
+	}
+}
+
+// Readers of the ring: the connected sessions, then the asynchronous serial mirror
+TelnetSpy::Reader* TelnetSpy::activeReader(uint8_t index) {
+	if (index < TELNETSPY_MAX_CLIENTS) {
+		return sessions[index].connected ? &sessions[index] : NULL;
+	}
+	return serialQueued() ? &serialReader : NULL;
+}
+
+bool TelnetSpy::serialQueued() {
+	return (serialMirror == TELNETSPY_MIRROR_ASYNC) && usedSer && telnetBuf;
+}
+
+// Main task: the asynchronous mirror gets no more than the UART's transmit FIFO takes.
+// While the FIFO is full with output waiting, the wait counts as stall time.
+void TelnetSpy::drainSerial() {
+	if (!serialQueued()) {
+		return;
+	}
+	catchUp(serialReader);
+	if ((bufHead.load(std::memory_order_acquire) == serialReader.cursor) && (serialReader.dropped == 0)) {
+		return;
+	}
+	int window = usedSer->availableForWrite();
+	if (window <= 0) {
+		if (!serialStalled) {
+			serialStalled = true;
+			serialStallStart = micros();
+		}
+		return;
+	}
+	if (serialStalled) {
+		serialStalled = false;
+		serialStallMicros += micros() - serialStallStart;
+	}
+	sendReader(serialReader, *usedSer, window, micros());
+	releaseSent();
+}
+
+// The synchronous mirror: a write the FIFO cannot take at once waits for the UART
+size_t TelnetSpy::writeSerial(const uint8_t* data, size_t size) {
+	if ((size_t) usedSer->availableForWrite() >= size) {
+		return usedSer->write(data, size);
+	}
+	uint32_t started = micros();
+	size_t written = usedSer->write(data, size);
+	serialStallMicros += micros() - started;
+	return written;
 }
 
 int TelnetSpy::telnetAvailable() {
-    checkReceive();
+	for (uint8_t i = 0; i < TELNETSPY_MAX_CLIENTS; i++) {
+		if (sessions[i].connected) {
+			checkReceive(sessions[i]);
+		}
+	}
     if (recBuf) {
         return recUsed;
     }
-	return client.available();
+	Session* session = inputSession();
+	return session ? session->client.available() : 0;
+}
+
+// Without a receive buffer the input is read straight from the first client which has some
+TelnetSpy::Session* TelnetSpy::inputSession() {
+	for (uint8_t i = 0; i < TELNETSPY_MAX_CLIENTS; i++) {
+		if (sessions[i].connected && (sessions[i].client.available() > 0)) {
+			return &sessions[i];
+		}
+	}
+	return NULL;
 }
 
 bool TelnetSpy::isClientConnected() {
-	return connected;
+	return activeClients > 0;
+}
+
+void TelnetSpy::setMaxClients(uint8_t count) {
+	maxClients = min(max((uint8_t) 1, count), (uint8_t) TELNETSPY_MAX_CLIENTS);
+	for (uint8_t i = maxClients; i < TELNETSPY_MAX_CLIENTS; i++) {
+		closeSession(sessions[i]);
+	}
+}
+
+uint8_t TelnetSpy::getMaxClients() {
+	return maxClients;
+}
+
+uint8_t TelnetSpy::getClientCount() {
+	return activeClients;
 }
 
 void TelnetSpy::setCallbackOnConnect(void (*callback)()) {
@@ -635,21 +1411,190 @@ void TelnetSpy::setCallbackOnDisconnect(void (*callback)()) {
 }
 
 void TelnetSpy::disconnectClient() {
-    if (client.connected()) {
-        sendBlock();
-        client.flush();
-        client.stop();
-    }
-    if (connected && (callbackDisconnect != NULL)) {
-        callbackDisconnect();
-    }
-    connected = false;
+	for (uint8_t i = 0; i < TELNETSPY_MAX_CLIENTS; i++) {
+		closeSession(sessions[i]);
+	}
+}
+
+// A new client starts at the oldest data still buffered
+void TelnetSpy::openSession(Session& session) {
+	session.connected = true;
+	activeClients++;
+	session.nvtDetected = false;
+	session.nvtState = NVT_DATA;
+	session.cursor = bufTail.load(std::memory_order_acquire);
+	session.cursorMillis = tailMillis;
+	session.cursorTag = tailTag;
+	session.recordOffset = 0;
+	session.maxLevel = TELNETSPY_LEVEL_DEBUG;
+	session.subsystems = 0xFFFFFFFF;
+	session.inCommand = false;
+	session.dropped = pendingDrop.exchange(0, std::memory_order_relaxed);
+	session.waitRef = 0xFFFFFFFF;
+	session.pingRef = 0xFFFFFFFF;
+	schedulePing(session);
+	if (callbackConnect != NULL) {
+		callbackConnect();
+	}
+}
+
+void TelnetSpy::closeSession(Session& session) {
+	if (session.connected && session.client.connected()) {
+		sendBlock(session);
+		session.client.flush();
+	}
+	session.client.stop();
+	if (!session.connected) {
+		return;
+	}
+	session.connected = false;
+	activeClients--;
+	session.waitRef = 0xFFFFFFFF;
+	session.pingRef = 0xFFFFFFFF;
+	if (callbackDisconnect != NULL) {
+		callbackDisconnect();
+	}
+}
+
+void TelnetSpy::schedulePing(Session& session) {
+	if (pingTime == 0) {
+		session.pingRef = 0xFFFFFFFF;
+		return;
+	}
+	session.pingRef = (millis() & 0x7FFFFFF) + pingTime;
+	if (session.pingRef > 0x7FFFFFFF) {
+		session.pingRef -= 0x80000000;
+	}
+}
+
+uint32_t TelnetSpy::getDroppedBytes() {
+	return droppedBytes;
+}
+
+uint32_t TelnetSpy::getDroppedLines() {
+	return droppedLines;
+}
+
+uint32_t TelnetSpy::getPartialWrites() {
+	return partialWrites;
+}
+
+uint32_t TelnetSpy::getSendStalls() {
+	return sendStalls;
+}
+
+uint32_t TelnetSpy::getLastHandleMicros() {
+	return lastHandleMicros;
+}
+
+uint32_t TelnetSpy::getMaxHandleMicros() {
+	return maxHandleMicros;
 }
 
 void TelnetSpy::clearBuffer() {
-	bufUsed = 0;
-	bufRdIdx = 0;
-	bufWrIdx = 0;
+	tailMillis = lastRecordMillis;
+	tailTag = lastRecordTag;
+	advanceTail(bufHead.load(std::memory_order_acquire));
+}
+
+void TelnetSpy::setRecordMode(bool enable) {
+	if (recordMode == enable) {
+		return;
+	}
+	recordMode = enable;
+	recordTag = DEFAULT_RECORD_TAG;
+	lineLen = 0;
+	clearBuffer();
+	for (uint8_t i = 0; i <= TELNETSPY_MAX_CLIENTS; i++) {
+		Reader& reader = (i < TELNETSPY_MAX_CLIENTS) ? sessions[i] : serialReader;
+		reader.cursor = bufHead.load(std::memory_order_acquire);
+		reader.cursorMillis = lastRecordMillis;
+		reader.cursorTag = lastRecordTag;
+		reader.recordOffset = 0;
+	}
+	lineHead = 0;
+	lineTail = 0;
+}
+
+bool TelnetSpy::getRecordMode() {
+	return recordMode;
+}
+
+void TelnetSpy::setRecordTag(uint8_t level, uint8_t subsystem) {
+	recordTag = (min(level, (uint8_t) TELNETSPY_LEVEL_DEBUG) << 5) | (subsystem & 0x1F);
+}
+
+void TelnetSpy::setSubsystemNames(const char* const* names, uint8_t count) {
+	subsystemNames = names;
+	subsystemCount = min(count, (uint8_t) TELNETSPY_MAX_SUBSYSTEMS);
+}
+
+// Only a synchronous serial mirror, which has to get the text now, pays for formatting it
+void TelnetSpy::printDeferred(PGM_P format, ...) {
+	va_list args;
+	va_start(args, format);
+	bool deferred = recordMode && telnetBuf;
+	if (deferred) {
+		drainDebugBuf();
+		if (storeOffline || (activeClients > 0) || serialQueued()) {
+			va_list copy;
+			va_copy(copy, args);
+			storeDeferred(format, copy);
+			va_end(copy);
+		}
+		drainSerial();
+	}
+	if (!deferred || (usedSer && (serialMirror == TELNETSPY_MIRROR_SYNC))) {
+		char text[TELNETSPY_DEFERRED_TEXT_LEN + 1];
+		int n = vsnprintf_P(text, sizeof(text) - 1, format, args);
+		n = min(max(n, 0), (int) sizeof(text) - 2);
+		if ((n == 0) || (text[n - 1] != '\n')) {
+			text[n++] = '\n';
+		}
+		if (deferred) {
+			writeSerial((const uint8_t*) text, n);
+		} else {
+			write((const uint8_t*) text, n);
+		}
+	}
+	va_end(args);
+}
+
+void TelnetSpy::setSerialMirror(uint8_t mode) {
+	if (mode == serialMirror) {
+		return;
+	}
+	if (serialQueued() && (mode == TELNETSPY_MIRROR_SYNC)) {
+		flush();
+	}
+	if (mode == TELNETSPY_MIRROR_ASYNC) {
+		// It starts with what is written from now on
+		serialReader.cursor = bufHead.load(std::memory_order_acquire);
+		serialReader.dropped = 0;
+		serialReader.cursorMillis = lastRecordMillis;
+		serialReader.cursorTag = lastRecordTag;
+		serialReader.recordOffset = 0;
+		serialStalled = false;
+	}
+	serialMirror = mode;
+	releaseSent();
+}
+
+uint8_t TelnetSpy::getSerialMirror() {
+	return serialMirror;
+}
+
+uint16_t TelnetSpy::getSerialBacklog() {
+	if (!serialQueued()) {
+		return 0;
+	}
+	uint32_t head = bufHead.load(std::memory_order_acquire);
+	uint32_t tail = bufTail.load(std::memory_order_acquire);
+	return ((int32_t) (tail - serialReader.cursor) > 0) ? head - tail : head - serialReader.cursor;
+}
+
+uint32_t TelnetSpy::getSerialStallMicros() {
+	return serialStallMicros;
 }
 
 void TelnetSpy::setFilter(char ch, const char* msg, void (*callback)()) {
@@ -717,6 +1662,10 @@ void TelnetSpy::handle() {
 	if (!started) {
 		return;
 	}
+	uint32_t handleStart = micros();
+	// The serial mirror does not wait for the network
+	drainDebugBuf();
+	drainSerial();
 	if (!listening) {
         switch (WiFi.getMode()) {
             case WIFI_MODE_STA:
@@ -736,7 +1685,14 @@ void TelnetSpy::handle() {
 		listening = true;
 	}
     if (telnetServer->hasClient()) {
-        if (client.connected()) {
+		Session* slot = NULL;
+		for (uint8_t i = 0; i < maxClients; i++) {
+			if (!sessions[i].connected && !sessions[i].client.connected()) {
+				slot = &sessions[i];
+				break;
+			}
+		}
+        if (slot == NULL) {
             WiFiClient rejectClient = telnetServer->accept();
 			if (strlen(rejectMsg) > 0) {
 				rejectClient.write((const uint8_t*) rejectMsg, strlen(rejectMsg));
@@ -744,209 +1700,269 @@ void TelnetSpy::handle() {
 			rejectClient.flush();
             rejectClient.stop();
         } else {
-            client = telnetServer->accept();
+            slot->client = telnetServer->accept();
 			if (strlen(welcomeMsg) > 0) {
-				client.write((const uint8_t*) welcomeMsg, strlen(welcomeMsg));
+				slot->client.write((const uint8_t*) welcomeMsg, strlen(welcomeMsg));
 			}
         }
     }
-    if (client.connected()) {
-    	if (!connected) {
-    		connected = true;
-    		if (pingTime != 0) {
-    			pingRef = (millis() & 0x7FFFFFF) + pingTime;
-    		}
-			if (callbackConnect != NULL) {
-				callbackConnect();
-			}
-		}
-	} else {
-    	if (connected) {
-    		connected = false;
-            sendBlock();
-        	client.flush();
-            client.stop();
-			pingRef = 0xFFFFFFFF;
-			waitRef = 0xFFFFFFFF;
-			if (callbackDisconnect != NULL) {
-				callbackDisconnect();
+	for (uint8_t i = 0; i < TELNETSPY_MAX_CLIENTS; i++) {
+		Session& session = sessions[i];
+		if (session.client.connected()) {
+			if (!session.connected) {
+				openSession(session);
 			}
+		} else if (session.connected) {
+			closeSession(session);
 		}
 	}
 
-	if (client.connected() && (bufUsed > 0)) {
-		if (bufUsed >= minBlockSize) {
-			sendBlock();
-		} else {
-			unsigned long m = millis() & 0x7FFFFFF;
-			if (waitRef == 0xFFFFFFFF) {
-				waitRef = m + collectingTime;
-				if (waitRef > 0x7FFFFFFF) {
-					waitRef -= 0x80000000;
-				}
+	for (uint8_t i = 0; i < TELNETSPY_MAX_CLIENTS; i++) {
+		Session& session = sessions[i];
+		if (!session.connected) {
+			continue;
+		}
+		uint32_t pending = bufHead.load(std::memory_order_acquire) - session.cursor;
+		if (pending > 0) {
+			if (pending >= minBlockSize) {
+				sendBlock(session);
 			} else {
-				if (!((waitRef < 0x20000000) && (m > 0x60000000)) && (m >= waitRef)) {
-					sendBlock();
+				unsigned long m = millis() & 0x7FFFFFF;
+				if (session.waitRef == 0xFFFFFFFF) {
+					session.waitRef = m + collectingTime;
+					if (session.waitRef > 0x7FFFFFFF) {
+						session.waitRef -= 0x80000000;
+					}
+				} else {
+					if (!((session.waitRef < 0x20000000) && (m > 0x60000000)) && (m >= session.waitRef)) {
+						sendBlock(session);
+					}
 				}
 			}
 		}
-	}
-	if (client.connected() && (pingRef != 0xFFFFFFFF)) {
-		unsigned long m = millis() & 0x7FFFFFF;
-		if (!((pingRef < 0x20000000) && (m > 0x60000000)) && (m >= pingRef)) {
-            if (nvtDetected) {
-                // Send a NOP via telnet NVT protocol
-			    addTelnetBuf(255);
-			    addTelnetBuf(241);
-            } else  {
-                // Send a NULL
-			    addTelnetBuf(0);
-            }
-			sendBlock();
+		if (session.pingRef != 0xFFFFFFFF) {
+			unsigned long m = millis() & 0x7FFFFFF;
+			if (!((session.pingRef < 0x20000000) && (m > 0x60000000)) && (m >= session.pingRef)) {
+				// Send a NOP via telnet NVT protocol, or a NULL, to this client only. It only
+				// comes after a quiet period, so it lands between blocks.
+				if (session.nvtDetected) {
+					session.client.write(NVT_NOP, sizeof(NVT_NOP));
+				} else {
+					session.client.write(NVT_NULL, sizeof(NVT_NULL));
+				}
+				schedulePing(session);
+			}
 		}
+		checkReceive(session);
 	}
-    if (client.connected()) {
-        checkReceive();
-    }
+	lastHandleMicros = micros() - handleStart;
+	maxHandleMicros = max(maxHandleMicros, lastHandleMicros);
 }
 
-void TelnetSpy::writeRecBuf(char c) {
-    if (recLen == recUsed) {
-        return;
-    }
+// Bulk copy into the receive ring; what does not fit is lost
+void TelnetSpy::writeRecBuf(const uint8_t* data, uint16_t size) {
+	if (!recBuf || (size == 0)) {
+		return;
+	}
 CRITCAL_SECTION_START
-	recBuf[recWrIdx++] = c;
+	size = min(size, (uint16_t) (recLen - recUsed));
+	uint16_t first = min(size, (uint16_t) (recLen - recWrIdx));
+	memcpy(&recBuf[recWrIdx], data, first);
+	memcpy(recBuf, &data[first], size - first);
+	recWrIdx += size;
 	if (recWrIdx >= recLen) {
-		recWrIdx = 0;
+		recWrIdx -= recLen;
 	}
-	recUsed++;
+	recUsed += size;
 CRITCAL_SECTION_END
 }
 
-void TelnetSpy::checkReceive() {
-	int n = client.available();
-	while (n > 0) {
-        char c, c2;
-        c = client.peek();
-        if (filterChar && (filterChar == c)) {
-            // Filter character detected
+void TelnetSpy::checkReceive(Session& session) {
+	if (!recBuf) {
+		// Data has to stay in the client for read(), so only the protocol bytes and the
+		// filter character in front of it are taken, one at a time
+		int c;
+		while (((c = session.client.peek()) != -1) &&
+			   ((session.nvtState != NVT_DATA) || (c == 255) || (filterChar && (filterChar == (char) c)) ||
+				(recordMode && (session.inCommand || (c == TELNETSPY_REPLAY_CHAR))))) {
+			uint8_t b = session.client.read();
+			parseReceived(session, &b, 1);
+			if (!session.connected) {
+				return;
+			}
+		}
+		return;
+	}
+	uint8_t chunk[TELNETSPY_REC_CHUNK_LEN];
+	int n;
+	while ((n = session.client.available()) > 0) {
+		n = session.client.read(chunk, min(n, (int) sizeof(chunk)));
+		if (n <= 0) {
+			return;
+		}
+		parseReceived(session, chunk, n);
+		if (!session.connected) {
+			// Aborted by an AO
+			return;
+		}
+	}
+}
+
+// Runs the NVT state machine over data. Kept bytes are compacted to the front of data
+// and go to the receive buffer in one copy, or before a callback so the order holds.
+void TelnetSpy::parseReceived(Session& session, uint8_t* data, uint16_t size) {
+	uint16_t kept = 0;
+	for (uint16_t i = 0; i < size; i++) {
+		uint8_t c = data[i];
+		if (recordMode && (session.nvtState == NVT_DATA) && (session.inCommand || (c == TELNETSPY_REPLAY_CHAR))) {
+			// Replay command line, not passed on
+			if (!session.inCommand) {
+				session.inCommand = true;
+				session.commandLen = 0;
+			} else if ((c == '\r') || (c == '\n')) {
+				session.inCommand = false;
+				session.command[session.commandLen] = 0;
+				replayCommand(session);
+			} else if (session.commandLen < sizeof(session.command) - 1) {
+				session.command[session.commandLen++] = c;
+			}
+			continue;
+		}
+		if ((session.nvtState == NVT_DATA) && filterChar && (filterChar == (char) c)) {
+			writeRecBuf(data, kept);
+			kept = 0;
 			if (strlen(filterMsg) > 0) {
-				client.write((const uint8_t*) filterMsg, strlen(filterMsg));
+				session.client.write((const uint8_t*) filterMsg, strlen(filterMsg));
 			}
-   			client.read();  // Remove filter character
-            n--;
-            if (filterCallback != NULL) {
-                filterCallback();
-            }
-            continue;
-        }
-		if (255 == c) {  // If IAC (start of telnet NVT protocol telegram):
-            if (n == 1) {
-                // Telegram incomplete
-                return;
-            }
-   			client.read();  // Remove IAC
-            n--;
-            c = client.read();  // Gett command byte
-            n--;
-            switch (c) {
-                case 241:   // Telnet command "NOP" (no operation)
-              		if (pingTime != 0) {
-  		            	pingRef = (millis() & 0x7FFFFFF) + pingTime;
-  		            }
-                    break;
-                case 242:   // Telnet command "Data Mark" (not yet implemented)
-                    break;
-                case 243:   // Telnet command "Break";
-                    if (callbackNvtBRK != NULL) {
-                        callbackNvtBRK();
-                    }
-                    break;
-                case 244:   // Telnet command "Interrupt process"
-                    if (callbackNvtIP != NULL) {
-                        if ((void(*)()) 1 == callbackNvtIP) {
-                            ESP.restart();
-                        } else {
-                            callbackNvtIP();
-                        }
-                    }
-                    break;
-                case 245:   // Telnet command "Abort output"
-                    if (callbackNvtAO != NULL) {
-                        if ((void(*)()) 1 == callbackNvtAO) {
-                            disconnectClient();
-                        } else {
-                            callbackNvtAO();
-                        }
-                    }
-                    break;
-                case 246:   // Telnet command "Are you there"
-                    if (callbackNvtAYT != NULL) {
-                        callbackNvtAYT();
-                    }
-                    break;
-                case 247:   // Telnet command "Erase character"
-                    if (callbackNvtEC != NULL) {
-                        callbackNvtEC();
-                    }
-                    break;
-                case 248:   // Telnet command "Erase line"
-                    if (callbackNvtEL != NULL) {
-                        callbackNvtEL();
-                    }
-                    break;
-                case 249:   // Telnet command "Go ahead"
-                    if (callbackNvtGA != NULL) {
-                        callbackNvtGA();
-                    }
-                    break;
-                case 250:   // Telnet command "SB" (additional data follows)
-                    while (n > 0) {
-                        c = client.read();
-                        n--;
-                        if (255 != c) {
-                            // If not IAC, ignore it
-                            continue;
-                        }
-                        c = client.read();
-                        n--;
-                        if (240 != c) {
-                            // If not SE (end of additional data), ignore it
-                            continue;
-                        }
-                    }
-                    break;
-                case 251:   // Telnet command "WILL"
-                case 252:   // Telnet command "WON'T"
-                case 253:   // Telnet command "DO"
-                case 254:   // Telnet command "DON'T"
-                    nvtDetected = true;
-                    c2 = client.read();     // Get option byte
-                    n--;
-                    if (callbackNvtWWDD != NULL) {
-                        callbackNvtWWDD(c, c2);
-                    }
-                    break;
-                case 255:   // Escaped data byte 0xff
-                    if (recBuf) {
-                        writeRecBuf(c);
-                    } else {
-                        // If no receive buffer is used, the data byte 0xff will be lost.
-                        // May be in the future there is a solution for this problem.
-                    }
-                    break;
-            }
-            continue;
-		}
-        // Next character in the client buffer is a normal character
-        if (recBuf) {
-            client.read();
-            writeRecBuf(c);
-            n--;
-            continue;
-        }
-        // Leave the character in the client buffer
-        return;
+			if (filterCallback != NULL) {
+				filterCallback();
+			}
+			continue;
+		}
+		uint8_t transition = NVT_TRANSITIONS[session.nvtState][(c < 240) ? (uint8_t) NVT_C_DATA : (uint8_t) NVT_CLASS[c - 240]];
+		session.nvtState = transition & 0x0F;
+		switch (transition & 0xF0) {
+			case NVT_A_KEEP:
+				data[kept++] = c;
+				break;
+			case NVT_A_COMMAND:
+				writeRecBuf(data, kept);
+				kept = 0;
+				nvtCommand(session, c);
+				if (!session.connected) {
+					return;
+				}
+				break;
+			case NVT_A_SAVE:
+				session.nvtDetected = true;
+				session.nvtCommand = c;
+				break;
+			case NVT_A_OPTION:
+				if (callbackNvtWWDD != NULL) {
+					writeRecBuf(data, kept);
+					kept = 0;
+					callbackNvtWWDD(session.nvtCommand, c);
+				}
+				break;
+		}
+	}
+	writeRecBuf(data, kept);
+}
+
+// "[e|w|i|d] [subsystem,...]": the highest level to show and the subsystems (names or
+// ids, all if none given). The client is rewound to the oldest record.
+void TelnetSpy::replayCommand(Session& session) {
+	const char* p = session.command;
+	while (*p == ' ') {
+		p++;
+	}
+	uint8_t level = TELNETSPY_LEVEL_DEBUG;
+	const char* found = *p ? strchr(LEVEL_KEYS, tolower(*p)) : NULL;
+	if (found) {
+		level = found - LEVEL_KEYS;
+		p++;
+	}
+	uint32_t mask = 0;
+	while (*p) {
+		while ((*p == ' ') || (*p == ',')) {
+			p++;
+		}
+		const char* start = p;
+		while (*p && (*p != ' ') && (*p != ',')) {
+			p++;
+		}
+		size_t n = p - start;
+		if (n == 0) {
+			break;
+		}
+		for (uint8_t i = 0; i < TELNETSPY_MAX_SUBSYSTEMS; i++) {
+			bool named = (i < subsystemCount) && subsystemNames[i] && (strlen(subsystemNames[i]) == n) && (strncasecmp(subsystemNames[i], start, n) == 0);
+			if (named || (isdigit(*start) && (atoi(start) == i))) {
+				mask |= 1UL << i;
+			}
+		}
 	}
+	session.maxLevel = level;
+	session.subsystems = mask ? mask : 0xFFFFFFFF;
+	session.cursor = bufTail.load(std::memory_order_acquire);
+	session.cursorMillis = tailMillis;
+	session.cursorTag = tailTag;
+	session.recordOffset = 0;
+	session.dropped = 0;
+	char msg[64];
+	int len = snprintf(msg, sizeof(msg), "\r\n[TelnetSpy: replay up to level %c, %s subsystems]\r\n", LEVEL_NAMES[level], mask ? "selected" : "all");
+	session.client.write((const uint8_t*) msg, min(len, (int) sizeof(msg) - 1));
 }
 
+void TelnetSpy::nvtCommand(Session& session, uint8_t command) {
+	switch (command) {
+		case 241:   // Telnet command "NOP" (no operation)
+			schedulePing(session);
+			break;
+		case 242:   // Telnet command "Data Mark" (not yet implemented)
+			break;
+		case 243:   // Telnet command "Break";
+			if (callbackNvtBRK != NULL) {
+				callbackNvtBRK();
+			}
+			break;
+		case 244:   // Telnet command "Interrupt process"
+			if (callbackNvtIP != NULL) {
+				if ((void(*)()) 1 == callbackNvtIP) {
+					ESP.restart();
+				} else {
+					callbackNvtIP();
+				}
+			}
+			break;
+		case 245:   // Telnet command "Abort output"
+			if (callbackNvtAO != NULL) {
+				if ((void(*)()) 1 == callbackNvtAO) {
+					closeSession(session);
+				} else {
+					callbackNvtAO();
+				}
+			}
+			break;
+		case 246:   // Telnet command "Are you there"
+			if (callbackNvtAYT != NULL) {
+				callbackNvtAYT();
+			}
+			break;
+		case 247:   // Telnet command "Erase character"
+			if (callbackNvtEC != NULL) {
+				callbackNvtEC();
+			}
+			break;
+		case 248:   // Telnet command "Erase line"
+			if (callbackNvtEL != NULL) {
+				callbackNvtEL();
+			}
+			break;
+		case 249:   // Telnet command "Go ahead"
+			if (callbackNvtGA != NULL) {
+				callbackNvtGA();
+			}
+			break;
+	}
+}
@@ -48,11 +48,22 @@
  * Default: "Connection established via TelnetSpy.\n"
  *		void setWelcomeMsg(char* msg);
  *
- * Change the message which will be send to the telnet client if another
- * session is already established.
- * Default: "TelnetSpy: Only one connection possible.\n"
+ * Change the message which will be send to the telnet client if all client
+ * slots are already in use.
+ * Default: "TelnetSpy: No more connections possible.\n"
  *		void setRejectMsg(char* msg);
  *
+ * Change the number of telnet clients which can be connected at the same time
+ * (1 to TELNETSPY_MAX_CLIENTS). All clients are served from the same transmit
+ * buffer, each with its own read position. Clients above the new limit will be
+ * disconnected.
+ * Default: TELNETSPY_MAX_CLIENTS
+ *		void setMaxClients(uint8_t count);
+ *		uint8_t getMaxClients();
+ *
+ * This function returns the number of connected telnet clients.
+ *		uint8_t getClientCount();
+ *
  * Change the amount of characters to collect before sending a telnet block.
  * Default: 64 
  *		void setMinBlockSize(uint16_t minSize);
@@ -71,8 +82,9 @@
  * cannot be send via telnet, it will be send to serial output only.
  * Changing size tries to preserve the already collected data. If the new
  * buffer size is too small the youngest data will be preserved only. Returns
- * false if the requested buffer size cannot be set.
- * Default: 3000
+ * false if the requested buffer size cannot be set. The size is rounded down
+ * to a power of two.
+ * Default: 2048
  *		bool setBufferSize(uint16_t newSize);
  *
  * This function returns the actual size of the transmit buffer.
@@ -116,28 +128,103 @@
  * Default: Serial
  *		void setSerial(HardwareSerial* usedSerial);
  *
- * This function returns true, if a telnet client is connected.
+ * How output reaches the serial port:
+ *  - TELNETSPY_MIRROR_SYNC: every write goes to the port right away and waits
+ *      while its transmit FIFO is full.
+ *  - TELNETSPY_MIRROR_ASYNC: the port is one more reader of the transmit buffer.
+ *      write() and handle() give it only what its FIFO takes (availableForWrite),
+ *      so they never wait for the UART. A port which falls behind loses the
+ *      oldest lines and gets a drop notice. In record mode it gets the rendered
+ *      records. The system's debug output goes the same way, so it only shows
+ *      while the main loop runs. Without a transmit buffer this is the same as
+ *      TELNETSPY_MIRROR_SYNC.
+ *  - TELNETSPY_MIRROR_OFF: nothing is written to the port.
+ * Leaving TELNETSPY_MIRROR_ASYNC for TELNETSPY_MIRROR_SYNC writes out the backlog
+ * first; leaving it for TELNETSPY_MIRROR_OFF discards the backlog.
+ * Default: TELNETSPY_MIRROR_SYNC
+ *		void setSerialMirror(uint8_t mode);
+ *		uint8_t getSerialMirror();
+ *
+ * These functions return the bytes waiting for the serial port (asynchronous
+ * mirror only) and the total time in microseconds the serial output waited
+ * for the UART. That is time spent in blocked writes for the synchronous
+ * mirror, and time the backlog had to wait on a full FIFO for the
+ * asynchronous one.
+ *		uint16_t getSerialBacklog();
+ *		uint32_t getSerialStallMicros();
+ *
+ * This function returns true, if at least one telnet client is connected.
  *		bool isClientConnected();
  *
  * This function installs a callback function which will be called on every
- * telnet connect of this object (except rejected connect tries). Use NULL to
- * remove the callback.
+ * telnet connect of this object (except rejected connect tries), once per
+ * client. Use NULL to remove the callback.
  * Default: NULL
  *		void setCallbackOnConnect(void (*callback)());
  *
  * This function installs a callback function which will be called on every
- * telnet disconnect of this object (except rejected connect tries). Use NULL
- * to remove the callback.
+ * telnet disconnect of this object (except rejected connect tries), once per
+ * client. Use NULL to remove the callback.
  * Default: NULL
  *		void setCallbackOnDisconnect(void (*callback)());
  *
- * This function disconnects an active client connection.
+ * This function disconnects all active client connections.
  *      void disconnectClient();
  *
  * This function clears the transmit buffer of TelnetSpy, so all waiting data
  * to send via a telnet connection will be discard.
  *      void clearBuffer();
  *
+ * When the transmit buffer overflows, the oldest lines are dropped and the
+ * next block sent to the telnet client starts with a "[TelnetSpy: N bytes
+ * dropped]" line. A client which cannot keep up does not hold back the others:
+ * it falls behind, loses the lines which are overwritten and gets the same
+ * notice. These functions return the totals since startup.
+ *      uint32_t getDroppedBytes();
+ *      uint32_t getDroppedLines();
+ *
+ * In record mode every line is stored as a record: a compact header with the
+ * millis timestamp (as a delta to the previous record), a level and a
+ * subsystem id, followed by the text without its line end. Timestamps, level
+ * and subsystem name are rendered when the record is sent, e.g.
+ * "[    123.456] W nws: unable to connect". Switching the mode clears the
+ * transmit buffer.
+ * Default: false
+ *      void setRecordMode(bool enable);
+ *      bool getRecordMode();
+ *
+ * Set the level (TELNETSPY_LEVEL_ERROR to TELNETSPY_LEVEL_DEBUG) and the
+ * subsystem id (0 to TELNETSPY_MAX_SUBSYSTEMS - 1) of the line written next.
+ * After its line end the tag falls back to TELNETSPY_LEVEL_INFO, subsystem 0.
+ *      void setRecordTag(uint8_t level, uint8_t subsystem);
+ *
+ * Names rendered for the subsystem ids; the array must stay valid. Ids without
+ * a name are rendered as "#id".
+ *      void setSubsystemNames(const char* const* names, uint8_t count);
+ *
+ * Log a printf style line whose format lives in flash (PSTR). In record mode
+ * only the format's address and the raw arguments are stored (strings are
+ * copied, "%n" is not supported), and the text is built when a client is sent
+ * the record. The line always ends after it; a trailing "\n" in the format is
+ * optional. While the serial port is used it still gets the text right away.
+ * Outside record mode it is the same as printf_P().
+ *      void printDeferred(PGM_P format, ...);
+ *
+ * In record mode a telnet client can type a line starting with
+ * TELNETSPY_REPLAY_CHAR to replay the buffered records with a filter, which
+ * stays in place for what follows: "~w" shows warnings and errors, "~d nws,1"
+ * everything of the subsystems "nws" and 1, "~" removes the filter.
+ *
+ * Sending never blocks the main loop: each handle() writes what fits in the
+ * TCP send window of each client (both ring segments in one pass) and stops
+ * once TELNETSPY_SEND_BUDGET_US is spent per client. These functions return how often the
+ * stack accepted less than offered, how often the window was full, and how
+ * long the last / longest handle() took.
+ *      uint32_t getPartialWrites();
+ *      uint32_t getSendStalls();
+ *      uint32_t getLastHandleMicros();
+ *      uint32_t getMaxHandleMicros();
+ *
  * This function allows to filter the character given by "ch" out of the
  * receiving telnet data stream. If this character is detected, the following
  * happens:
@@ -167,7 +254,7 @@
  * This function installs a callback function which will be called whenever
  * the telnet command "AO" (Abort Output) is received. Use NULL to remove the
  * callback.
- * Default: 1 (=> disconnectClient of TelnerSpy will be called)
+ * Default: 1 (=> the client which sent it will be disconnected)
  *		void setCallbackOnNvtAO)(void (*callback)());
  *
  * This function installs a callback function which will be called whenever
@@ -222,12 +309,18 @@
  * Transfering data also via telnet will need more performance than the serial
  * port only. So time critical things may be influenced.
  *
- * It is not possible to establish more than one telnet connection at the same
- * time. But its possible to use more than one instance of TelnetSpy.
+ * Up to TELNETSPY_MAX_CLIENTS telnet connections can be established at the
+ * same time (see setMaxClients). Its also possible to use more than one
+ * instance of TelnetSpy.
  *
  * If you have problems with low memory you may reduce the value of the define
  * TELNETSPY_BUFFER_LEN for a smaller ring buffer on initialisation.    
  *
+ * The transmit ring is lock free (atomic head and tail, no critical section)
+ * and the os_print hook stages into a ring of its own. What that does to
+ * interrupt latency is unmeasured -- a timer interrupt toggling a GPIO, read
+ * on a logic analyser with and without a busy telnet session, would show it.
+ *
  * Usage of void setDebugOutput(bool) to enable / disable of capturing of
  * os_print calls when you have more than one TelnetSpy instance: That
  * TelnetSpy object will handle this functionallity where you used
@@ -239,7 +332,7 @@
 #ifndef TelnetSpy_h
 #define TelnetSpy_h
 
-#define TELNETSPY_BUFFER_LEN 3000
+#define TELNETSPY_BUFFER_LEN 2048  // rounded down to a power of two
 #define TELNETSPY_MIN_BLOCK_SIZE 64
 #define TELNETSPY_COLLECTING_TIME 100
 #define TELNETSPY_MAX_BLOCK_SIZE 512
@@ -247,8 +340,28 @@
 #define TELNETSPY_PORT 23
 #define TELNETSPY_CAPTURE_OS_PRINT true
 #define TELNETSPY_WELCOME_MSG "Connection established via TelnetSpy.\r\n"
-#define TELNETSPY_REJECT_MSG "TelnetSpy: Only one connection possible.\r\n"
+#define TELNETSPY_REJECT_MSG "TelnetSpy: No more connections possible.\r\n"
+#define TELNETSPY_MAX_CLIENTS 3         // client slots, setMaxClients() can use fewer
 #define TELNETSPY_REC_BUFFER_LEN 64
+#define TELNETSPY_REC_CHUNK_LEN 64      // received bytes read from the client per call
+#define TELNETSPY_DEBUG_BUFFER_LEN 256  // os_printf staging, must be a power of two
+#define TELNETSPY_LINE_INDEX_LEN 64     // line starts remembered for overflow, must be a power of two
+#define TELNETSPY_SEND_BUDGET_US 2000  // sendBlock() stops writing after this much time in one pass
+#define TELNETSPY_DROP_MARKER "\r\n[TelnetSpy: %lu bytes dropped]\r\n"
+#define TELNETSPY_RECORD_LINE_LEN 127   // longest line stored as one record, longer lines are split
+#define TELNETSPY_RECORD_HEADER_MAX 7   // length, tag if changed and up to 5 bytes of timestamp delta
+#define TELNETSPY_RECORD_DEFERRED 0x80  // tag bit of a record holding a format and its arguments
+#define TELNETSPY_DEFERRED_TEXT_LEN 192 // longest text rendered from a deferred record
+#define TELNETSPY_REPLAY_CHAR '~'
+#define TELNETSPY_MAX_SUBSYSTEMS 32
+#define TELNETSPY_LEVEL_ERROR 0
+#define TELNETSPY_LEVEL_WARN 1
+#define TELNETSPY_LEVEL_INFO 2
+#define TELNETSPY_LEVEL_DEBUG 3
+#define TELNETSPY_MIRROR_OFF 0
+#define TELNETSPY_MIRROR_SYNC 1
+#define TELNETSPY_MIRROR_ASYNC 2
+#define TELNETSPY_SERIAL_FLUSH_TIME 1000  // ms flush() waits at most for the serial backlog
 
 #ifdef ESP8266
 #include <ESP8266WiFi.h>
@@ -269,6 +382,7 @@
 #define CRITCAL_SECTION_END portEXIT_CRITICAL(&AtomicMutex);
 #endif
 #include <WiFiClient.h>
+#include <atomic>
 
 class TelnetSpy : public Stream {
 	public:
@@ -291,11 +405,29 @@ class TelnetSpy : public Stream {
 		bool setRecBufferSize(uint16_t newSize);
 		uint16_t getRecBufferSize();
 		void setSerial(HardwareSerial* usedSerial);
+		void setSerialMirror(uint8_t mode);
+		uint8_t getSerialMirror();
+		uint16_t getSerialBacklog();
+		uint32_t getSerialStallMicros();
 		bool isClientConnected();
+		void setMaxClients(uint8_t count);
+		uint8_t getMaxClients();
+		uint8_t getClientCount();
 		void setCallbackOnConnect(void (*callback)());
 		void setCallbackOnDisconnect(void (*callback)());
         void disconnectClient();
         void clearBuffer();
+        void setRecordMode(bool enable);
+        bool getRecordMode();
+        void setRecordTag(uint8_t level, uint8_t subsystem);
+        void setSubsystemNames(const char* const* names, uint8_t count);
+        void printDeferred(PGM_P format, ...) __attribute__ ((format (printf, 2, 3)));
+        uint32_t getDroppedBytes();
+        uint32_t getDroppedLines();
+        uint32_t getPartialWrites();
+        uint32_t getSendStalls();
+        uint32_t getLastHandleMicros();
+        uint32_t getMaxHandleMicros();
         void setFilter(char ch, const char* msg, void (*callback)());
         void setFilter(char ch, const String& msg, void (*callback)());
         char getFilter();
@@ -332,6 +464,7 @@ class TelnetSpy : public Stream {
 		void flush(void) override;
 		void debugWrite(uint8_t);
 		size_t write(uint8_t) override;
+		size_t write(const uint8_t* data, size_t size) override;
 		inline size_t write(unsigned long n) { return write((uint8_t) n); }
 		inline size_t write(long n) { return write((uint8_t) n); }
 		inline size_t write(unsigned int n) { return write((uint8_t) n); }
@@ -342,26 +475,79 @@ class TelnetSpy : public Stream {
 		uint32_t baudRate(void);
 
 	protected:
+		// A reader of the ring: a telnet client or the asynchronous serial mirror. All
+		// read the same ring; cursor uses the same free running numbering as bufHead /
+		// bufTail.
+		struct Reader {
+			uint32_t cursor;
+			uint32_t dropped;  // bytes this reader missed, reported with the next block
+			// Record mode
+			uint32_t cursorMillis;   // timestamp and tag of the record before cursor
+			uint8_t cursorTag;
+			uint16_t recordOffset;   // rendered bytes of the record at cursor already sent
+			uint8_t maxLevel;
+			uint32_t subsystems;     // bit per subsystem shown
+		};
+		// One connected telnet client
+		struct Session : Reader {
+			WiFiClient client;
+			bool connected;
+			bool nvtDetected;
+			uint8_t nvtState;    // receive parser, kept across reads
+			uint8_t nvtCommand;  // WILL / WON'T / DO / DON'T waiting for its option
+			unsigned long waitRef;
+			unsigned long pingRef;
+			bool inCommand;
+			uint8_t commandLen;
+			char command[24];
+		};
 		CRITCAL_SECTION_MUTEX
-		void sendBlock(void);
-		void addTelnetBuf(char c);
-		char pullTelnetBuf();
-		char peekTelnetBuf();
+		void sendBlock(Session& session);
+		uint32_t sendReader(Reader& reader, Print& out, size_t window, uint32_t started);
+		Reader* activeReader(uint8_t index);  // 0 to TELNETSPY_MAX_CLIENTS, NULL if not reading
+		bool serialQueued();
+		void drainSerial();
+		size_t writeSerial(const uint8_t* data, size_t size);
+		void sendAll();
+		void releaseSent();
+		void openSession(Session& session);
+		void closeSession(Session& session);
+		void schedulePing(Session& session);
+		Session* inputSession();
+		uint16_t telnetUsed();
+		void storeTelnetBuf(const uint8_t* data, size_t size);
+		void addTelnetBuf(const uint8_t* data, uint16_t size);
+		void discardOldestLine();
+		void indexLines(const void* data, uint16_t size, uint32_t offset);
+		void noteDropped(uint32_t bytes, uint16_t lines, bool stored);
+		void makeRoom(size_t size);
+		void assembleRecord(const uint8_t* data, size_t size);
+		void storeRecord();
+		void commitRecord(uint16_t len, uint8_t tag);
+		void storeDeferred(PGM_P format, va_list args);
+		uint16_t renderDeferred(uint32_t pos, uint8_t len, char* text, uint16_t size);
+		uint8_t readRecordHeader(uint32_t pos, uint8_t& len, uint8_t& tag, uint32_t& delta);  // tag: in the previous, out this one
+		uint32_t sendRecords(Reader& reader, Print& out, size_t window, uint32_t started);
+		void catchUp(Reader& reader);
+		void replayCommand(Session& session);
+		void advanceTail(uint32_t target);
+		void drainDebugBuf();
 		int telnetAvailable();
-        void writeRecBuf(char c);
-        void checkReceive();
+        void writeRecBuf(const uint8_t* data, uint16_t size);
+        void checkReceive(Session& session);
+        void parseReceived(Session& session, uint8_t* data, uint16_t size);
+        void nvtCommand(Session& session, uint8_t command);
 		WiFiServer* telnetServer;
-		WiFiClient client;
+		Session sessions[TELNETSPY_MAX_CLIENTS];
+		uint8_t maxClients;
+		uint8_t activeClients;
 		uint16_t port;
 		HardwareSerial* usedSer;
 		bool storeOffline;
 		bool started;
 		bool listening;
 		bool firstMainLoop;
-		unsigned long waitRef;
-		unsigned long pingRef;
 		uint16_t pingTime;
-        bool nvtDetected;
 		char* welcomeMsg;
 		char* rejectMsg;
         char filterChar;
@@ -371,17 +557,52 @@ class TelnetSpy : public Stream {
 		uint16_t collectingTime;
 		uint16_t maxBlockSize;
 		bool debugOutput;
+		// Single producer (write) / single consumer (sendBlock) ring with free running
+		// indices; used = head - tail, position = index & bufMask
 		char* telnetBuf;
 		uint16_t bufLen;
-		uint16_t bufUsed;
-		uint16_t bufRdIdx;
-		uint16_t bufWrIdx;
+		uint16_t bufMask;
+		std::atomic<uint32_t> bufHead;
+		std::atomic<uint32_t> bufTail;
+		// os_printf hook -> main task, drained into telnetBuf by write() and handle()
+		char dbgBuf[TELNETSPY_DEBUG_BUFFER_LEN];
+		std::atomic<uint32_t> dbgHead;
+		std::atomic<uint32_t> dbgTail;
+		std::atomic<uint32_t> dbgDropped;
+		// Producer owned ring of line start offsets (same numbering as bufHead / bufTail)
+		uint32_t lineStarts[TELNETSPY_LINE_INDEX_LEN];
+		uint16_t lineHead;
+		uint16_t lineTail;
+		uint32_t droppedBytes;
+		uint32_t droppedLines;
+		// Dropped while no client was connected, reported to the next one to connect
+		std::atomic<uint32_t> pendingDrop;
+		// Record mode: the line being assembled, with room for its header in front
+		bool recordMode;
+		uint8_t recordTag;
+		char lineBuf[TELNETSPY_RECORD_HEADER_MAX + TELNETSPY_RECORD_LINE_LEN];
+		uint16_t lineLen;
+		uint32_t lastRecordMillis;  // timestamp and tag of the youngest record
+		uint8_t lastRecordTag;
+		uint32_t tailMillis;        // timestamp and tag of the record before the tail
+		uint8_t tailTag;
+		const char* const* subsystemNames;
+		uint8_t subsystemCount;
+		// Serial mirror
+		uint8_t serialMirror;
+		Reader serialReader;
+		uint32_t serialStallMicros;
+		uint32_t serialStallStart;
+		bool serialStalled;
+		uint32_t partialWrites;
+		uint32_t sendStalls;
+		uint32_t lastHandleMicros;
+		uint32_t maxHandleMicros;
 		char* recBuf;
 		uint16_t recLen;
 		uint16_t recUsed;
 		uint16_t recRdIdx;
 		uint16_t recWrIdx;
-		bool connected;
 		void (*callbackConnect)();
 		void (*callbackDisconnect)();
         void (*callbackNvtBRK)();
@@ -0,0 +1,105 @@
+/***************************************************************************
+Copyright © 2023 Shell M. Shrader <shell at shellware dot com>
+----------------------------------------------------------------------------
+This work is free. You can redistribute it and/or modify it under the
+terms of the Do What The Fuck You Want To Public License, Version 2,
+as published by Sam Hocevar. See the COPYING file for more details.
+****************************************************************************/
+#include <math.h>
+
+#include "adaptive_sampler.h"
+
+AdaptiveSampler::AdaptiveSampler() {
+    setThresholds(0, ADAPTIVE_TEMPERATURE_RATE, ADAPTIVE_TEMPERATURE_DEVIATION);
+    setThresholds(1, ADAPTIVE_PRESSURE_RATE, ADAPTIVE_PRESSURE_DEVIATION);
+    setThresholds(2, ADAPTIVE_HUMIDITY_RATE, ADAPTIVE_HUMIDITY_DEVIATION);
+    configure(1000, 1000, 1000);
+}
+
+void AdaptiveSampler::configure(uint32_t minInterval, uint32_t maxInterval, uint32_t startInterval) {
+    min_interval = minInterval;
+    max_interval = maxInterval < minInterval ? minInterval : maxInterval;
+    start_interval = startInterval < min_interval ? min_interval : (startInterval > max_interval ? max_interval : startInterval);
+    reset();
+}
+
+void AdaptiveSampler::setThresholds(uint8_t channel, float rate, float deviation) {
+    if (channel >= ADAPTIVE_CHANNELS) return;
+    channels[channel].rate_threshold = rate;
+    channels[channel].deviation_threshold = deviation;
+}
+
+void AdaptiveSampler::reset() {
+    for (uint8_t i = 0; i < ADAPTIVE_CHANNELS; i++) {
+        channels[i].previous = 0;
+        channels[i].rate = 0;
+        channels[i].mean = 0;
+        channels[i].variance = 0;
+    }
+    interval = start_interval;
+    last_timestamp = 0;
+    activity = 0;
+    flat_samples = 0;
+    primed = false;
+}
+
+uint32_t AdaptiveSampler::update(const int32_t values[ADAPTIVE_CHANNELS], uint32_t timestamp) {
+    if (!primed) {
+        for (uint8_t i = 0; i < ADAPTIVE_CHANNELS; i++) {
+            channels[i].previous = values[i];
+            channels[i].mean = values[i];
+        }
+        last_timestamp = timestamp;
+        primed = true;
+        return interval;
+    }
+
+    const uint32_t elapsed = timestamp - last_timestamp;
+    last_timestamp = timestamp;
+    if (elapsed == 0) return interval;
+
+    activity = 0;
+
+    for (uint8_t i = 0; i < ADAPTIVE_CHANNELS; i++) {
+        ADAPTIVE_CHANNEL_TYPE& ch = channels[i];
+
+        const float rate = fabsf((float) (values[i] - ch.previous)) * 1000.0f / elapsed;
+        ch.previous = values[i];
+        ch.rate += ADAPTIVE_SMOOTHING * (rate - ch.rate);
+
+        // west's incremental ew mean / variance
+        const float residual = values[i] - ch.mean;
+        ch.mean += ADAPTIVE_SMOOTHING * residual;
+        ch.variance = (1 - ADAPTIVE_SMOOTHING) * (ch.variance + ADAPTIVE_SMOOTHING * residual * residual);
+
+        const float rateActivity = ch.rate / ch.rate_threshold;
+        const float deviationActivity = sqrtf(ch.variance) / ch.deviation_threshold;
+        if (rateActivity > activity) activity = rateActivity;
+        if (deviationActivity > activity) activity = deviationActivity;
+    }
+
+    if (activity >= 1) {
+        // attack immediately
+        interval = min_interval;
+        flat_samples = 0;
+    } else if (flat_samples < ADAPTIVE_HOLD_SAMPLES) {
+        flat_samples++;
+    } else {
+        // decay exponentially
+        interval = interval > max_interval / 2 ? max_interval : interval * 2;
+    }
+
+    return interval;
+}
+
+uint32_t AdaptiveSampler::getInterval() const {
+    return interval;
+}
+
+float AdaptiveSampler::getActivity() const {
+    return activity;
+}
+
+bool AdaptiveSampler::isActive() const {
+    return activity >= 1;
+}
@@ -0,0 +1,274 @@
+/***************************************************************************
+Copyright © 2023 Shell M. Shrader <shell at shellware dot com>
+----------------------------------------------------------------------------
+This work is free. You can redistribute it and/or modify it under the
+terms of the Do What The Fuck You Want To Public License, Version 2,
+as published by Sam Hocevar. See the COPYING file for more details.
+****************************************************************************/
+#include "bme280_sensor.h"
+
+#define BME280_REGISTER_DATA           0xF7
+#define BME280_DATA_LEN                8
+
+// a channel disabled by oversampling (or not yet converted) reads as this
+#define BME280_SKIPPED_20BIT           0x80000
+#define BME280_SKIPPED_16BIT           0x8000
+
+#define BME280_STATUS_MEASURING        0x08
+
+// indexed by the Adafruit_BME280 enums
+static const uint8_t  OVERSAMPLING_FACTORS[] = { 0, 1, 2, 4, 8, 16 };
+static const uint8_t  FILTER_COEFFICIENTS[]  = { 0, 2, 4, 8, 16 };
+static const uint32_t STANDBY_MICROS[]       = { 500, 62500, 125000, 250000, 500000, 1000000, 10000, 20000 };
+
+bool BME280Sensor::beginSPI(int8_t csPin, uint32_t clock, SPIClass* theSPI) {
+    if (i2c_dev) {
+        delete i2c_dev;
+        i2c_dev = NULL;
+    }
+    if (spi_dev) {
+        delete spi_dev;
+    }
+
+    _cs = csPin;
+    spi_dev = new Adafruit_SPIDevice(csPin, clock > BME280_MAX_SPI_CLOCK ? BME280_MAX_SPI_CLOCK : clock, SPI_BITORDER_MSBFIRST, SPI_MODE0, theSPI);
+
+    // begin() takes the spi path whenever spi_dev is set, so a failed probe
+    // must not leave it behind for a later i2c begin() on this object
+    if (begin()) return true;
+
+    reset();
+    return false;
+}
+
+// sample wakes from deep sleep: the sensor stayed powered, so skip init()'s
+// soft reset and its 100 ms of settling and only re-read the calibration
+bool BME280Sensor::resume(uint8_t addr, TwoWire* theWire) {
+    reset();
+
+    i2c_dev = new Adafruit_I2CDevice(addr, theWire);
+    if (i2c_dev->begin() && attach()) return true;
+
+    reset();
+    return false;
+}
+
+bool BME280Sensor::resumeSPI(int8_t csPin, uint32_t clock, SPIClass* theSPI) {
+    reset();
+
+    _cs = csPin;
+    spi_dev = new Adafruit_SPIDevice(csPin, clock > BME280_MAX_SPI_CLOCK ? BME280_MAX_SPI_CLOCK : clock, SPI_BITORDER_MSBFIRST, SPI_MODE0, theSPI);
+    if (spi_dev->begin() && attach()) return true;
+
+    reset();
+    return false;
+}
+
+// a forced conversion leaves the sensor asleep, where it takes config writes;
+// ctrl_meas is left to startForcedMeasurement() so the first write converts
+void BME280Sensor::resumeForced(sensor_sampling tempSampling, sensor_sampling pressSampling,
+                                sensor_sampling humSampling, sensor_filter filter) {
+    sensorMode = MODE_FORCED;
+    osrsT = tempSampling;
+    osrsP = pressSampling;
+    osrsH = humSampling;
+    standby = STANDBY_MS_0_5;
+
+    write8(BME280_REGISTER_CONTROLHUMID, humSampling);
+    write8(BME280_REGISTER_CONFIG, filter << 2);
+}
+
+bool BME280Sensor::attach() {
+    if (read8(BME280_REGISTER_CHIPID) != BME280_CHIP_ID) return false;
+
+    readCoefficients();
+    return true;
+}
+
+// drop either bus device so the next begin() starts from scratch
+void BME280Sensor::reset() {
+    if (spi_dev) {
+        delete spi_dev;
+        spi_dev = NULL;
+    }
+    if (i2c_dev) {
+        delete i2c_dev;
+        i2c_dev = NULL;
+    }
+}
+
+bool BME280Sensor::isSPI() {
+    return spi_dev != NULL;
+}
+
+void BME280Sensor::configure(sensor_mode mode, sensor_sampling tempSampling, sensor_sampling pressSampling,
+                             sensor_sampling humSampling, sensor_filter filter, standby_duration duration) {
+    sensorMode = mode;
+    osrsT = tempSampling;
+    osrsP = pressSampling;
+    osrsH = humSampling;
+    standby = duration;
+
+    setSampling(mode, tempSampling, pressSampling, humSampling, filter, duration);
+}
+
+bool BME280Sensor::isForced() {
+    return sensorMode == MODE_FORCED;
+}
+
+// kicks off one conversion without waiting on it -- unlike
+// takeForcedMeasurement() which polls the status register with delay(1)
+bool BME280Sensor::startForcedMeasurement() {
+    if (sensorMode != MODE_FORCED) return false;
+
+    write8(BME280_REGISTER_CONTROL, (osrsT << 5) | (osrsP << 2) | MODE_FORCED);
+    return true;
+}
+
+bool BME280Sensor::isMeasuring() {
+    return read8(BME280_REGISTER_STATUS) & BME280_STATUS_MEASURING;
+}
+
+uint32_t BME280Sensor::getMeasurementMicros() {
+    return measurementMicros(osrsT, osrsP, osrsH);
+}
+
+uint32_t BME280Sensor::getStandbyMicros() {
+    return sensorMode == MODE_NORMAL ? standbyMicros(standby) : 0;
+}
+
+// datasheet 9.1 maximum measurement time:
+// 1.25 + 2.3 * osrs_t + (2.3 * osrs_p + 0.575) + (2.3 * osrs_h + 0.575) ms
+uint32_t BME280Sensor::measurementMicros(sensor_sampling tempSampling, sensor_sampling pressSampling, sensor_sampling humSampling) {
+    uint32_t total = 1250;
+
+    if (tempSampling != SAMPLING_NONE) total += 2300 * OVERSAMPLING_FACTORS[tempSampling];
+    if (pressSampling != SAMPLING_NONE) total += 2300 * OVERSAMPLING_FACTORS[pressSampling] + 575;
+    if (humSampling != SAMPLING_NONE) total += 2300 * OVERSAMPLING_FACTORS[humSampling] + 575;
+
+    return total;
+}
+
+uint32_t BME280Sensor::standbyMicros(standby_duration duration) {
+    return STANDBY_MICROS[duration];
+}
+
+int8_t BME280Sensor::samplingFromFactor(long factor) {
+    // SAMPLING_NONE is not offered -- every channel is published
+    for (uint8_t i = SAMPLING_X1; i < sizeof(OVERSAMPLING_FACTORS); i++) {
+        if (OVERSAMPLING_FACTORS[i] == factor) return i;
+    }
+    return -1;
+}
+
+uint8_t BME280Sensor::factorFromSampling(sensor_sampling sampling) {
+    return OVERSAMPLING_FACTORS[sampling];
+}
+
+int8_t BME280Sensor::filterFromCoefficient(long coefficient) {
+    for (uint8_t i = 0; i < sizeof(FILTER_COEFFICIENTS); i++) {
+        if (FILTER_COEFFICIENTS[i] == coefficient) return i;
+    }
+    return -1;
+}
+
+uint8_t BME280Sensor::coefficientFromFilter(sensor_filter filter) {
+    return FILTER_COEFFICIENTS[filter];
+}
+
+int8_t BME280Sensor::standbyFromMillis(float millis) {
+    for (uint8_t i = 0; i < sizeof(STANDBY_MICROS) / sizeof(STANDBY_MICROS[0]); i++) {
+        if ((uint32_t) (millis * 1000) == STANDBY_MICROS[i]) return i;
+    }
+    return -1;
+}
+
+float BME280Sensor::millisFromStandby(standby_duration duration) {
+    return STANDBY_MICROS[duration] / 1000.0;
+}
+
+bool BME280Sensor::readSample(BME280_READING_TYPE* reading) {
+    uint8_t buffer[BME280_DATA_LEN];
+
+    const unsigned long start = micros();
+    const bool ok = readDataRegisters(buffer, sizeof(buffer));
+    busMicros = micros() - start;
+
+    if (!ok) return false;
+
+    const int32_t adc_P = ((uint32_t) buffer[0] << 12) | ((uint32_t) buffer[1] << 4) | (buffer[2] >> 4);
+    const int32_t adc_T = ((uint32_t) buffer[3] << 12) | ((uint32_t) buffer[4] << 4) | (buffer[5] >> 4);
+    const int32_t adc_H = ((uint32_t) buffer[6] << 8) | buffer[7];
+
+    if (adc_T == BME280_SKIPPED_20BIT) return false;
+
+    // temperature first -- it sets t_fine for the other two
+    reading->temperature = compensateTemperature(adc_T) * 10L;
+    reading->pressure = adc_P == BME280_SKIPPED_20BIT ? 0 : (compensatePressure(adc_P) * 10UL + 128) >> 8;
+    reading->humidity = adc_H == BME280_SKIPPED_16BIT ? 0 : (compensateHumidity(adc_H) * 1000UL + 512) >> 10;
+
+    return true;
+}
+
+unsigned long BME280Sensor::getBusMicros() {
+    return busMicros;
+}
+
+bool BME280Sensor::readDataRegisters(uint8_t* buffer, size_t len) {
+    uint8_t reg = BME280_REGISTER_DATA;
+
+    if (spi_dev) {
+        reg |= 0x80;
+        return spi_dev->write_then_read(&reg, 1, buffer, len);
+    }
+    if (i2c_dev) {
+        return i2c_dev->write_then_read(&reg, 1, buffer, len);
+    }
+    return false;
+}
+
+// datasheet 4.2.3 -- returns 0.01 C
+int32_t BME280Sensor::compensateTemperature(int32_t adc_T) {
+    const int32_t var1 = ((((adc_T >> 3) - ((int32_t) _bme280_calib.dig_T1 << 1))) * ((int32_t) _bme280_calib.dig_T2)) >> 11;
+    const int32_t var2 = (((((adc_T >> 4) - ((int32_t) _bme280_calib.dig_T1)) * ((adc_T >> 4) - ((int32_t) _bme280_calib.dig_T1))) >> 12) *
+                          ((int32_t) _bme280_calib.dig_T3)) >> 14;
+
+    t_fine = var1 + var2 + t_fine_adjust;
+    return (t_fine * 5 + 128) >> 8;
+}
+
+// datasheet 4.2.3 -- returns Pa in Q24.8.  Signed terms are scaled by
+// multiplying, since left shifts of negative values are undefined
+// before C++20.
+uint32_t BME280Sensor::compensatePressure(int32_t adc_P) {
+    int64_t var1 = ((int64_t) t_fine) - 128000;
+    int64_t var2 = var1 * var1 * (int64_t) _bme280_calib.dig_P6;
+    var2 = var2 + var1 * (int64_t) _bme280_calib.dig_P5 * 131072;
+    var2 = var2 + (int64_t) _bme280_calib.dig_P4 * 34359738368LL;
+    var1 = ((var1 * var1 * (int64_t) _bme280_calib.dig_P3) >> 8) + var1 * (int64_t) _bme280_calib.dig_P2 * 4096;
+    var1 = (((((int64_t) 1) << 47) + var1)) * ((int64_t) _bme280_calib.dig_P1) >> 33;
+
+    if (var1 == 0) return 0;  // avoid a divide by zero
+
+    int64_t p = 1048576 - adc_P;
+    p = (((p << 31) - var2) * 3125) / var1;
+    var1 = (((int64_t) _bme280_calib.dig_P9) * (p >> 13) * (p >> 13)) >> 25;
+    var2 = (((int64_t) _bme280_calib.dig_P8) * p) >> 19;
+    p = ((p + var1 + var2) >> 8) + (int64_t) _bme280_calib.dig_P7 * 16;
+
+    return (uint32_t) p;
+}
+
+// datasheet 4.2.3 -- returns %RH in Q22.10
+uint32_t BME280Sensor::compensateHumidity(int32_t adc_H) {
+    int32_t v_x1 = t_fine - ((int32_t) 76800);
+
+    v_x1 = (((((adc_H << 14) - ((int32_t) _bme280_calib.dig_H4 * 1048576) - (((int32_t) _bme280_calib.dig_H5) * v_x1)) + ((int32_t) 16384)) >> 15) *
+            (((((((v_x1 * ((int32_t) _bme280_calib.dig_H6)) >> 10) * (((v_x1 * ((int32_t) _bme280_calib.dig_H3)) >> 11) + ((int32_t) 32768))) >> 10) +
+               ((int32_t) 2097152)) * ((int32_t) _bme280_calib.dig_H2) + 8192) >> 14));
+    v_x1 = v_x1 - (((((v_x1 >> 15) * (v_x1 >> 15)) >> 7) * ((int32_t) _bme280_calib.dig_H1)) >> 4);
+    v_x1 = v_x1 < 0 ? 0 : v_x1;
+    v_x1 = v_x1 > 419430400 ? 419430400 : v_x1;
+
+    return (uint32_t) (v_x1 >> 12);
+}
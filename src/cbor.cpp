@@ -0,0 +1,78 @@
+/***************************************************************************
+Copyright © 2023 Shell M. Shrader <shell at shellware dot com>
+----------------------------------------------------------------------------
+This work is free. You can redistribute it and/or modify it under the
+terms of the Do What The Fuck You Want To Public License, Version 2,
+as published by Sam Hocevar. See the COPYING file for more details.
+****************************************************************************/
+#include "cbor.h"
+
+#define CBOR_MAJOR_UNSIGNED 0
+#define CBOR_MAJOR_NEGATIVE 1
+#define CBOR_MAJOR_ARRAY    4
+#define CBOR_MAJOR_MAP      5
+
+CborWriter::CborWriter(uint8_t* buffer, size_t capacity) {
+    buf = buffer;
+    cap = capacity;
+    len = 0;
+    overflow = false;
+}
+
+void CborWriter::writeUnsigned(uint32_t value) {
+    writeHead(CBOR_MAJOR_UNSIGNED, value);
+}
+
+void CborWriter::writeInt(int32_t value) {
+    if (value < 0) {
+        // major type 1 carries -1 - n
+        writeHead(CBOR_MAJOR_NEGATIVE, (uint32_t) (-1 - value));
+    } else {
+        writeHead(CBOR_MAJOR_UNSIGNED, (uint32_t) value);
+    }
+}
+
+void CborWriter::beginArray(size_t items) {
+    writeHead(CBOR_MAJOR_ARRAY, items);
+}
+
+void CborWriter::beginMap(size_t pairs) {
+    writeHead(CBOR_MAJOR_MAP, pairs);
+}
+
+size_t CborWriter::length() const {
+    return len;
+}
+
+bool CborWriter::overflowed() const {
+    return overflow;
+}
+
+void CborWriter::writeHead(uint8_t major, uint32_t value) {
+    major <<= 5;
+
+    if (value < 24) {
+        put(major | value);
+    } else if (value <= 0xFF) {
+        put(major | 24);
+        put(value);
+    } else if (value <= 0xFFFF) {
+        put(major | 25);
+        put(value >> 8);
+        put(value);
+    } else {
+        put(major | 26);
+        put(value >> 24);
+        put(value >> 16);
+        put(value >> 8);
+        put(value);
+    }
+}
+
+void CborWriter::put(uint8_t value) {
+    if (len >= cap) {
+        overflow = true;
+        return;
+    }
+    buf[len++] = value;
+}
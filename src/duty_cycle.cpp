@@ -0,0 +1,119 @@
+/***************************************************************************
+Copyright © 2023 Shell M. Shrader <shell at shellware dot com>
+----------------------------------------------------------------------------
+This work is free. You can redistribute it and/or modify it under the
+terms of the Do What The Fuck You Want To Public License, Version 2,
+as published by Sam Hocevar. See the COPYING file for more details.
+****************************************************************************/
+#include "duty_cycle.h"
+
+void DutyCycle::configure(uint32_t sampleInterval, uint8_t samplesPerPublish) {
+    sample_interval = sampleInterval;
+    samples_per_publish = samplesPerPublish;
+}
+
+void DutyCycle::begin(DUTY_CYCLE_STATE_TYPE* retained, bool restored) {
+    state = retained;
+
+    if (!restored) {
+        // a cold boot (or a corrupt block) starts a fresh timeline and brings the radio up
+        state->clock = 0;
+        state->wakes = 0;
+        state->last_calibration = UINT32_MAX;
+        state->charge = 0;
+        state->quiet_awake = 0;
+        state->quiet_wakes = 0;
+        state->next_action = DUTY_CYCLE_PUBLISH;
+    }
+
+    state->wakes++;
+}
+
+duty_cycle_action DutyCycle::getAction() const {
+    return (duty_cycle_action) state->next_action;
+}
+
+uint32_t DutyCycle::sleep(uint32_t awake, uint32_t radio, uint16_t samplesHeld) {
+    // keep the sample cadence -- time spent awake comes out of the sleep
+    const uint32_t duration = awake + DUTY_CYCLE_MIN_SLEEP >= sample_interval ? DUTY_CYCLE_MIN_SLEEP : sample_interval - awake;
+
+    if (radio > awake) radio = awake;
+    const float charge = (awake - radio) * DUTY_CYCLE_AWAKE_MA + radio * DUTY_CYCLE_RADIO_MA + duration * DUTY_CYCLE_SLEEP_MA;
+
+    cycle_current = charge / (awake + duration);
+    state->charge += charge;
+    state->clock += awake + duration;
+
+    // radio-off wakes cannot log, so their totals ride along to the next radio wake
+    if (radio == 0) {
+        state->quiet_wakes++;
+        state->quiet_awake += awake;
+    } else {
+        quiet_wakes = state->quiet_wakes;
+        quiet_awake = state->quiet_awake;
+        state->quiet_wakes = 0;
+        state->quiet_awake = 0;
+    }
+
+    // the wake that takes the last sample of a window also publishes it
+    state->next_action = samplesHeld + 1 >= samples_per_publish ? DUTY_CYCLE_PUBLISH : DUTY_CYCLE_SAMPLE;
+
+    return duration;
+}
+
+uint32_t DutyCycle::getClock() const {
+    return state->clock;
+}
+
+float DutyCycle::getCycleCurrent() const {
+    return cycle_current;
+}
+
+float DutyCycle::getAverageCurrent() const {
+    return state->clock > 0 ? state->charge / state->clock : 0;
+}
+
+uint16_t DutyCycle::getQuietWakes() const {
+    return quiet_wakes;
+}
+
+uint32_t DutyCycle::getQuietAwake() const {
+    return quiet_awake;
+}
+
+uint32_t DutyCycle::crc32(const uint8_t* data, size_t length) {
+    // bitwise ieee 802.3 -- a few hundred bytes once per wake does not justify a table
+    uint32_t crc = 0xFFFFFFFF;
+
+    while (length--) {
+        crc ^= *data++;
+        for (uint8_t bit = 0; bit < 8; bit++) {
+            crc = (crc >> 1) ^ (0xEDB88320 & (0 - (crc & 1)));
+        }
+    }
+
+    return ~crc;
+}
+
+void DutyCycle::seal(void* block, size_t length) {
+    DUTY_CYCLE_STATE_TYPE* header = (DUTY_CYCLE_STATE_TYPE*) block;
+
+    header->magic = DUTY_CYCLE_MAGIC;
+    header->length = length;
+    header->crc = 0;
+    header->crc = crc32((const uint8_t*) block, length);
+}
+
+bool DutyCycle::verify(void* block, size_t length) {
+    DUTY_CYCLE_STATE_TYPE* header = (DUTY_CYCLE_STATE_TYPE*) block;
+
+    if (header->magic != DUTY_CYCLE_MAGIC || header->length != length) return false;
+
+    // the crc was computed with its own field zeroed
+    const uint32_t crc = header->crc;
+    header->crc = 0;
+    const bool valid = crc32((const uint8_t*) block, length) == crc;
+    header->crc = crc;
+
+    return valid;
+}
@@ -0,0 +1,274 @@
+/***************************************************************************
+Copyright © 2023 Shell M. Shrader <shell at shellware dot com>
+----------------------------------------------------------------------------
+This work is free. You can redistribute it and/or modify it under the
+terms of the Do What The Fuck You Want To Public License, Version 2,
+as published by Sam Hocevar. See the COPYING file for more details.
+****************************************************************************/
+#include "influx_exporter.h"
+
+#ifdef esp32
+    #include <WiFi.h>
+#else
+    #include <ESP8266WiFi.h>
+#endif
+
+// anything earlier means sntp has not set the clock yet
+#define INFLUX_MIN_VALID_EPOCH 1600000000
+
+static size_t appendMilli(char* buf, size_t capacity, const char* field, const long value) {
+    const unsigned long magnitude = value < 0 ? -value : value;
+    const int written = snprintf(buf, capacity, "%s=%s%lu.%03lu,", field, value < 0 ? "-" : "", magnitude / 1000, magnitude % 1000);
+    return written < 0 ? capacity : written;
+}
+
+static size_t appendChannel(char* buf, size_t capacity, const char* name, const WINDOW_CHANNEL_TYPE& channel) {
+    char field[24];
+    size_t len = appendMilli(buf, capacity, name, channel.average);
+
+    snprintf(field, sizeof(field), "%s_low", name);
+    if (len < capacity) len += appendMilli(&buf[len], capacity - len, field, channel.low);
+
+    snprintf(field, sizeof(field), "%s_high", name);
+    if (len < capacity) len += appendMilli(&buf[len], capacity - len, field, channel.high);
+
+    return len;
+}
+
+InfluxExporter::InfluxExporter() {
+    server = NULL;
+    database = NULL;
+    host = NULL;
+    port = 0;
+    resolved = false;
+    started = false;
+    startedRef = 0;
+    linesSent = 0;
+    bytesSent = 0;
+    linesDropped = 0;
+    formatMicros = 0;
+    sendMillis = 0;
+    resetBatch();
+    resetOutbox();
+}
+
+void InfluxExporter::begin(const char* serverHost, uint16_t serverPort, const char* databaseName, const char* hostTag) {
+    server = serverHost;
+    database = databaseName && strlen(databaseName) > 0 ? databaseName : NULL;
+    host = hostTag;
+    port = serverPort > 0 ? serverPort : (database ? INFLUX_HTTP_PORT : INFLUX_UDP_PORT);
+    resolved = false;
+    started = true;
+    startedRef = millis();
+    resetBatch();
+    resetOutbox();
+}
+
+void InfluxExporter::end() {
+    started = false;
+    resetBatch();
+    resetOutbox();
+}
+
+bool InfluxExporter::isStarted() {
+    return started;
+}
+
+bool InfluxExporter::addWindow(const WINDOW_TYPE& window, time_t epoch) {
+    if (!started) return false;
+
+    const bool timestamped = epoch >= INFLUX_MIN_VALID_EPOCH;
+    char line[INFLUX_LINE_LEN];
+
+    const unsigned long start = micros();
+    const size_t len = formatLine(line, sizeof(line), window, timestamped ? epoch : 0);
+    formatMicros = micros() - start;
+
+    if (len == 0) {
+        linesDropped++;
+        return false;
+    }
+
+    // with every outbox still waiting the batch has nowhere to go
+    if (batchLen + len > sizeof(batch) && !queueBatch()) {
+        linesDropped++;
+        return false;
+    }
+
+    memcpy(&batch[batchLen], line, len);
+    batchLen += len;
+    batchLines++;
+    if (!timestamped) batchUnstamped = true;
+
+    if (batchLines >= INFLUX_BATCH_WINDOWS) queueBatch();
+
+    return true;
+}
+
+// a full queue leaves the batch in place until handle() frees an outbox
+bool InfluxExporter::queueBatch() {
+    if (batchLen == 0) return true;
+    if (outboxCount >= INFLUX_OUTBOX_DEPTH) return false;
+
+    const uint8_t slot = (outboxHead + outboxCount) % INFLUX_OUTBOX_DEPTH;
+    memcpy(outbox[slot], batch, batchLen);
+    outboxLen[slot] = batchLen;
+    outboxLines[slot] = batchLines;
+    outboxCount++;
+    resetBatch();
+    return true;
+}
+
+bool InfluxExporter::handle() {
+    if (!started) return false;
+
+    // untimestamped lines get the arrival time -- ship the pass now so a
+    // later pass for the same sensor is not stamped on top of it
+    if (batchUnstamped || batchLines >= INFLUX_BATCH_WINDOWS) queueBatch();
+
+    if (outboxCount == 0) return false;
+    if (retries > 0 && millis() - retryRef < (unsigned long) INFLUX_RETRY_DELAY << (retries - 1)) return false;
+
+    if (send()) return true;
+
+    retryRef = millis();
+    if (++retries > INFLUX_MAX_RETRIES) {
+        linesDropped += outboxLines[outboxHead];
+        popOutbox();
+    }
+    return false;
+}
+
+uint32_t InfluxExporter::getLinesSent() {
+    return linesSent;
+}
+
+uint32_t InfluxExporter::getBytesSent() {
+    return bytesSent;
+}
+
+uint32_t InfluxExporter::getLinesDropped() {
+    return linesDropped;
+}
+
+uint32_t InfluxExporter::getFormatMicros() {
+    return formatMicros;
+}
+
+// duration of the last send attempt, successful or not
+uint32_t InfluxExporter::getSendMillis() {
+    return sendMillis;
+}
+
+// delivered lines over the time since begin()
+float InfluxExporter::getLinesPerSecond() {
+    const unsigned long elapsed = millis() - startedRef;
+    return elapsed > 0 ? linesSent * 1000.0 / elapsed : 0;
+}
+
+size_t InfluxExporter::formatLine(char* line, size_t capacity, const WINDOW_TYPE& window, time_t epoch) {
+    int written = snprintf(line, capacity, INFLUX_MEASUREMENT ",host=%s,sensor=%u ", host ? host : "unknown", window.sensor);
+    if (written < 0 || (size_t) written >= capacity) return 0;
+    size_t len = written;
+
+    if (len < capacity) len += appendChannel(&line[len], capacity - len, "temperature", window.temperature);
+    if (len < capacity) len += appendChannel(&line[len], capacity - len, "humidity", window.humidity);
+    if (len < capacity) len += appendChannel(&line[len], capacity - len, "pressure", window.pressure);
+    if (len < capacity) len += appendChannel(&line[len], capacity - len, "altitude", window.altitude);
+    if (len >= capacity) return 0;
+
+    // rssi is kept as |dBm| -- publish it signed like the HA sensor
+    written = epoch ?
+        snprintf(&line[len], capacity - len, "rssi=%ldi,samples=%di,sequence=%luu %lu000000000\n", -window.rssi.average, window.sample_count, window.sequence, (unsigned long) epoch) :
+        snprintf(&line[len], capacity - len, "rssi=%ldi,samples=%di,sequence=%luu\n", -window.rssi.average, window.sample_count, window.sequence);
+    if (written < 0 || (size_t) written >= capacity - len) return 0;
+
+    return len + written;
+}
+
+bool InfluxExporter::send() {
+    const unsigned long start = millis();
+    const bool sent = resolve() && (database ? sendHttp() : sendUdp());
+    sendMillis = millis() - start;
+
+    // the collector may have moved -- look it up again on the next try
+    if (!sent) {
+        resolved = false;
+        return false;
+    }
+
+    linesSent += outboxLines[outboxHead];
+    bytesSent += outboxLen[outboxHead];
+    popOutbox();
+    return true;
+}
+
+// the lookup is cached so a send costs no dns round trip
+bool InfluxExporter::resolve() {
+    if (resolved) return true;
+
+#ifdef esp32
+    resolved = WiFi.hostByName(server, serverIp) == 1;
+#else
+    resolved = WiFi.hostByName(server, serverIp, INFLUX_TIMEOUT) == 1;
+#endif
+    return resolved;
+}
+
+bool InfluxExporter::sendUdp() {
+    if (!udp.beginPacket(serverIp, port)) return false;
+    udp.write((const uint8_t*) outbox[outboxHead], outboxLen[outboxHead]);
+    return udp.endPacket();
+}
+
+bool InfluxExporter::sendHttp() {
+    WiFiClient client;
+    client.setTimeout(INFLUX_TIMEOUT);
+
+#ifdef esp32
+    if (!client.connect(serverIp, port, INFLUX_TIMEOUT)) return false;
+#else
+    // the esp8266 core bounds the connect by setTimeout()
+    if (!client.connect(serverIp, port)) return false;
+#endif
+
+    char header[160];
+    const int headerLen = snprintf(header, sizeof(header),
+        "POST /write?db=%s&precision=ns HTTP/1.0\r\nHost: %s\r\nContent-Type: text/plain\r\nContent-Length: %u\r\n\r\n",
+        database, server, (unsigned int) outboxLen[outboxHead]);
+    if (headerLen < 0 || (size_t) headerLen >= sizeof(header)) {
+        client.stop();
+        return false;
+    }
+
+    client.write((const uint8_t*) header, headerLen);
+    client.write((const uint8_t*) outbox[outboxHead], outboxLen[outboxHead]);
+
+    // only the status line matters -- influx answers 204 on success
+    char status[16] = {0};
+    client.readBytes(status, sizeof(status) - 1);
+    client.stop();
+
+    return strncmp(status, "HTTP/1.", 7) == 0 && status[9] == '2';
+}
+
+void InfluxExporter::resetBatch() {
+    batchLen = 0;
+    batchLines = 0;
+    batchUnstamped = false;
+}
+
+void InfluxExporter::resetOutbox() {
+    outboxHead = 0;
+    outboxCount = 0;
+    retries = 0;
+    retryRef = 0;
+}
+
+// the next outbox starts with a fresh retry budget
+void InfluxExporter::popOutbox() {
+    outboxHead = (outboxHead + 1) % INFLUX_OUTBOX_DEPTH;
+    outboxCount--;
+    retries = 0;
+    retryRef = 0;
+}
@@ -10,20 +10,36 @@ as published by Sam Hocevar. See the COPYING file for more details.
 #ifdef BS_USE_TELNETSPY
 void setExtraRemoteCommands(char c) {
   if (c == '?') {
-    LOG_PRINTLN(bs.builtInRemoteCommandsMenu + "P = Sea Level Pressure\n? = This menu\n");
+    LOG_PRINTLN(bs.builtInRemoteCommandsMenu + "P = Sea Level Pressure\nM = Serial mirror on / off\nH = Window history\n? = This menu\n");
+  }
+  if (c == 'H') {
+    lockHistory();
+    LOG_PRINTF("\nWindow history: %lu windows in %u of %u bytes, %lu evicted\n\n", (unsigned long) history.getCount(),
+               history.getBytesUsed(), WINDOW_HISTORY_SIZE, (unsigned long) history.getEvicted());
+    unlockHistory();
+  }
+  if (c == 'M') {
+    // a quiet UART in production; the backlog and stall time show what the mirror costs
+    SerialAndTelnet.setSerialMirror(SerialAndTelnet.getSerialMirror() == TELNETSPY_MIRROR_OFF ? TELNETSPY_MIRROR_ASYNC : TELNETSPY_MIRROR_OFF);
+    LOG_PRINTF("\nSerial mirror %s, backlog %u bytes, stalled %lu ms\n\n", SerialAndTelnet.getSerialMirror() == TELNETSPY_MIRROR_OFF ? "off" : "on",
+               SerialAndTelnet.getSerialBacklog(), (unsigned long) SerialAndTelnet.getSerialStallMicros() / 1000);
   }
   if (c == 'P') {
-    SEALEVELPRESSURE_HPA = getSeaLevelPressure();
-    LOG_PRINTLN("\nSea Level Pressure: [" + String(SEALEVELPRESSURE_HPA) + "]\n");        
+    if (bme280_config.station_elevation_flag == CFG_SET) {
+      crossCheckSeaLevel();
+    } else {
+      SEALEVELPRESSURE_HPA = getSeaLevelPressure();
+      LOG_TAG(INFO, SUBSYSTEM_NWS);
+      LOG_PRINTLN("\nSea Level Pressure: [" + String(SEALEVELPRESSURE_HPA) + "]\n");        
+    }
+    logNwsStations();
   }
 }
 #endif
 
-float finalTemp = 0.0;
-float finalHumid = 0.0;
-float finalAlt = 0.0;
-float finalPres = 0.0;
 short finalRssi = 0;
+float finalSampleRate = 0.0;
+float finalDutyCycle = 100.0;
 
 void updateExtraConfigItem(const String item, String value) {
     if (item == MQTT_SERVER) {
@@ -90,6 +106,267 @@ void updateExtraConfigItem(const String item, String value) {
       } else {
           bme280_config.nws_station_flag = CFG_NOT_SET;
       }    
+      nwsStations.parse(bme280_config.nws_station_flag == CFG_SET ? bme280_config.nws_station : "");
+      return;
+    }
+
+    if (item == MQTT_RAW_TOPIC) {
+      memset(bme280_config.mqtt_raw_topic, CFG_NOT_SET, MQTT_RAW_TOPIC_LEN);
+      if (value.length() > 0) {
+          value.toCharArray(bme280_config.mqtt_raw_topic, MQTT_RAW_TOPIC_LEN);
+          bme280_config.mqtt_raw_topic_flag = CFG_SET;
+      } else {
+          bme280_config.mqtt_raw_topic_flag = CFG_NOT_SET;
+      }
+      return;
+    }
+
+    if (item == INFLUX_SERVER) {
+      memset(bme280_config.influx_server, CFG_NOT_SET, INFLUX_SERVER_LEN);
+      if (value.length() > 0) {
+          value.toCharArray(bme280_config.influx_server, INFLUX_SERVER_LEN);
+          bme280_config.influx_server_flag = CFG_SET;
+      } else {
+          bme280_config.influx_server_flag = CFG_NOT_SET;
+      }
+      return;
+    }
+
+    if (item == INFLUX_PORT) {
+      const long influx_port = value.toInt();
+      if (influx_port > 0 && influx_port <= USHRT_MAX) {
+          bme280_config.influx_port = influx_port;
+          bme280_config.influx_port_flag = CFG_SET;
+      } else {
+          bme280_config.influx_port_flag = CFG_NOT_SET;
+          bme280_config.influx_port = 0;
+      }
+      return;
+    }
+
+    if (item == INFLUX_DB) {
+      memset(bme280_config.influx_db, CFG_NOT_SET, INFLUX_DB_LEN);
+      if (value.length() > 0) {
+          value.toCharArray(bme280_config.influx_db, INFLUX_DB_LEN);
+          bme280_config.influx_db_flag = CFG_SET;
+      } else {
+          bme280_config.influx_db_flag = CFG_NOT_SET;
+      }
+      return;
+    }
+
+    if (item == SPI_CS_PIN) {
+      if (isNumeric(value) && value.toInt() < CFG_NOT_SET) {
+          bme280_config.spi_cs_pin = value.toInt();
+          bme280_config.spi_cs_pin_flag = CFG_SET;
+      } else {
+          bme280_config.spi_cs_pin_flag = CFG_NOT_SET;
+          bme280_config.spi_cs_pin = CFG_NOT_SET;
+      }
+      return;
+    }
+
+    if (item == OSRS_TEMPERATURE) {
+      const int8_t sampling = BME280Sensor::samplingFromFactor(value.toInt());
+      if (sampling >= 0 && sampling != DEFAULT_OVERSAMPLING) {
+          bme280_config.osrs_temperature = sampling;
+          bme280_config.osrs_temperature_flag = CFG_SET;
+      } else {
+          bme280_config.osrs_temperature_flag = CFG_NOT_SET;
+          bme280_config.osrs_temperature = DEFAULT_OVERSAMPLING;
+      }
+      return;
+    }
+
+    if (item == OSRS_PRESSURE) {
+      const int8_t sampling = BME280Sensor::samplingFromFactor(value.toInt());
+      if (sampling >= 0 && sampling != DEFAULT_OVERSAMPLING) {
+          bme280_config.osrs_pressure = sampling;
+          bme280_config.osrs_pressure_flag = CFG_SET;
+      } else {
+          bme280_config.osrs_pressure_flag = CFG_NOT_SET;
+          bme280_config.osrs_pressure = DEFAULT_OVERSAMPLING;
+      }
+      return;
+    }
+
+    if (item == OSRS_HUMIDITY) {
+      const int8_t sampling = BME280Sensor::samplingFromFactor(value.toInt());
+      if (sampling >= 0 && sampling != DEFAULT_OVERSAMPLING) {
+          bme280_config.osrs_humidity = sampling;
+          bme280_config.osrs_humidity_flag = CFG_SET;
+      } else {
+          bme280_config.osrs_humidity_flag = CFG_NOT_SET;
+          bme280_config.osrs_humidity = DEFAULT_OVERSAMPLING;
+      }
+      return;
+    }
+
+    if (item == IIR_FILTER) {
+      const int8_t filter = BME280Sensor::filterFromCoefficient(value.toInt());
+      if (filter >= 0 && filter != DEFAULT_IIR_FILTER) {
+          bme280_config.iir_filter = filter;
+          bme280_config.iir_filter_flag = CFG_SET;
+      } else {
+          bme280_config.iir_filter_flag = CFG_NOT_SET;
+          bme280_config.iir_filter = DEFAULT_IIR_FILTER;
+      }
+      return;
+    }
+
+    if (item == STANDBY_TIME) {
+      const int8_t standby = BME280Sensor::standbyFromMillis(value.toFloat());
+      if (standby >= 0 && standby != DEFAULT_STANDBY) {
+          bme280_config.standby = standby;
+          bme280_config.standby_flag = CFG_SET;
+      } else {
+          bme280_config.standby_flag = CFG_NOT_SET;
+          bme280_config.standby = DEFAULT_STANDBY;
+      }
+      return;
+    }
+
+    if (item == SENSOR_MODE) {
+      if (value == "forced") {
+          bme280_config.sensor_mode = Adafruit_BME280::MODE_FORCED;
+          bme280_config.sensor_mode_flag = CFG_SET;
+      } else {
+          bme280_config.sensor_mode_flag = CFG_NOT_SET;
+          bme280_config.sensor_mode = Adafruit_BME280::MODE_NORMAL;
+      }
+      return;
+    }
+
+    if (item == HIGH_RATE_PERIOD) {
+      const long period = value.toInt();
+      if (period > 0 && period <= USHRT_MAX) {
+          bme280_config.high_rate_period = period;
+          bme280_config.high_rate_period_flag = CFG_SET;
+      } else {
+          bme280_config.high_rate_period_flag = CFG_NOT_SET;
+          bme280_config.high_rate_period = 0;
+      }
+      return;
+    }
+
+    if (item == MQTT_FAST_TOPIC) {
+      memset(bme280_config.mqtt_fast_topic, CFG_NOT_SET, MQTT_FAST_TOPIC_LEN);
+      if (value.length() > 0) {
+          value.toCharArray(bme280_config.mqtt_fast_topic, MQTT_FAST_TOPIC_LEN);
+          bme280_config.mqtt_fast_topic_flag = CFG_SET;
+      } else {
+          bme280_config.mqtt_fast_topic_flag = CFG_NOT_SET;
+      }
+      return;
+    }
+
+    if (item == ESTIMATOR) {
+      const int8_t mode = StreamEstimator::modeFromName(value.c_str());
+      if (mode > ESTIMATOR_OFF) {
+          bme280_config.estimator = mode;
+          bme280_config.estimator_flag = CFG_SET;
+      } else {
+          bme280_config.estimator_flag = CFG_NOT_SET;
+          bme280_config.estimator = ESTIMATOR_OFF;
+      }
+      return;
+    }
+
+    if (item == EMA_ALPHA) {
+      const float alpha = value.toFloat();
+      if (alpha > 0 && alpha <= 1) {
+          bme280_config.ema_alpha = alpha;
+          bme280_config.ema_alpha_flag = CFG_SET;
+      } else {
+          bme280_config.ema_alpha_flag = CFG_NOT_SET;
+          bme280_config.ema_alpha = DEFAULT_EMA_ALPHA;
+      }
+      return;
+    }
+
+    if (item == KALMAN_Q) {
+      const float q = value.toFloat();
+      if (q > 0) {
+          bme280_config.kalman_q = q;
+          bme280_config.kalman_q_flag = CFG_SET;
+      } else {
+          bme280_config.kalman_q_flag = CFG_NOT_SET;
+          bme280_config.kalman_q = DEFAULT_KALMAN_Q;
+      }
+      return;
+    }
+
+    if (item == KALMAN_R) {
+      const float r = value.toFloat();
+      if (r > 0) {
+          bme280_config.kalman_r = r;
+          bme280_config.kalman_r_flag = CFG_SET;
+      } else {
+          bme280_config.kalman_r_flag = CFG_NOT_SET;
+          bme280_config.kalman_r = DEFAULT_KALMAN_R;
+      }
+      return;
+    }
+
+    if (item == ADAPTIVE_MIN_INTERVAL) {
+      const unsigned long interval = strtoul(value.c_str(), 0, 10);
+      if (interval > 0) {
+          bme280_config.adaptive_min_interval = interval;
+          bme280_config.adaptive_min_interval_flag = CFG_SET;
+      } else {
+          bme280_config.adaptive_min_interval_flag = CFG_NOT_SET;
+          bme280_config.adaptive_min_interval = 0;
+      }
+      return;
+    }
+
+    if (item == ADAPTIVE_MAX_INTERVAL) {
+      const unsigned long interval = strtoul(value.c_str(), 0, 10);
+      if (interval > 0) {
+          bme280_config.adaptive_max_interval = interval;
+          bme280_config.adaptive_max_interval_flag = CFG_SET;
+      } else {
+          bme280_config.adaptive_max_interval_flag = CFG_NOT_SET;
+          bme280_config.adaptive_max_interval = 0;
+      }
+      return;
+    }
+
+    if (item == STATION_ELEVATION) {
+      // metres above sea level -- below it is fine (death valley, the dead sea)
+      if (isNumeric(value.startsWith("-") ? value.substring(1) : value)) {
+          bme280_config.station_elevation = value.toFloat();
+          bme280_config.station_elevation_flag = CFG_SET;
+      } else {
+          bme280_config.station_elevation_flag = CFG_NOT_SET;
+          bme280_config.station_elevation = 0;
+      }
+      return;
+    }
+
+    if (item == RADIO_SLEEP) {
+      bme280_config.radio_sleep = RADIO_SLEEP_OFF;
+      for (tiny_int mode = RADIO_SLEEP_MODEM; mode <= RADIO_SLEEP_LIGHT; mode++) {
+        if (value == RADIO_SLEEP_NAMES[mode]) bme280_config.radio_sleep = mode;
+      }
+      bme280_config.radio_sleep_flag = bme280_config.radio_sleep == RADIO_SLEEP_OFF ? CFG_NOT_SET : CFG_SET;
+      return;
+    }
+
+    if (item == DEEP_SLEEP) {
+      bme280_config.deep_sleep_flag = value == "on" ? CFG_SET : CFG_NOT_SET;
+      return;
+    }
+
+    if (item == SPI_CLOCK) {
+      const unsigned long spi_clock = strtoul(value.c_str(), 0, 10);
+      if (spi_clock > 0 && spi_clock <= BME280_MAX_SPI_CLOCK) {
+          bme280_config.spi_clock = spi_clock;
+          bme280_config.spi_clock_flag = CFG_SET;
+      } else {
+          bme280_config.spi_clock_flag = CFG_NOT_SET;
+          bme280_config.spi_clock = BME280_DEFAULT_SPI_CLOCK;
+      }
       return;
     }
 }
@@ -122,26 +399,126 @@ void updateExtraHtmlTemplateItems(String *html) {
     html->replace(escParam(NWS_STATION), String(bme280_config.nws_station));
   }
 
+  while (html->indexOf(escParam(MQTT_RAW_TOPIC), 0) != -1) {
+    html->replace(escParam(MQTT_RAW_TOPIC), String(bme280_config.mqtt_raw_topic));
+  }
+
+  while (html->indexOf(escParam(INFLUX_SERVER), 0) != -1) {
+    html->replace(escParam(INFLUX_SERVER), String(bme280_config.influx_server));
+  }
+
+  while (html->indexOf(escParam(INFLUX_PORT), 0) != -1) {
+    html->replace(escParam(INFLUX_PORT), bme280_config.influx_port_flag == CFG_SET ? String(bme280_config.influx_port) : String());
+  }
+
+  while (html->indexOf(escParam(INFLUX_DB), 0) != -1) {
+    html->replace(escParam(INFLUX_DB), String(bme280_config.influx_db));
+  }
+
+  while (html->indexOf(escParam(OSRS_TEMPERATURE), 0) != -1) {
+    html->replace(escParam(OSRS_TEMPERATURE), String(BME280Sensor::factorFromSampling((Adafruit_BME280::sensor_sampling) bme280_config.osrs_temperature)));
+  }
+
+  while (html->indexOf(escParam(OSRS_PRESSURE), 0) != -1) {
+    html->replace(escParam(OSRS_PRESSURE), String(BME280Sensor::factorFromSampling((Adafruit_BME280::sensor_sampling) bme280_config.osrs_pressure)));
+  }
+
+  while (html->indexOf(escParam(OSRS_HUMIDITY), 0) != -1) {
+    html->replace(escParam(OSRS_HUMIDITY), String(BME280Sensor::factorFromSampling((Adafruit_BME280::sensor_sampling) bme280_config.osrs_humidity)));
+  }
+
+  while (html->indexOf(escParam(IIR_FILTER), 0) != -1) {
+    html->replace(escParam(IIR_FILTER), String(BME280Sensor::coefficientFromFilter((Adafruit_BME280::sensor_filter) bme280_config.iir_filter)));
+  }
+
+  while (html->indexOf(escParam(STANDBY_TIME), 0) != -1) {
+    html->replace(escParam(STANDBY_TIME), toFloatStr(BME280Sensor::millisFromStandby((Adafruit_BME280::standby_duration) bme280_config.standby), 1));
+  }
+
+  while (html->indexOf(escParam(SENSOR_MODE), 0) != -1) {
+    html->replace(escParam(SENSOR_MODE), bme280_config.sensor_mode == Adafruit_BME280::MODE_FORCED ? "forced" : "normal");
+  }
+
+  while (html->indexOf(escParam(HIGH_RATE_PERIOD), 0) != -1) {
+    html->replace(escParam(HIGH_RATE_PERIOD), bme280_config.high_rate_period_flag == CFG_SET ? String(bme280_config.high_rate_period) : String());
+  }
+
+  while (html->indexOf(escParam(MQTT_FAST_TOPIC), 0) != -1) {
+    html->replace(escParam(MQTT_FAST_TOPIC), String(bme280_config.mqtt_fast_topic));
+  }
+
+  while (html->indexOf(escParam(ESTIMATOR), 0) != -1) {
+    html->replace(escParam(ESTIMATOR), StreamEstimator::nameFromMode((estimator_mode) bme280_config.estimator));
+  }
+
+  while (html->indexOf(escParam(EMA_ALPHA), 0) != -1) {
+    html->replace(escParam(EMA_ALPHA), toFloatStr(bme280_config.ema_alpha, 3));
+  }
+
+  while (html->indexOf(escParam(KALMAN_Q), 0) != -1) {
+    html->replace(escParam(KALMAN_Q), toFloatStr(bme280_config.kalman_q, 3));
+  }
+
+  while (html->indexOf(escParam(KALMAN_R), 0) != -1) {
+    html->replace(escParam(KALMAN_R), toFloatStr(bme280_config.kalman_r, 3));
+  }
+
+  while (html->indexOf(escParam(ADAPTIVE_MIN_INTERVAL), 0) != -1) {
+    html->replace(escParam(ADAPTIVE_MIN_INTERVAL), bme280_config.adaptive_min_interval_flag == CFG_SET ? String(bme280_config.adaptive_min_interval) : String());
+  }
+
+  while (html->indexOf(escParam(ADAPTIVE_MAX_INTERVAL), 0) != -1) {
+    html->replace(escParam(ADAPTIVE_MAX_INTERVAL), bme280_config.adaptive_max_interval_flag == CFG_SET ? String(bme280_config.adaptive_max_interval) : String());
+  }
+
+  while (html->indexOf(escParam(STATION_ELEVATION), 0) != -1) {
+    html->replace(escParam(STATION_ELEVATION), bme280_config.station_elevation_flag == CFG_SET ? toFloatStr(bme280_config.station_elevation, 1) : String());
+  }
+
+  while (html->indexOf(escParam(RADIO_SLEEP), 0) != -1) {
+    html->replace(escParam(RADIO_SLEEP), RADIO_SLEEP_NAMES[bme280_config.radio_sleep_flag == CFG_SET ? bme280_config.radio_sleep : RADIO_SLEEP_OFF]);
+  }
+
+  while (html->indexOf(escParam(DEEP_SLEEP), 0) != -1) {
+    html->replace(escParam(DEEP_SLEEP), bme280_config.deep_sleep_flag == CFG_SET ? "on" : "off");
+  }
+
+  while (html->indexOf(escParam(SPI_CS_PIN), 0) != -1) {
+    html->replace(escParam(SPI_CS_PIN), bme280_config.spi_cs_pin_flag == CFG_SET ? String(bme280_config.spi_cs_pin) : String());
+  }
+
+  while (html->indexOf(escParam(SPI_CLOCK), 0) != -1) {
+    html->replace(escParam(SPI_CLOCK), String(bme280_config.spi_clock));
+  }
+
+  // the page shows the streaming estimate when there is one, mqtt keeps the window averages
+  const SENSOR_PIPELINE_TYPE& shown = pipelines[0];
+  const bool streaming = streaming_mode != ESTIMATOR_OFF && shown.estimators[READING_PRESSURE].isPrimed();
+
   while (html->indexOf(escParam(TEMPERATURE), 0) != -1) {
-    html->replace(escParam(TEMPERATURE), toFloatStr(finalTemp, 3));
+    html->replace(escParam(TEMPERATURE), toFloatStr(streaming ? shown.stream_temperature : shown.final_temperature, 3));
   }
 
   while (html->indexOf(escParam(HUMIDITY), 0) != -1) {
-    html->replace(escParam(HUMIDITY), toFloatStr(finalHumid, 3));
+    html->replace(escParam(HUMIDITY), toFloatStr(streaming ? shown.stream_humidity : shown.final_humidity, 3));
   }
 
   while (html->indexOf(escParam(ALTITUDE), 0) != -1) {
-    html->replace(escParam(ALTITUDE), toFloatStr(finalAlt, 3));
+    html->replace(escParam(ALTITUDE), toFloatStr(streaming ? shown.stream_altitude : shown.final_altitude, 3));
   }
 
   while (html->indexOf(escParam(PRESSURE), 0) != -1) {
-    html->replace(escParam(PRESSURE), toFloatStr(finalPres, 3));
+    html->replace(escParam(PRESSURE), toFloatStr(streaming ? shown.stream_pressure : shown.final_pressure, 3));
   }
 
   while (html->indexOf(escParam(_RSSI), 0) != -1) {
     html->replace(escParam(_RSSI), String(finalRssi));
   }
 
+  while (html->indexOf(escParam(SAMPLE_RATE), 0) != -1) {
+    html->replace(escParam(SAMPLE_RATE), toFloatStr(finalSampleRate, 1));
+  }
+
   while (html->indexOf(escParam(SEA_LEVEL_ATMOSPHERIC_PRESSURE), 0) != -1) {
       html->replace(escParam(SEA_LEVEL_ATMOSPHERIC_PRESSURE), String(SEALEVELPRESSURE_HPA * HPA_TO_INHG));
   }
@@ -149,135 +526,800 @@ void updateExtraHtmlTemplateItems(String *html) {
 
 void setup() {
 #ifdef BS_USE_TELNETSPY
+  SerialAndTelnet.setRecordMode(true);
+  SerialAndTelnet.setSerialMirror(TELNETSPY_MIRROR_ASYNC);
+  SerialAndTelnet.setSubsystemNames(LOG_SUBSYSTEM_NAMES, sizeof(LOG_SUBSYSTEM_NAMES) / sizeof(LOG_SUBSYSTEM_NAMES[0]));
   bs.setExtraRemoteCommands(setExtraRemoteCommands);
 #endif
+  // a radio-off sample wake never reaches Bootstrap -- it samples, banks the window and sleeps again
+  const bool restored = loadRetainedState();
+  // only a timer wake of a deep sleep build may skip it -- a warm reboot left mid-cycle boots in full
+  if (restored && retained.deep_sleep && retained.cycle.next_action == DUTY_CYCLE_SAMPLE && isDeepSleepWake()) sampleWake();
+
+  if (!restored) {
+    // power on (or a corrupt block) -- nothing to resume
+    retained = RETAINED_STATE_TYPE();
+    retained.cycle.last_calibration = UINT32_MAX;
+    retained.calibration_age = ULONG_MAX;
+  }
+
   bs.setConfig(&bme280_config, sizeof(bme280_config));
   bs.updateExtraConfigItem(updateExtraConfigItem);
   bs.updateExtraHtmlTemplateItems(updateExtraHtmlTemplateItems);
   bs.setup();
 
+#ifdef esp32
+  history_mutex = xSemaphoreCreateMutex();
+#endif
+  server.on("/api/history", HTTP_GET, handleHistoryRequest);
+
   updateExtraConfigItem(MQTT_SERVER, bme280_config.mqtt_server);
   updateExtraConfigItem(MQTT_USER, bme280_config.mqtt_user);
   updateExtraConfigItem(MQTT_PWD, bme280_config.mqtt_pwd);
   updateExtraConfigItem(SAMPLES_PER_PUBLISH, String(bme280_config.samples_per_publish));
   updateExtraConfigItem(PUBLISH_INTERVAL, String(bme280_config.publish_interval));
   updateExtraConfigItem(NWS_STATION, bme280_config.nws_station);
-
-  if (!bme.begin()) {
+  updateExtraConfigItem(MQTT_RAW_TOPIC, bme280_config.mqtt_raw_topic);
+  updateExtraConfigItem(INFLUX_SERVER, bme280_config.influx_server);
+  updateExtraConfigItem(INFLUX_PORT, bme280_config.influx_port_flag == CFG_SET ? String(bme280_config.influx_port) : String());
+  updateExtraConfigItem(INFLUX_DB, bme280_config.influx_db);
+  updateExtraConfigItem(HIGH_RATE_PERIOD, bme280_config.high_rate_period_flag == CFG_SET ? String(bme280_config.high_rate_period) : String());
+  updateExtraConfigItem(MQTT_FAST_TOPIC, bme280_config.mqtt_fast_topic);
+  updateExtraConfigItem(ESTIMATOR, bme280_config.estimator_flag == CFG_SET ? StreamEstimator::nameFromMode((estimator_mode) bme280_config.estimator) : "off");
+  updateExtraConfigItem(EMA_ALPHA, bme280_config.ema_alpha_flag == CFG_SET ? String(bme280_config.ema_alpha, 6) : String());
+  updateExtraConfigItem(KALMAN_Q, bme280_config.kalman_q_flag == CFG_SET ? String(bme280_config.kalman_q, 6) : String());
+  updateExtraConfigItem(KALMAN_R, bme280_config.kalman_r_flag == CFG_SET ? String(bme280_config.kalman_r, 6) : String());
+  updateExtraConfigItem(ADAPTIVE_MIN_INTERVAL, bme280_config.adaptive_min_interval_flag == CFG_SET ? String(bme280_config.adaptive_min_interval) : String());
+  updateExtraConfigItem(ADAPTIVE_MAX_INTERVAL, bme280_config.adaptive_max_interval_flag == CFG_SET ? String(bme280_config.adaptive_max_interval) : String());
+  updateExtraConfigItem(STATION_ELEVATION, bme280_config.station_elevation_flag == CFG_SET ? String(bme280_config.station_elevation, 2) : String());
+  updateExtraConfigItem(RADIO_SLEEP, RADIO_SLEEP_NAMES[bme280_config.radio_sleep_flag == CFG_SET ? bme280_config.radio_sleep : RADIO_SLEEP_OFF]);
+  updateExtraConfigItem(DEEP_SLEEP, bme280_config.deep_sleep_flag == CFG_SET ? "on" : "off");
+  updateExtraConfigItem(SPI_CS_PIN, bme280_config.spi_cs_pin_flag == CFG_SET ? String(bme280_config.spi_cs_pin) : String());
+  updateExtraConfigItem(SPI_CLOCK, String(bme280_config.spi_clock));
+  updateExtraConfigItem(OSRS_TEMPERATURE, bme280_config.osrs_temperature_flag == CFG_SET ? String(BME280Sensor::factorFromSampling((Adafruit_BME280::sensor_sampling) bme280_config.osrs_temperature)) : String());
+  updateExtraConfigItem(OSRS_PRESSURE, bme280_config.osrs_pressure_flag == CFG_SET ? String(BME280Sensor::factorFromSampling((Adafruit_BME280::sensor_sampling) bme280_config.osrs_pressure)) : String());
+  updateExtraConfigItem(OSRS_HUMIDITY, bme280_config.osrs_humidity_flag == CFG_SET ? String(BME280Sensor::factorFromSampling((Adafruit_BME280::sensor_sampling) bme280_config.osrs_humidity)) : String());
+  updateExtraConfigItem(IIR_FILTER, bme280_config.iir_filter_flag == CFG_SET ? String(BME280Sensor::coefficientFromFilter((Adafruit_BME280::sensor_filter) bme280_config.iir_filter)) : String());
+  updateExtraConfigItem(STANDBY_TIME, bme280_config.standby_flag == CFG_SET ? toFloatStr(BME280Sensor::millisFromStandby((Adafruit_BME280::standby_duration) bme280_config.standby), 1) : String());
+  updateExtraConfigItem(SENSOR_MODE, bme280_config.sensor_mode_flag == CFG_SET && bme280_config.sensor_mode == Adafruit_BME280::MODE_FORCED ? "forced" : "normal");
+
+  pipeline_count = discoverSensors();
+
+  if (pipeline_count == 0) {
+    LOG_TAG(ERROR, SUBSYSTEM_SENSOR);
     LOG_PRINTLN("\nCould not find a valid BME280 sensor, check wiring!");
-  } else {
-    bme_temp->printSensorDetails();
-    bme_pressure->printSensorDetails();
-    bme_humidity->printSensorDetails();
+
+    // keep the default pipeline so its entities still register with HA
+    pipelines[0].bus = SENSOR_BUSES[0];
+    pipelines[0].address = SENSOR_ADDRESSES[0];
+    pipeline_count = 1;
+  }
+
+  // battery mode needs a configured network -- an ap mode device stays up for setup
+  deep_sleep = bme280_config.deep_sleep_flag == CFG_SET && bs.wifimode == WIFI_STA;
+
+  configureSensors();
+
+  if (deep_sleep) {
+    dutyCycle.configure(sample_interval, bme280_config.samples_per_publish);
+    dutyCycle.begin(&retained.cycle, restored);
+  }
+
+  // an ota, watchdog or deep sleep wake picks up the window, calibration and last snapshot
+  if (restored) restoreRetainedState();
+
+  // a republished snapshot already fills the gap a warm-up would
+  if (snapshot_pending) warmup_interval = 0;
+  if (warmup_interval > 0) {
+    LOG_TAG(INFO, SUBSYSTEM_SENSOR);
+    LOG_PRINTF("Warm-up: %d sample(s) every %lu ms before the first publish\n", bme280_config.samples_per_publish, warmup_interval);
+  }
+
+  // set device details
+  strncpy(deviceName, bme280_config.hostname, sizeof(deviceName) - 1);
+  const size_t deviceNameLen = strlen(deviceName);
+  std::replace(deviceName, deviceName + deviceNameLen, '-', '_');
+  memcpy(deviceId, deviceName, deviceNameLen);
+
+  device.setUniqueId(deviceId, deviceNameLen);
+  device.setName(deviceName);
+  device.setSoftwareVersion("1.0.0");
+  device.setManufacturer("Shell M. Shrader");
+  device.setModel("BME280");
+
+  // configure sensors from the descriptor table
+  for (tiny_int i = 0; i < pipeline_count; i++) {
+    for (tiny_int ch = 0; ch < PIPELINE_CHANNELS; ch++) {
+      pipelines[i].sensors[ch] = createSensor(SENSOR_DESCRIPTORS[ch], i);
+    }
+  }
+
+  for (tiny_int ch = PIPELINE_CHANNELS; ch < SENSOR_CHANNELS; ch++) {
+    deviceSensors[ch - PIPELINE_CHANNELS] = createSensor(SENSOR_DESCRIPTORS[ch], 0);
+  }
+
+  ipAddressSensor = new (ipAddressSensorStorage) HASensor(packSensorName(IP_ADDRESS_DESCRIPTOR.suffix, 0));
+  ipAddressSensor->setIcon(IP_ADDRESS_DESCRIPTOR.icon);
+  ipAddressSensor->setName(IP_ADDRESS_DESCRIPTOR.name);
+
+  // deep sleep switches the radio off entirely; high rate sampling cannot idle
+  radio_sleep = bs.wifimode == WIFI_STA && !deep_sleep && high_rate_period == 0 ? (radio_sleep_mode) bme280_config.radio_sleep : RADIO_SLEEP_OFF;
+  if (radio_sleep != RADIO_SLEEP_OFF) {
+    setRadioSleep(true);
+    LOG_TAG(INFO, SUBSYSTEM_POWER);
+    LOG_PRINTF("Radio %s sleep between samples\n", RADIO_SLEEP_NAMES[radio_sleep]);
+  }
+
+  // fire up mqtt client if in station mode and mqtt server configured
+  if (bs.wifimode == WIFI_STA && bme280_config.mqtt_server_flag == CFG_SET) {
+    IPAddress serverIp;
+    if (deep_sleep && restored && retained.mqtt_server_ip != 0 && !serverIp.fromString(bme280_config.mqtt_server)) {
+      // skip the dns lookup on publish wakes
+      mqtt.begin(IPAddress(retained.mqtt_server_ip), bme280_config.mqtt_user, bme280_config.mqtt_pwd);
+    } else {
+      mqtt.begin(bme280_config.mqtt_server, bme280_config.mqtt_user, bme280_config.mqtt_pwd);
+    }
+    LOG_TAG(INFO, SUBSYSTEM_MQTT);
+    LOG_PRINTLN("MQTT started");
+  }
+
+  // influx exporter only needs a reachable collector
+  if (bs.wifimode == WIFI_STA && bme280_config.influx_server_flag == CFG_SET) {
+    influx.begin(bme280_config.influx_server, bme280_config.influx_port_flag == CFG_SET ? bme280_config.influx_port : 0,
+                 bme280_config.influx_db_flag == CFG_SET ? bme280_config.influx_db : NULL, deviceName);
+    LOG_TAG(INFO, SUBSYSTEM_INFLUX);
+    LOG_PRINTLN("Influx exporter started");
+  }
+
+  // setup done
+  LOG_PRINTLN("\nSystem Ready\n");
+}
+
+void loop() {
+  bs.loop();
+  
+  if (bs.wifimode == WIFI_STA && bme280_config.mqtt_server_flag == CFG_SET) {
+    // handle MQTT
+    mqtt.loop();
+  }
+
+  if (influx.isStarted() && influx.handle()) {
+    #ifdef BME280_LOG_LEVEL_FULL
+      LOG_TAG(DEBUG, SUBSYSTEM_INFLUX);
+      LOG_PRINTF("Influx: %u lines / %u bytes sent (%.2f lines/s), %u dropped, %u us per line, %u ms per send\n",
+                 influx.getLinesSent(), influx.getBytesSent(), influx.getLinesPerSecond(), influx.getLinesDropped(),
+                 influx.getFormatMicros(), influx.getSendMillis());
+    #endif
+  }
+  
+  const unsigned long sysmillis = millis();
+
+  if (deep_sleep) {
+    handleDutyCycle(sysmillis);
+    return;
+  }
+
+  // after a warm reboot the last readings go out as soon as the broker is back
+  if (snapshot_pending && mqtt.isConnected()) publishSnapshot();
+
+  // recalibrate sea level hPa every 5 minutes (a sleeping radio does it in the publish window instead)
+  if (radio_sleep == RADIO_SLEEP_OFF && window_ticks.sample_count == 0) calibrateSeaLevel(sysmillis);
+
+  if (high_rate_period > 0) {
+    // fixed rate schedule -- ticks lost to a stalled loop are counted, not replayed
+    const unsigned long now = micros();
+    if ((long) (now - next_high_rate_sample) >= 0) {
+      next_high_rate_sample += high_rate_period;
+      if ((long) (now - next_high_rate_sample) >= 0) {
+        high_rate_stats.overruns += (now - next_high_rate_sample) / high_rate_period + 1;
+        next_high_rate_sample = now + high_rate_period;
+      }
+      collectHighRateSample(sysmillis);
+    }
+    return;
+  }
+
+  // collect a sample from every sensor every (publish_interval / samples_per_publish) seconds,
+  // or as often as the adaptive controller last asked for
+  if (sysmillis - last_update >= currentSampleInterval() || last_update == ULONG_MAX) {
+    if (bme280_config.sensor_mode == Adafruit_BME280::MODE_FORCED) {
+      // start every conversion at once so they overlap, then read them when the budget expires
+      for (tiny_int i = 0; i < pipeline_count; i++) {
+        pipelines[i].bme.startForcedMeasurement();
+      }
+      conversion_start = micros();
+      conversion_pending = true;
+    } else {
+      collectSamples(sysmillis);
+    }
+    last_update = sysmillis;
+  }
+
+  if (conversion_pending && micros() - conversion_start >= measurement_budget) {
+    bool measuring = false;
+    for (tiny_int i = 0; i < pipeline_count && !measuring; i++) {
+      measuring = pipelines[i].bme.isMeasuring();
+    }
+
+    // a sensor outliving its datasheet budget gets the library's forced timeout before we give up on it
+    if (!measuring || micros() - conversion_start >= BME280_FORCED_TIMEOUT * 1000UL) {
+      #ifdef BME280_LOG_LEVEL_FULL
+        LOG_TAG(DEBUG, SUBSYSTEM_SENSOR);
+        LOG_DEFERF("Forced conversion read after %lu us (budget %lu us)%s\n", micros() - conversion_start, measurement_budget, measuring ? " - timed out" : "");
+      #endif
+      conversion_pending = false;
+      collectSamples(sysmillis);
+    }
+  }
+
+  if (radio_sleep != RADIO_SLEEP_OFF) idleUntilNextEvent();
+}
+
+void calibrateSeaLevel(const unsigned long sysmillis) {
+  // a known elevation derives sea level locally every window; nws only checks it now and then
+  const bool local = bme280_config.station_elevation_flag == CFG_SET;
+  if (local && local_sea_level_hpa == INVALID_SEALEVELPRESSURE_HPA) return;
+
+  if (bme280_config.nws_station_flag == CFG_SET &&
+     (sysmillis - last_pressure_calibration >= (local ? NWS_CROSS_CHECK_INTERVAL : NWS_CALIBRATION_INTERVAL) || last_pressure_calibration == ULONG_MAX)) {
+    if (local) {
+      crossCheckSeaLevel();
+    } else {
+      SEALEVELPRESSURE_HPA = getSeaLevelPressure();
+      #ifdef BME280_LOG_LEVEL_BASIC
+        LOG_TAG(INFO, SUBSYSTEM_NWS);
+        LOG_DEFERF("Sea Level hPa = %.2f\n", SEALEVELPRESSURE_HPA);
+      #endif
+    }
+    last_pressure_calibration = sysmillis;
+  }
+}
+
+void crossCheckSeaLevel() {
+  if (bme280_config.nws_station_flag == CFG_NOT_SET || local_sea_level_hpa == INVALID_SEALEVELPRESSURE_HPA) {
+    LOG_TAG(WARN, SUBSYSTEM_NWS);
+    LOG_PRINTLN("Sea level cross-check needs an NWS station and a completed window");
+    return;
+  }
+
+  const float nws = getSeaLevelPressure();
+  if (!isSampleValid(nws)) return;
+
+  // one line per check so a captured log can be compared offline
+  LOG_TAG(INFO, SUBSYSTEM_NWS);
+  LOG_PRINTF("Sea level cross-check: local %s hPa, NWS %s hPa, delta %s hPa\n",
+             toFloatStr(local_sea_level_hpa, 2).c_str(), toFloatStr(nws, 2).c_str(), toFloatStr(local_sea_level_hpa - nws, 2).c_str());
+}
+
+void idleUntilNextEvent() {
+  // a pending conversion wants its budget, otherwise the next sample tick -- capped so
+  // the web server, ota and the mqtt keepalive are still serviced promptly
+  const unsigned long sysmillis = millis();
+  const unsigned long interval = currentSampleInterval();
+  unsigned long idle = conversion_pending ? measurement_budget / 1000 :
+                       (last_update == ULONG_MAX || sysmillis - last_update >= interval ? 0 : interval - (sysmillis - last_update));
+  if (idle > RADIO_SLEEP_MAX_IDLE) idle = RADIO_SLEEP_MAX_IDLE;
+  #ifdef BS_USE_TELNETSPY
+    if (idle > RADIO_SLEEP_SERVICE_IDLE && (SerialAndTelnet.getSerialBacklog() > 0 || SerialAndTelnet.isClientConnected())) {
+      idle = RADIO_SLEEP_SERVICE_IDLE;
+    }
+  #endif
+  if (idle == 0) return;
+
+  // the sdk drops into the configured modem / light sleep while we wait
+  delay(idle);
+  radio_idle_millis += idle;
+}
+
+void setRadioSleep(const bool sleep) {
+  const radio_sleep_mode mode = sleep ? radio_sleep : RADIO_SLEEP_OFF;
+
+  #ifdef esp32
+    // arduino-esp32 has no auto light sleep without tickless idle; light maps to max modem sleep
+    WiFi.setSleep(mode == RADIO_SLEEP_LIGHT ? WIFI_PS_MAX_MODEM : mode == RADIO_SLEEP_MODEM ? WIFI_PS_MIN_MODEM : WIFI_PS_NONE);
+  #else
+    WiFi.setSleepMode(mode == RADIO_SLEEP_LIGHT ? WIFI_LIGHT_SLEEP : mode == RADIO_SLEEP_MODEM ? WIFI_MODEM_SLEEP : WIFI_NONE_SLEEP);
+  #endif
+}
+
+void collectSamples(const unsigned long sysmillis) {
+    const long currentRssi = abs(WiFi.RSSI());
+
+    #ifdef BME280_LOG_LEVEL_FULL
+      const unsigned long sampleStart = micros();
+    #endif
+
+    // in normal mode sensors free-run, so reading one overlaps the others' conversions
+    for (tiny_int i = 0; i < pipeline_count; i++) {
+      samplePipeline(pipelines[i], currentRssi);
+    }
+    countWindowTick(currentRssi);
+
+    #ifdef BME280_LOG_LEVEL_BASIC
+      LOG_TAG(DEBUG, SUBSYSTEM_SENSOR);
+      LOG_DEFERF("Gathered Sample #%d\n", window_ticks.sample_count);
+    #endif
+
+    #ifdef BME280_LOG_LEVEL_FULL
+      LOG_TAG(DEBUG, SUBSYSTEM_SENSOR);
+      LOG_DEFERF("Sampled %d sensor(s) in %lu us\n", pipeline_count, micros() - sampleStart);
+    #endif
+
+    if (adaptive_sampling) {
+      const BME280_READING_TYPE& reading = pipelines[0].last_reading;
+      const int32_t values[ADAPTIVE_CHANNELS] = { (int32_t) reading.temperature, (int32_t) reading.pressure, (int32_t) reading.humidity };
+      const unsigned long interval = adaptive.update(values, sysmillis);
+
+      #ifdef BME280_LOG_LEVEL_FULL
+        if (interval != sample_interval) {
+          LOG_TAG(DEBUG, SUBSYSTEM_SENSOR);
+          LOG_PRINTF("Adaptive sampling: activity %s, interval %lu -> %lu ms\n", toFloatStr(adaptive.getActivity(), 2).c_str(), sample_interval, interval);
+        }
+      #endif
+
+      sample_interval = interval;
+    }
+
+    publishStreamingEstimates(sysmillis);
+    publishIfWindowComplete(sysmillis);
+
+    // bank the window so a warm reboot resumes it
+    if (!deep_sleep) saveRetainedState();
+}
+
+const unsigned long currentSampleInterval() {
+    // the warm-up window samples as fast as the sensor produces fresh readings
+    return warmup_interval > 0 ? warmup_interval : sample_interval;
+}
+
+const bool isWindowComplete(const unsigned long sysmillis) {
+    const short sampleCount = window_ticks.sample_count;
+
+    // the warm-up window is held for the broker like the snapshot, or it would fill the gap for no one
+    if (warmup_interval > 0) {
+      const bool brokerPending = bs.wifimode == WIFI_STA && bme280_config.mqtt_server_flag == CFG_SET && !mqtt.isConnected();
+      return sampleCount >= (brokerPending ? MAX_WINDOW_SAMPLES : bme280_config.samples_per_publish);
+    }
+
+    // adaptive windows vary in size, so they close on the publish interval instead
+    if (adaptive_sampling) {
+      return (sysmillis - window_start >= bme280_config.publish_interval && sampleCount >= MIN_SAMPLES_PER_PUBLISH) ||
+             sampleCount >= MAX_WINDOW_SAMPLES;
+    }
+
+    return sampleCount >= bme280_config.samples_per_publish;
+}
+
+void publishIfWindowComplete(const unsigned long sysmillis) {
+    if (isWindowComplete(sysmillis)) {
+        #ifdef BME280_LOG_LEVEL_FULL
+          const unsigned long radioWindowStart = millis();
+        #endif
+
+        // one radio-on window for calibration and every publish
+        if (radio_sleep != RADIO_SLEEP_OFF) {
+          setRadioSleep(false);
+          calibrateSeaLevel(sysmillis);
+        }
+
+        // before publishPipeline consumes the window -- from the first sensor that read enough of it
+        if (bme280_config.station_elevation_flag == CFG_SET) {
+          tiny_int i = 0;
+          while (i < pipeline_count && pipelines[i].samples.sample_count < MIN_SAMPLES_PER_PUBLISH) i++;
+          if (i < pipeline_count) deriveSeaLevelPressure(pipelines[i].samples);
+        }
+
+        // rssi belongs to the window, not to whichever sensor happened to read
+        const WINDOW_TICKS_TYPE& ticks = window_ticks;
+        finalRssi = ticks.sample_count >= MIN_SAMPLES_PER_PUBLISH ? (ticks.rssi - (ticks.low_rssi + ticks.high_rssi)) / (ticks.sample_count - 2) * -1 :
+                    ticks.sample_count > 0 ? ticks.rssi / ticks.sample_count * -1 : 0;
+        const short windowSamples = ticks.sample_count;
+
+        for (tiny_int i = 0; i < pipeline_count; i++) {
+          publishPipeline(pipelines[i], i, sysmillis);
+        }
+
+        #ifdef BME280_LOG_LEVEL_FULL
+          LOG_TAG(DEBUG, SUBSYSTEM_SENSOR);
+          LOG_PRINT(F("rssi        = "));
+          LOG_PRINT(finalRssi);
+          LOG_PRINTLN(" dB");
+        #endif
+
+        if (isSampleValid(finalRssi)) deviceSensors[RSSI_CHANNEL - PIPELINE_CHANNELS]->setValue(finalRssi);
+
+        // a warm-up window's rate says nothing about the configured cadence
+        if (sysmillis != window_start && warmup_interval == 0) {
+          finalSampleRate = windowSamples * 60000.0 / (sysmillis - window_start);
+          deviceSensors[SAMPLE_RATE_CHANNEL - PIPELINE_CHANNELS]->setValue(finalSampleRate);
+
+          // share of the window spent outside scheduled idle
+          const unsigned long windowMillis = sysmillis - window_start;
+          finalDutyCycle = 100.0 * (windowMillis - std::min<unsigned long>(radio_idle_millis, windowMillis)) / windowMillis;
+          deviceSensors[DUTY_CYCLE_CHANNEL - PIPELINE_CHANNELS]->setValue(finalDutyCycle);
+        }
+        window_start = sysmillis;
+        window_ticks = WINDOW_TICKS_TYPE();
+
+        if (isSampleValid(SEALEVELPRESSURE_HPA) && hasSeaLevelSource()) deviceSensors[SEA_LEVEL_PRESSURE_CHANNEL - PIPELINE_CHANNELS]->setValue(SEALEVELPRESSURE_HPA * HPA_TO_INHG);
+
+        if (bs.wifimode == WIFI_STA) 
+          ipAddressSensor->setValue(WiFi.localIP().toString().c_str());
+        
+        bs.updateHtmlTemplate("/index.template.html", false);
+
+        #ifdef BME280_LOG_LEVEL_FULL
+          if (high_rate_period > 0) logHighRateStats(sysmillis);
+        #endif
+
+        if (radio_sleep != RADIO_SLEEP_OFF) {
+          setRadioSleep(true);
+
+          #ifdef BME280_LOG_LEVEL_FULL
+            // compare temperature against a radio_sleep=off run to see the self-heating bias
+            LOG_TAG(INFO, SUBSYSTEM_POWER);
+            LOG_PRINTF("Radio sleep %s: duty cycle %s%%, idle %lu ms, radio window %lu ms\n", RADIO_SLEEP_NAMES[radio_sleep],
+                       toFloatStr(finalDutyCycle, 1).c_str(), radio_idle_millis, millis() - radioWindowStart);
+          #endif
+        }
+        radio_idle_millis = 0;
+
+        if (warmup_interval > 0) {
+          LOG_TAG(INFO, SUBSYSTEM_SENSOR);
+          LOG_PRINTF("First publish %lu ms after boot, warm-up done\n", millis());
+          warmup_interval = 0;
+        }
+        retained.snapshot_valid = true;
+
+        printHeapStats();
+        bs.blink();
+    }
+}
+
+void collectHighRateSample(const unsigned long sysmillis) {
+    long currentRssi = LONG_MIN;
+    bool decimated = false;
+
+    for (tiny_int i = 0; i < pipeline_count; i++) {
+      SENSOR_PIPELINE_TYPE& pipeline = pipelines[i];
+      BME280_READING_TYPE reading;
+
+      if (!pipeline.bme.readSample(&reading)) continue;
+
+      // estimates track every raw reading, the decimator only sets the publish cadence
+      if (streaming_mode != ESTIMATOR_OFF) updateEstimators(pipeline, reading);
+
+      const unsigned long filterStart = micros();
+      int32_t temperature, pressure, humidity;
+
+      // bitwise & so every channel is pushed -- they stay in phase
+      const bool ready = pipeline.decimators[READING_TEMPERATURE].push(reading.temperature, &temperature) &
+                         pipeline.decimators[READING_PRESSURE].push(reading.pressure, &pressure) &
+                         pipeline.decimators[READING_HUMIDITY].push(reading.humidity, &humidity);
+
+      high_rate_stats.filter_micros += micros() - filterStart;
+
+      if (i == 0) {
+        high_rate_stats.raw_samples++;
+        high_rate_stats.raw_sum += reading.pressure;
+        high_rate_stats.raw_sum_sq += (double) reading.pressure * reading.pressure;
+      }
+
+      if (!ready) continue;
+
+      if (currentRssi == LONG_MIN) currentRssi = abs(WiFi.RSSI());
+      accumulateReading(pipeline, { temperature, pressure, humidity }, currentRssi);
+
+      if (i == 0) {
+        high_rate_stats.outputs++;
+        high_rate_stats.out_sum += pressure;
+        high_rate_stats.out_sum_sq += (double) pressure * pressure;
+      }
+      decimated = true;
+    }
+
+    // any sensor's decimator output advances the window
+    if (!decimated) return;
+    countWindowTick(currentRssi);
+
+    #ifdef BME280_LOG_LEVEL_BASIC
+      LOG_TAG(DEBUG, SUBSYSTEM_SENSOR);
+      LOG_DEFERF("Gathered Sample #%d (decimated)\n", window_ticks.sample_count);
+    #endif
+
+    publishStreamingEstimates(sysmillis);
+    publishIfWindowComplete(sysmillis);
+
+    // bank the window so a warm reboot resumes it
+    if (!deep_sleep) saveRetainedState();
+}
+
+#ifdef BME280_LOG_LEVEL_FULL
+void logHighRateStats(const unsigned long sysmillis) {
+    HIGH_RATE_STATS_TYPE& stats = high_rate_stats;
+    const unsigned long elapsed = sysmillis - stats.window_start;
+
+    if (stats.raw_samples > 1 && stats.outputs > 0 && elapsed > 0) {
+      const double rawMean = stats.raw_sum / stats.raw_samples;
+      const double rawStdDev = sqrt(std::max(0.0, stats.raw_sum_sq / stats.raw_samples - rawMean * rawMean));
+      const double outMean = stats.out_sum / stats.outputs;
+      const double outStdDev = sqrt(std::max(0.0, stats.out_sum_sq / stats.outputs - outMean * outMean));
+
+      // a trimmed mean of samples_per_publish raw readings would average roughly n - 2 of them
+      LOG_TAG(DEBUG, SUBSYSTEM_SENSOR);
+      LOG_PRINTF("High rate: %s samples/s, %lu overruns, cic %s us/sample, pressure noise raw %s / decimated %s / trimmed mean ~%s milli-hPa\n",
+                 toFloatStr(stats.raw_samples * 1000.0 / elapsed, 1).c_str(), stats.overruns,
+                 toFloatStr((float) stats.filter_micros / stats.raw_samples, 2).c_str(),
+                 toFloatStr(rawStdDev, 1).c_str(), toFloatStr(outStdDev, 1).c_str(),
+                 toFloatStr(rawStdDev / sqrt(std::max(1, bme280_config.samples_per_publish - 2)), 1).c_str());
+    }
+
+    stats = HIGH_RATE_STATS_TYPE();
+    stats.window_start = sysmillis;
+}
+#endif
+
+void configureSensors() {
+    const bool highRate = bme280_config.high_rate_period_flag == CFG_SET && !deep_sleep;
+
+    // high rate mode runs the fastest normal mode cadence and lets the decimator do the averaging
+    // battery mode takes one forced conversion per wake
+    const Adafruit_BME280::sensor_mode mode = highRate ? Adafruit_BME280::MODE_NORMAL :
+                                              deep_sleep ? Adafruit_BME280::MODE_FORCED : (Adafruit_BME280::sensor_mode) bme280_config.sensor_mode;
+    const Adafruit_BME280::sensor_sampling osrsT = highRate ? Adafruit_BME280::SAMPLING_X1 : (Adafruit_BME280::sensor_sampling) bme280_config.osrs_temperature;
+    const Adafruit_BME280::sensor_sampling osrsP = highRate ? Adafruit_BME280::SAMPLING_X1 : (Adafruit_BME280::sensor_sampling) bme280_config.osrs_pressure;
+    const Adafruit_BME280::sensor_sampling osrsH = highRate ? Adafruit_BME280::SAMPLING_X1 : (Adafruit_BME280::sensor_sampling) bme280_config.osrs_humidity;
+    const Adafruit_BME280::sensor_filter filter = highRate ? Adafruit_BME280::FILTER_OFF : (Adafruit_BME280::sensor_filter) bme280_config.iir_filter;
+    const Adafruit_BME280::standby_duration standby = highRate ? Adafruit_BME280::STANDBY_MS_0_5 : (Adafruit_BME280::standby_duration) bme280_config.standby;
+
+    for (tiny_int i = 0; i < pipeline_count; i++) {
+      pipelines[i].bme.configure(mode, osrsT, osrsP, osrsH, filter, standby);
+    }
+
+    measurement_budget = BME280Sensor::measurementMicros(osrsT, osrsP, osrsH);
+
+    // in normal mode a fresh result only lands every t_meas + t_standby
+    const unsigned long sampleBudget = measurement_budget +
+        (mode == Adafruit_BME280::MODE_NORMAL ? BME280Sensor::standbyMicros(standby) : 0);
+    const unsigned long sampleInterval = bme280_config.publish_interval / bme280_config.samples_per_publish;
+
+    #ifdef BME280_LOG_LEVEL_BASIC
+      LOG_TAG(INFO, SUBSYSTEM_SENSOR);
+      LOG_PRINTF("BME280 %s mode osrs t/p/h x%d/x%d/x%d iir %d standby %s ms - max measurement %lu us\n",
+                 mode == Adafruit_BME280::MODE_FORCED ? "forced" : "normal",
+                 BME280Sensor::factorFromSampling(osrsT),
+                 BME280Sensor::factorFromSampling(osrsP),
+                 BME280Sensor::factorFromSampling(osrsH),
+                 BME280Sensor::coefficientFromFilter(filter),
+                 toFloatStr(BME280Sensor::millisFromStandby(standby), 1).c_str(),
+                 measurement_budget);
+    #endif
+
+    if (sampleInterval * 1000 < sampleBudget) {
+      LOG_TAG(WARN, SUBSYSTEM_SENSOR);
+      LOG_PRINTF("WARNING: sample interval %lu ms is shorter than the sensor's %lu us measurement cycle - samples will repeat\n",
+                 sampleInterval, sampleBudget);
+    }
+
+    streaming_mode = bme280_config.estimator_flag == CFG_SET ? (estimator_mode) bme280_config.estimator : ESTIMATOR_OFF;
+
+    for (tiny_int i = 0; i < pipeline_count; i++) {
+      for (tiny_int ch = 0; ch < READING_CHANNELS; ch++) {
+        pipelines[i].estimators[ch].configure(streaming_mode,
+                                              bme280_config.ema_alpha_flag == CFG_SET ? bme280_config.ema_alpha : DEFAULT_EMA_ALPHA,
+                                              bme280_config.kalman_q_flag == CFG_SET ? bme280_config.kalman_q : DEFAULT_KALMAN_Q,
+                                              bme280_config.kalman_r_flag == CFG_SET ? bme280_config.kalman_r : DEFAULT_KALMAN_R);
+      }
+    }
+
+    #ifdef BME280_LOG_LEVEL_BASIC
+      if (streaming_mode != ESTIMATOR_OFF) {
+        LOG_TAG(INFO, SUBSYSTEM_SENSOR);
+        LOG_PRINTF("Streaming %s estimator on every sample\n", StreamEstimator::nameFromMode(streaming_mode));
+      }
+    #endif
+
+    if (highRate) {
+      // never read faster than the sensor converts, and keep the ratio inside the cic's headroom
+      high_rate_period = std::max<unsigned long>((unsigned long) bme280_config.high_rate_period * 1000UL, sampleBudget);
+      high_rate_period = std::max<unsigned long>(high_rate_period, sampleInterval * 1000UL / CIC_MAX_RATIO + 1);
+      const uint32_t ratio = std::max<unsigned long>(1UL, sampleInterval * 1000UL / high_rate_period);
+
+      for (tiny_int i = 0; i < pipeline_count; i++) {
+        for (tiny_int ch = 0; ch < READING_CHANNELS; ch++) {
+          pipelines[i].decimators[ch].setRatio(ratio);
+        }
+      }
+
+      LOG_TAG(INFO, SUBSYSTEM_SENSOR);
+      LOG_PRINTF("High rate sampling every %lu us, cic order %d decimating by %lu\n", high_rate_period, CIC_ORDER, (unsigned long) ratio);
+
+      next_high_rate_sample = micros();
+      high_rate_stats.window_start = millis();
+    } else {
+      high_rate_period = 0;
+    }
+
+    sample_interval = sampleInterval;
+
+    // first window goes out as soon as the sensor can fill it; high rate and battery modes keep their own cadence
+    warmup_interval = highRate || deep_sleep ? 0 : std::max<unsigned long>(1UL, (sampleBudget + 999) / 1000);
+    if (warmup_interval >= sample_interval) warmup_interval = 0;
+
+    adaptive_sampling = !highRate && !deep_sleep && bme280_config.adaptive_min_interval_flag == CFG_SET;
+
+    if (adaptive_sampling) {
+      // as fast as the sensor converts and the window sums allow, and slow enough
+      // that a window still gets its minimum samples
+      const unsigned long ceiling = bme280_config.publish_interval / MIN_SAMPLES_PER_PUBLISH;
+      unsigned long minInterval = std::max<unsigned long>(bme280_config.adaptive_min_interval, (sampleBudget + 999) / 1000);
+      minInterval = std::min<unsigned long>(std::max<unsigned long>(minInterval, bme280_config.publish_interval / MAX_WINDOW_SAMPLES), ceiling);
+      const unsigned long maxInterval = bme280_config.adaptive_max_interval_flag == CFG_SET ?
+          std::min<unsigned long>(std::max<unsigned long>(bme280_config.adaptive_max_interval, minInterval), ceiling) : ceiling;
+
+      adaptive.configure(minInterval, maxInterval, sampleInterval);
+      sample_interval = adaptive.getInterval();
+
+      #ifdef BME280_LOG_LEVEL_BASIC
+        LOG_TAG(INFO, SUBSYSTEM_SENSOR);
+        LOG_PRINTF("Adaptive sampling between %lu and %lu ms\n", minInterval, maxInterval);
+      #endif
+    }
+
+    window_start = millis();
+}
+
+tiny_int discoverSensors() {
+  tiny_int found = 0;
+
+  if (bme280_config.spi_cs_pin_flag == CFG_SET) {
+    SENSOR_PIPELINE_TYPE& pipeline = pipelines[found];
+
+    if (pipeline.bme.beginSPI(bme280_config.spi_cs_pin, bme280_config.spi_clock)) {
+      pipeline.address = bme280_config.spi_cs_pin;
+
+      #ifdef BME280_LOG_LEVEL_BASIC
+        LOG_TAG(INFO, SUBSYSTEM_SENSOR);
+        LOG_PRINTF("BME280 #%d found on spi (cs %d) at %lu Hz\n", found + 1, pipeline.address, bme280_config.spi_clock);
+      #endif
+
+      found++;
+    } else {
+      LOG_TAG(WARN, SUBSYSTEM_SENSOR);
+      LOG_PRINTF("No BME280 found on spi (cs %d)\n", bme280_config.spi_cs_pin);
+    }
   }
 
-  // set device details
-  String uniqueId = String(bme280_config.hostname);
-  std::replace(uniqueId.begin(), uniqueId.end(), '-', '_');
+#if SENSOR_BUS_COUNT > 1
+  Wire1.begin(BME280_WIRE1_SDA, BME280_WIRE1_SCL);
+#endif
+
+  for (tiny_int bus = 0; bus < SENSOR_BUS_COUNT; bus++) {
+    for (tiny_int addr = 0; addr < SENSOR_ADDRESS_COUNT; addr++) {
+      SENSOR_PIPELINE_TYPE& pipeline = pipelines[found];
+
+      if (!pipeline.bme.begin(SENSOR_ADDRESSES[addr], SENSOR_BUSES[bus])) continue;
 
-  for (tiny_int i = 0; i < uniqueId.length(); i++) {
-    deviceId[i] = (byte)uniqueId[i];
+      pipeline.bus = SENSOR_BUSES[bus];
+      pipeline.address = SENSOR_ADDRESSES[addr];
+
+      #ifdef BME280_LOG_LEVEL_BASIC
+        LOG_TAG(INFO, SUBSYSTEM_SENSOR);
+        LOG_PRINTF("BME280 #%d found on bus %d at 0x%02X\n", found + 1, bus, pipeline.address);
+      #endif
+
+      pipeline.bme.getTemperatureSensor()->printSensorDetails();
+      pipeline.bme.getPressureSensor()->printSensorDetails();
+      pipeline.bme.getHumiditySensor()->printSensorDetails();
+
+      found++;
+    }
   }
 
-  strcpy(deviceName, uniqueId.c_str());
+  // every probe re-runs Wire.begin() which drops the clock back to 100 kHz
+  for (tiny_int bus = 0; bus < SENSOR_BUS_COUNT; bus++) {
+    SENSOR_BUSES[bus]->setClock(BME280_I2C_CLOCK);
+  }
 
-  device.setUniqueId(deviceId, uniqueId.length());
-  device.setName(deviceName);
-  device.setSoftwareVersion("1.0.0");
-  device.setManufacturer("Shell M. Shrader");
-  device.setModel("BME280");
+  return found;
+}
 
-  // configure sensors
-  strcpy(tempSensorName,         (uniqueId + "_temperature_sensor").c_str());
-  strcpy(humidSensorName,        (uniqueId + "_humdity_sensor").c_str());
-  strcpy(presSensorName,         (uniqueId + "_pressure_sensor").c_str());
-  strcpy(altSensorName,          (uniqueId + "_altitude_sensor").c_str());
-  strcpy(rssiSensorName,         (uniqueId + "_rssi_sensor").c_str());
-  strcpy(seaLevelPresSensorName, (uniqueId + "_sea_level_pressure_sensor").c_str());
-  strcpy(ipAddressSensorName,    (uniqueId + "_ip_address_sensor").c_str());
-
-  tempSensor         = new HASensorNumber(tempSensorName, HASensorNumber::PrecisionP1);
-  humidSensor        = new HASensorNumber(humidSensorName, HASensorNumber::PrecisionP0);
-  presSensor         = new HASensorNumber(presSensorName, HASensorNumber::PrecisionP2);
-  altSensor          = new HASensorNumber(altSensorName, HASensorNumber::PrecisionP1);
-  rssiSensor         = new HASensorNumber(rssiSensorName, HASensorNumber::PrecisionP0);
-  seaLevelPresSensor = new HASensorNumber(seaLevelPresSensorName, HASensorNumber::PrecisionP2);
-  ipAddressSensor    = new HASensor(ipAddressSensorName);
-  
-  tempSensor->setDeviceClass("temperature");
-  tempSensor->setName("Temperature");
-  tempSensor->setUnitOfMeasurement("F");
+void samplePipeline(SENSOR_PIPELINE_TYPE& pipeline, const long currentRssi) {
+    BME280_READING_TYPE reading;
 
-  humidSensor->setDeviceClass("humidity");
-  humidSensor->setName("Humidity");
-  humidSensor->setUnitOfMeasurement("%");
+    if (!pipeline.bme.readSample(&reading)) {
+      LOG_TAG(ERROR, SUBSYSTEM_SENSOR);
+      LOG_PRINTF("BME280 @ 0x%02X read failed - sample skipped\n", pipeline.address);
+      return;
+    }
 
-  altSensor->setIcon("mdi:waves-arrow-up");
-  altSensor->setName("Altitude");
-  altSensor->setUnitOfMeasurement("M");
-  
-  presSensor->setDeviceClass("atmospheric_pressure");
-  presSensor->setName("Barometer");
-  presSensor->setUnitOfMeasurement("inHg");
+    if (streaming_mode != ESTIMATOR_OFF) updateEstimators(pipeline, reading);
+    pipeline.last_reading = reading;
+    accumulateReading(pipeline, reading, currentRssi);
+}
 
-  rssiSensor->setDeviceClass("signal_strength");
-  rssiSensor->setName("rssi");
-  rssiSensor->setUnitOfMeasurement("dB");
+void updateEstimators(SENSOR_PIPELINE_TYPE& pipeline, const BME280_READING_TYPE& reading) {
+    const float temperature = pipeline.estimators[READING_TEMPERATURE].update(reading.temperature);
+    const float pressure = pipeline.estimators[READING_PRESSURE].update(reading.pressure);
+    const float humidity = pipeline.estimators[READING_HUMIDITY].update(reading.humidity);
 
-  seaLevelPresSensor->setDeviceClass("atmospheric_pressure");
-  seaLevelPresSensor->setName("Sea Level Barometer");
-  seaLevelPresSensor->setUnitOfMeasurement("inHg");
+    // same units as the final_ values
+    pipeline.stream_temperature = temperature / 1000.0 * 1.8 + 32;
+    pipeline.stream_humidity = humidity / 1000.0;
+    pipeline.stream_altitude = pressureToAltitude(lround(pressure));
+    pipeline.stream_pressure = pressure / 1000.0 * HPA_TO_INHG;
+}
 
-  ipAddressSensor->setIcon("mdi:ip");
-  ipAddressSensor->setName("IP Address");
+void publishStreamingEstimates(const unsigned long sysmillis) {
+    if (streaming_mode == ESTIMATOR_OFF) return;
 
-  // fire up mqtt client if in station mode and mqtt server configured
-  if (bs.wifimode == WIFI_STA && bme280_config.mqtt_server_flag == CFG_SET) {
-    mqtt.begin(bme280_config.mqtt_server, bme280_config.mqtt_user, bme280_config.mqtt_pwd);
-    LOG_PRINTLN("MQTT started");
-  }
+    if (bme280_config.mqtt_fast_topic_flag == CFG_SET) {
+      for (tiny_int i = 0; i < pipeline_count; i++) {
+        publishFastSample(pipelines[i], i, sysmillis);
+      }
+    }
 
-  // setup done
-  LOG_PRINTLN("\nSystem Ready\n");
+    // a completing window refreshes the page itself
+    if (!isWindowComplete(sysmillis)) {
+      bs.updateHtmlTemplate("/index.template.html", false);
+    }
 }
 
-void loop() {
-  bs.loop();
-  
-  if (bs.wifimode == WIFI_STA && bme280_config.mqtt_server_flag == CFG_SET) {
-    // handle MQTT
-    mqtt.loop();
-  }
-  
-  const unsigned long sysmillis = millis();
+void publishFastSample(const SENSOR_PIPELINE_TYPE& pipeline, const tiny_int index, const unsigned long sysmillis) {
+    if (bs.wifimode != WIFI_STA || bme280_config.mqtt_server_flag != CFG_SET || !mqtt.isConnected()) return;
+    if (!pipeline.estimators[READING_PRESSURE].isPrimed()) return;
+
+    const StreamEstimator* estimators = pipeline.estimators;
+    const float pressure = estimators[READING_PRESSURE].getValue();
+
+    uint8_t payload[FAST_SAMPLE_MAX_LEN];
+    CborWriter cbor(payload, sizeof(payload));
+
+    cbor.beginMap(FAST_SAMPLE_MAP_PAIRS);
+    cbor.writeUnsigned(1);
+    cbor.writeUnsigned(sysmillis);
+    cbor.writeUnsigned(3);
+    cbor.writeInt(lround(estimators[READING_TEMPERATURE].getValue()));
+    cbor.writeUnsigned(4);
+    cbor.writeInt(lround(estimators[READING_HUMIDITY].getValue()));
+    cbor.writeUnsigned(5);
+    cbor.writeInt(lround(pressure));
+    cbor.writeUnsigned(6);
+    cbor.writeInt(lround(pressureToAltitude(lround(pressure)) * 1000));
+    cbor.writeUnsigned(8);
+    cbor.writeUnsigned(index);
+
+    if (cbor.overflowed()) {
+        LOG_TAG(ERROR, SUBSYSTEM_MQTT);
+        LOG_PRINTLN("Fast sample exceeds payload buffer - not published");
+        return;
+    }
 
-  // recalibrate sea level hPa every 5 minutes
-  if (bme280_config.nws_station_flag == CFG_SET && samples.sample_count == 0 && 
-     (sysmillis - samples.last_pressure_calibration >= 300000 || samples.last_pressure_calibration == ULONG_MAX)) {
-    SEALEVELPRESSURE_HPA = getSeaLevelPressure();
-    #ifdef BME280_LOG_LEVEL_BASIC
-      LOG_PRINTLN("Sea Level hPa = " + String(SEALEVELPRESSURE_HPA));
-    #endif
-    samples.last_pressure_calibration = sysmillis;
-  }
+    if (mqtt.beginPublish(bme280_config.mqtt_fast_topic, cbor.length(), false)) {
+        mqtt.writePayload(payload, cbor.length());
+        mqtt.endPublish();
+    }
+}
 
-  // collect a sample every (publish_interval / samples_per_publish) seconds
-  if (sysmillis - samples.last_update >= bme280_config.publish_interval / bme280_config.samples_per_publish || samples.last_update == ULONG_MAX) {
-    sensors_event_t temp_event, pressure_event, humidity_event;
-    samples.sample_count++;
+void countWindowTick(const long currentRssi) {
+    WINDOW_TICKS_TYPE& ticks = window_ticks;
 
-    bme_temp->getEvent(&temp_event);
-    const long currentTemp = round(temp_event.temperature * 1000);
+    ticks.sample_count++;
+    ticks.rssi += currentRssi;
+    if (currentRssi > ticks.high_rssi) ticks.high_rssi = currentRssi;
+    if (currentRssi < ticks.low_rssi) ticks.low_rssi = currentRssi;
+}
 
-    bme_pressure->getEvent(&pressure_event);
-    const long currentPres = round(pressure_event.pressure * 1000);
-    const long currentAlt = round(bme.readAltitude(SEALEVELPRESSURE_HPA == INVALID_SEALEVELPRESSURE_HPA ? DEFAULT_SEALEVELPRESSURE_HPA : SEALEVELPRESSURE_HPA) * 1000);
+void accumulateReading(SENSOR_PIPELINE_TYPE& pipeline, const BME280_READING_TYPE& reading, const long currentRssi) {
+    SAMPLES_TYPE& samples = pipeline.samples;
 
-    bme_humidity->getEvent(&humidity_event);
-    const long currentHumid = round(humidity_event.relative_humidity * 1000);
+    samples.sample_count++;
+
+    const long currentTemp = reading.temperature;
+    const long currentPres = reading.pressure;
+    const long currentAlt = round(pressureToAltitude(reading.pressure) * 1000);
+    const long currentHumid = reading.humidity;
 
-    const long currentRssi = abs(WiFi.RSSI());
-    
     if (currentTemp > samples.high_temperature) samples.high_temperature = currentTemp;
     if (currentHumid > samples.high_humidity) samples.high_humidity = currentHumid;
     if (currentAlt > samples.high_altitude) samples.high_altitude = currentAlt;
@@ -296,126 +1338,241 @@ void loop() {
     samples.pressure+=currentPres;
     samples.rssi+=currentRssi;
 
-    #ifdef BME280_LOG_LEVEL_BASIC
-      LOG_PRINTLN("Gathered Sample #" + String(samples.sample_count));
-    #endif
-
     #ifdef BME280_LOG_LEVEL_FULL
+      LOG_TAG(DEBUG, SUBSYSTEM_SENSOR);
+      LOG_PRINTF("BME280 @ 0x%02X (%s bus time %lu us)\n", pipeline.address, pipeline.bme.isSPI() ? "spi" : "i2c", pipeline.bme.getBusMicros());
+
+      LOG_TAG(DEBUG, SUBSYSTEM_SENSOR);
       LOG_PRINT(F("Temperature = "));
       LOG_PRINT(currentTemp / 1000.0, 3);
       LOG_PRINTLN(" *C");
 
+      LOG_TAG(DEBUG, SUBSYSTEM_SENSOR);
       LOG_PRINT(F("Humidity    = "));
       LOG_PRINT(currentHumid / 1000.0, 3);
       LOG_PRINTLN(" %");
 
+      LOG_TAG(DEBUG, SUBSYSTEM_SENSOR);
       LOG_PRINT(F("Altitude    = "));
       LOG_PRINT(currentAlt / 1000.0, 3);
       LOG_PRINTLN(" m");
 
+      LOG_TAG(DEBUG, SUBSYSTEM_SENSOR);
       LOG_PRINT(F("Pressure    = "));
       LOG_PRINT(currentPres / 1000.0, 3);
       LOG_PRINTLN(" hPa");
 
+      LOG_TAG(DEBUG, SUBSYSTEM_SENSOR);
       LOG_PRINT(F("rssi        = "));
       LOG_PRINT(currentRssi * -1);
       LOG_PRINTLN(" dB");
     #endif
+}
 
-    if (samples.sample_count >= bme280_config.samples_per_publish) {
-        // remove highest and lowest values (outliers)
-        samples.temperature = samples.temperature - (samples.low_temperature + samples.high_temperature);
-        samples.humidity = samples.humidity - (samples.low_humidity + samples.high_humidity);
-        samples.altitude = samples.altitude - (samples.low_altitude + samples.high_altitude);
-        samples.pressure = samples.pressure - (samples.low_pressure + samples.high_pressure);
-        samples.rssi = samples.rssi - (samples.low_rssi + samples.high_rssi);
-
-        // account for removed outliers
-        samples.sample_count-=2;
-
-        // use the average of what remains
-        finalTemp = samples.temperature / samples.sample_count / 1000.0 * 1.8 + 32;
-        finalHumid = samples.humidity / samples.sample_count / 1000.0;
-        finalAlt = samples.altitude / samples.sample_count / 1000.0;
-        finalPres = samples.pressure / samples.sample_count / 1000.0 * HPA_TO_INHG;
-        finalRssi = samples.rssi / samples.sample_count * -1;
-
-        // publish our normalized values 
-        #ifdef BME280_LOG_LEVEL_BASIC
-          LOG_PRINTLN("Normalized Result (Published)");
-        #endif
+void publishPipeline(SENSOR_PIPELINE_TYPE& pipeline, const tiny_int index, const unsigned long sysmillis) {
+    SAMPLES_TYPE& samples = pipeline.samples;
 
-        #ifdef BME280_LOG_LEVEL_FULL
-          LOG_PRINT(F("Temperature = "));
-          LOG_PRINT(finalTemp, 3);
-          LOG_PRINT(" *F (");
-          LOG_PRINT(samples.temperature / samples.sample_count / 1000.0, 3);
-          LOG_PRINTLN(" *C)");
-
-          LOG_PRINT(F("Humidity    = "));
-          LOG_PRINT(finalHumid, 3);
-          LOG_PRINTLN(" %");
-
-          LOG_PRINT(F("Altitude    = "));
-          LOG_PRINT(finalAlt, 3);
-          LOG_PRINTLN(" m");
-
-          LOG_PRINT(F("Pressure    = "));
-          LOG_PRINT(finalPres, 3);
-          LOG_PRINT(" inHg (");
-          LOG_PRINT(samples.pressure / samples.sample_count / 1000.0, 3);
-          LOG_PRINTLN(" hPa)");
+    // failed reads can leave too few samples to trim
+    if (samples.sample_count < MIN_SAMPLES_PER_PUBLISH) {
+      LOG_TAG(WARN, SUBSYSTEM_SENSOR);
+      LOG_PRINTF("BME280 @ 0x%02X has only %d sample(s) - window discarded\n", pipeline.address, samples.sample_count);
+      samples = SAMPLES_TYPE();
+      return;
+    }
 
-          LOG_PRINT(F("rssi        = "));
-          LOG_PRINT(finalRssi);
-          LOG_PRINTLN(" dB");
-        #endif
+    // remove highest and lowest values (outliers)
+    samples.temperature = samples.temperature - (samples.low_temperature + samples.high_temperature);
+    samples.humidity = samples.humidity - (samples.low_humidity + samples.high_humidity);
+    samples.altitude = samples.altitude - (samples.low_altitude + samples.high_altitude);
+    samples.pressure = samples.pressure - (samples.low_pressure + samples.high_pressure);
+    samples.rssi = samples.rssi - (samples.low_rssi + samples.high_rssi);
 
-        if (isSampleValid(finalTemp)) tempSensor->setValue(finalTemp);
-        if (isSampleValid(finalHumid)) humidSensor->setValue(finalHumid);
-        if (isSampleValid(finalAlt) && SEALEVELPRESSURE_HPA != INVALID_SEALEVELPRESSURE_HPA) altSensor->setValue(finalAlt);
-        if (isSampleValid(finalPres)) presSensor->setValue(finalPres);
-        if (isSampleValid(finalRssi)) rssiSensor->setValue(finalRssi);
+    // account for removed outliers
+    samples.sample_count-=2;
 
-        if (isSampleValid(SEALEVELPRESSURE_HPA) && bme280_config.nws_station_flag == CFG_SET) seaLevelPresSensor->setValue(SEALEVELPRESSURE_HPA * HPA_TO_INHG);
+    // use the average of what remains
+    pipeline.final_temperature = samples.temperature / samples.sample_count / 1000.0 * 1.8 + 32;
+    pipeline.final_humidity = samples.humidity / samples.sample_count / 1000.0;
+    pipeline.final_altitude = samples.altitude / samples.sample_count / 1000.0;
+    pipeline.final_pressure = samples.pressure / samples.sample_count / 1000.0 * HPA_TO_INHG;
 
-        if (bs.wifimode == WIFI_STA) 
-          ipAddressSensor->setValue(WiFi.localIP().toString().c_str());
-        
-        bs.updateHtmlTemplate("/index.template.html", false);
+    // publish our normalized values 
+    #ifdef BME280_LOG_LEVEL_BASIC
+      LOG_TAG(INFO, SUBSYSTEM_SENSOR);
+      LOG_PRINTF("Normalized Result (Published) - BME280 @ 0x%02X\n", pipeline.address);
+    #endif
+
+    #ifdef BME280_LOG_LEVEL_FULL
+      LOG_TAG(INFO, SUBSYSTEM_SENSOR);
+      LOG_PRINT(F("Temperature = "));
+      LOG_PRINT(pipeline.final_temperature, 3);
+      LOG_PRINT(" *F (");
+      LOG_PRINT(samples.temperature / samples.sample_count / 1000.0, 3);
+      LOG_PRINTLN(" *C)");
 
-        // reset our samples structure
-        samples.temperature = 0L;
-        samples.humidity = 0L;
-        samples.altitude = 0L;
-        samples.pressure = 0L;
-        samples.rssi = 0L;
+      LOG_TAG(INFO, SUBSYSTEM_SENSOR);
+      LOG_PRINT(F("Humidity    = "));
+      LOG_PRINT(pipeline.final_humidity, 3);
+      LOG_PRINTLN(" %");
 
-        samples.high_temperature = LONG_MIN;
-        samples.high_humidity = LONG_MIN;
-        samples.high_altitude = LONG_MIN;
-        samples.high_pressure = LONG_MIN;
-        samples.high_rssi = LONG_MIN;
+      LOG_TAG(INFO, SUBSYSTEM_SENSOR);
+      LOG_PRINT(F("Altitude    = "));
+      LOG_PRINT(pipeline.final_altitude, 3);
+      LOG_PRINTLN(" m");
 
-        samples.low_temperature = LONG_MAX;
-        samples.low_humidity = LONG_MAX;
-        samples.low_altitude = LONG_MAX;
-        samples.low_pressure = LONG_MAX;
-        samples.low_rssi = LONG_MAX;
+      LOG_TAG(INFO, SUBSYSTEM_SENSOR);
+      LOG_PRINT(F("Pressure    = "));
+      LOG_PRINT(pipeline.final_pressure, 3);
+      LOG_PRINT(" inHg (");
+      LOG_PRINT(samples.pressure / samples.sample_count / 1000.0, 3);
+      LOG_PRINTLN(" hPa)");
+    #endif
 
-        samples.sample_count = 0;
+    setPipelineValues(pipeline);
 
-        printHeapStats();
-        bs.blink();
+    WINDOW_TYPE window;
+    window.sequence = window_sequence++;
+    window.sensor = index;
+    window.timestamp = sysmillis;
+    window.sample_count = samples.sample_count + 2;
+    window.temperature = { samples.temperature / samples.sample_count, samples.low_temperature, samples.high_temperature };
+    window.humidity = { samples.humidity / samples.sample_count, samples.low_humidity, samples.high_humidity };
+    window.pressure = { samples.pressure / samples.sample_count, samples.low_pressure, samples.high_pressure };
+    window.altitude = { (long) (samples.altitude / samples.sample_count), samples.low_altitude, samples.high_altitude };
+    window.rssi = { samples.rssi / samples.sample_count, samples.low_rssi, samples.high_rssi };
+
+    if (bme280_config.mqtt_raw_topic_flag == CFG_SET) publishRawWindow(window);
+    if (influx.isStarted()) influx.addWindow(window, time(nullptr));
+
+    lockHistory();
+    history.push(window);
+    unlockHistory();
+
+    // reset our samples structure
+    samples = SAMPLES_TYPE();
+}
+
+void setPipelineValues(SENSOR_PIPELINE_TYPE& pipeline) {
+    if (isSampleValid(pipeline.final_temperature)) pipeline.sensors[TEMPERATURE_CHANNEL]->setValue(pipeline.final_temperature);
+    if (isSampleValid(pipeline.final_humidity)) pipeline.sensors[HUMIDITY_CHANNEL]->setValue(pipeline.final_humidity);
+    if (isSampleValid(pipeline.final_altitude) && SEALEVELPRESSURE_HPA != INVALID_SEALEVELPRESSURE_HPA) pipeline.sensors[ALTITUDE_CHANNEL]->setValue(pipeline.final_altitude);
+    if (isSampleValid(pipeline.final_pressure)) pipeline.sensors[PRESSURE_CHANNEL]->setValue(pipeline.final_pressure);
+}
+
+void publishRawWindow(const WINDOW_TYPE& window) {
+    if (bs.wifimode != WIFI_STA || bme280_config.mqtt_server_flag != CFG_SET || !mqtt.isConnected()) return;
+
+    const WINDOW_CHANNEL_TYPE* channels[] = { &window.temperature, &window.humidity, &window.pressure, &window.altitude, &window.rssi };
+
+    uint8_t payload[RAW_WINDOW_MAX_LEN];
+    CborWriter cbor(payload, sizeof(payload));
+
+    cbor.beginMap(RAW_WINDOW_MAP_PAIRS);
+    cbor.writeUnsigned(0);
+    cbor.writeUnsigned(window.sequence);
+    cbor.writeUnsigned(1);
+    cbor.writeUnsigned(window.timestamp);
+    cbor.writeUnsigned(2);
+    cbor.writeUnsigned(window.sample_count);
+
+    for (tiny_int i = 0; i < sizeof(channels) / sizeof(channels[0]); i++) {
+        cbor.writeUnsigned(3 + i);
+        cbor.beginArray(3);
+        cbor.writeInt(channels[i]->average);
+        cbor.writeInt(channels[i]->low);
+        cbor.writeInt(channels[i]->high);
     }
-    samples.last_update = sysmillis;
-  }
+
+    cbor.writeUnsigned(8);
+    cbor.writeUnsigned(window.sensor);
+
+    if (cbor.overflowed()) {
+        LOG_TAG(ERROR, SUBSYSTEM_MQTT);
+        LOG_PRINTLN("Raw window exceeds payload buffer - not published");
+        return;
+    }
+
+    if (mqtt.beginPublish(bme280_config.mqtt_raw_topic, cbor.length(), false)) {
+        mqtt.writePayload(payload, cbor.length());
+        mqtt.endPublish();
+    }
+
+    #ifdef BME280_LOG_LEVEL_FULL
+      LOG_TAG(DEBUG, SUBSYSTEM_MQTT);
+      LOG_PRINTF("Raw window #%lu published (%d bytes)\n", window.sequence, cbor.length());
+    #endif
+}
+
+void lockHistory() {
+#ifdef esp32
+    xSemaphoreTake(history_mutex, portMAX_DELAY);
+#endif
+}
+
+void unlockHistory() {
+#ifdef esp32
+    xSemaphoreGive(history_mutex);
+#endif
+}
+
+// /api/history?from=&to=&channel= -- from and to are window timestamps in millis since boot
+// (the response carries "now"), channel a comma separated list; all of each by default
+void handleHistoryRequest(AsyncWebServerRequest* request) {
+    const uint32_t from = request->hasParam("from") ? strtoul(request->getParam("from")->value().c_str(), NULL, 10) : 0;
+    const uint32_t to = request->hasParam("to") ? strtoul(request->getParam("to")->value().c_str(), NULL, 10) : UINT32_MAX;
+    const uint8_t channels = WindowHistory::parseChannels(request->hasParam("channel") ? request->getParam("channel")->value().c_str() : "");
+
+    if (channels == 0) {
+        request->send(400, "text/plain", "unknown channel");
+        return;
+    }
+
+    // rows are decoded as the client drains the response, so only the cursor is held
+    std::shared_ptr<WINDOW_HISTORY_QUERY_TYPE> query = std::make_shared<WINDOW_HISTORY_QUERY_TYPE>();
+    lockHistory();
+    history.beginQuery(*query, from, to, channels, millis());
+    unlockHistory();
+
+    request->send(request->beginChunkedResponse("application/json", [query](uint8_t* buffer, size_t maxLen, size_t index) -> size_t {
+        lockHistory();
+        const bool done = history.isQueryDone(*query);
+        const size_t len = done ? 0 : history.readQuery(*query, (char*) buffer, maxLen);
+        unlockHistory();
+
+        // no room for a whole row yet
+        return done || len > 0 ? len : RESPONSE_TRY_AGAIN;
+    }));
 }
 
 const bool isSampleValid(const float value) {
     return value < SHRT_MAX && value > SHRT_MIN;
 }
 
+// international barometric formula, as Adafruit_BME280::readAltitude
+const float pressureToAltitude(const long pressure) {
+    const float seaLevel = SEALEVELPRESSURE_HPA == INVALID_SEALEVELPRESSURE_HPA ? DEFAULT_SEALEVELPRESSURE_HPA : SEALEVELPRESSURE_HPA;
+    return 44330.0 * (1.0 - pow(pressure / 1000.0 / seaLevel, 0.1903));
+}
+
+void deriveSeaLevelPressure(const SAMPLES_TYPE& samples) {
+    if (samples.sample_count == 0) return;
+
+    // window means are smooth enough that the altitude channel is not just noise
+    local_sea_level_hpa = stationToSeaLevelPressure(samples.pressure / samples.sample_count / 1000.0,
+                                                    samples.temperature / samples.sample_count / 1000.0,
+                                                    bme280_config.station_elevation);
+    SEALEVELPRESSURE_HPA = local_sea_level_hpa;
+
+    #ifdef BME280_LOG_LEVEL_FULL
+      LOG_TAG(INFO, SUBSYSTEM_NWS);
+      LOG_DEFERF("Sea Level hPa = %.2f (local)\n", SEALEVELPRESSURE_HPA);
+    #endif
+}
+
+const bool hasSeaLevelSource() {
+    return bme280_config.nws_station_flag == CFG_SET || bme280_config.station_elevation_flag == CFG_SET;
+}
+
 const String toFloatStr(const float value, const short decimal_places) {
     char buf[20];
     sprintf(buf, "%.*f", decimal_places, value);
@@ -425,6 +1582,7 @@ const String toFloatStr(const float value, const short decimal_places) {
 const float getSeaLevelPressure() {
     if (bme280_config.nws_station_flag == CFG_NOT_SET) {
         #ifdef BME280_LOG_LEVEL_FULL
+          LOG_TAG(WARN, SUBSYSTEM_NWS);
           LOG_PRINTLN("NWS Station is not set - using default sea level pressure");
         #endif
         return DEFAULT_SEALEVELPRESSURE_HPA;
@@ -432,12 +1590,80 @@ const float getSeaLevelPressure() {
 
     if (bs.wifimode == WIFI_AP) {
         #ifdef BME280_LOG_LEVEL_FULL
+          LOG_TAG(WARN, SUBSYSTEM_NWS);
           LOG_PRINTLN("In AP mode - altitude will be ignored");
         #endif
         return INVALID_SEALEVELPRESSURE_HPA;
     }
 
-    const String observationsUrl = "https://api.weather.gov/stations/" + String(bme280_config.nws_station) + "/observations/latest";
+    float seaLevel = INVALID_SEALEVELPRESSURE_HPA;
+    int32_t observed = 0;
+    tiny_int source = 0;
+
+    // stations in order of preference; stop at the first fresh reading, otherwise the freshest wins
+    for (tiny_int i = 0; i < nwsStations.getCount(); i++) {
+        if (!nwsStations.isAvailable(i, millis())) {
+          #ifdef BME280_LOG_LEVEL_FULL
+            LOG_TAG(WARN, SUBSYSTEM_NWS);
+            LOG_PRINTF("NWS %s: breaker open, retry in %lu s\n", nwsStations.getId(i), (unsigned long) nwsStations.getRetryIn(i, millis()) / 1000);
+          #endif
+          continue;
+        }
+
+        NWS_OBSERVATION_TYPE observation = { INVALID_SEALEVELPRESSURE_HPA, 0, 0 };
+        const unsigned long start = millis();
+        const bool valid = fetchObservation(nwsStations.getId(i), &observation);
+        const unsigned long latency = millis() - start;
+
+        if (!valid) {
+          nwsStations.recordFailure(i, latency, millis());
+          continue;
+        }
+        nwsStations.recordSuccess(i, latency);
+
+        if (seaLevel == INVALID_SEALEVELPRESSURE_HPA || observation.observed > observed) {
+          seaLevel = observation.sea_level_hpa;
+          observed = observation.observed;
+          source = i;
+        }
+
+        // without both clocks we cannot tell stale from fresh, so take it
+        if (observation.observed == 0 || observation.server_time == 0 ||
+            observation.server_time - observation.observed <= NWS_MAX_OBSERVATION_AGE) break;
+
+        LOG_TAG(WARN, SUBSYSTEM_NWS);
+        LOG_PRINTF("NWS %s: observation is %ld min old - trying the next station\n", nwsStations.getId(i),
+                   (long) (observation.server_time - observation.observed) / 60);
+    }
+
+    #ifdef BME280_LOG_LEVEL_FULL
+      logNwsStations();
+    #endif
+
+    if (seaLevel == INVALID_SEALEVELPRESSURE_HPA) {
+      LOG_TAG(ERROR, SUBSYSTEM_NWS);
+      LOG_PRINTLN("No NWS station reported sea level pressure - altitude will be ignored");
+    } else if (source > 0) {
+      LOG_TAG(INFO, SUBSYSTEM_NWS);
+      LOG_PRINTF("Sea level pressure from fallback station %s\n", nwsStations.getId(source));
+    }
+
+    return seaLevel;
+}
+
+void logNwsStations() {
+    for (tiny_int i = 0; i < nwsStations.getCount(); i++) {
+      const unsigned long retry = nwsStations.getRetryIn(i, millis());
+      LOG_TAG(INFO, SUBSYSTEM_NWS);
+      LOG_PRINTF("NWS %s: %d%% ok, %lu ms average, %lu ms last%s\n", nwsStations.getId(i), nwsStations.getSuccessRate(i),
+                 (unsigned long) nwsStations.getAverageLatency(i), (unsigned long) nwsStations.getLatestLatency(i),
+                 retry > 0 ? (", breaker open " + String(retry / 1000) + " s").c_str() : "");
+    }
+}
+
+// one observations/latest round trip; false on any error or a null seaLevelPressure
+const bool fetchObservation(const char* station, NWS_OBSERVATION_TYPE* observation) {
+    const String observationsUrl = "https://api.weather.gov/stations/" + String(station) + "/observations/latest";
 
 #ifdef esp32
     DynamicJsonDocument doc(8192);
@@ -454,19 +1680,22 @@ const float getSeaLevelPressure() {
         httpsClient.println("Connection: close");
         httpsClient.println();
     } else {
-        LOG_PRINTLN("Unable to connect to NWS - altitude will be ignored");
-        return INVALID_SEALEVELPRESSURE_HPA;
+        LOG_TAG(WARN, SUBSYSTEM_NWS);
+        LOG_PRINTF("NWS %s: unable to connect\n", station);
+        return false;
     }
 
-    // read headers
+    // read headers, keeping the server's clock to age the observation by
     while (httpsClient.connected()) {
         String line = httpsClient.readStringUntil('\n');
         if (line == "\r") break;
+        if (line.startsWith("Date: ")) observation->server_time = NwsStations::parseHttpDate(line.c_str() + 6);
     }
 
     if (!httpsClient.connected()) {
-        LOG_PRINTLN("NWS dropped connnection - altitude will be ignored");
-        return INVALID_SEALEVELPRESSURE_HPA;
+        LOG_TAG(WARN, SUBSYSTEM_NWS);
+        LOG_PRINTF("NWS %s: dropped connection\n", station);
+        return false;
     }
 
     deserializeJson(doc, httpsClient.readString());
@@ -474,17 +1703,21 @@ const float getSeaLevelPressure() {
 
     String properties = doc["properties"];
     deserializeJson(doc, properties);
+    String timestamp = doc["timestamp"];
     String seaLevelPressure = doc["seaLevelPressure"];
     deserializeJson(doc, seaLevelPressure);
 
     String value = doc["value"];
 
     if (isNumeric(value)) {
-        return value.toInt() / 100.0;
+        observation->sea_level_hpa = value.toInt() / 100.0;
+        observation->observed = NwsStations::parseTimestamp(timestamp.c_str());
+        return true;
     } 
 
-    LOG_PRINTLN("Invalid response from NWS - altitude will be ignored");
-    return INVALID_SEALEVELPRESSURE_HPA;
+    LOG_TAG(WARN, SUBSYSTEM_NWS);
+    LOG_PRINTF("NWS %s: no sea level pressure in response\n", station);
+    return false;
 #else
     HTTPClient httpClient;
     std::unique_ptr<BearSSL::WiFiClientSecure>httpsClient(new BearSSL::WiFiClientSecure);
@@ -499,45 +1732,60 @@ const float getSeaLevelPressure() {
         httpClient.addHeader("User-Agent", "curl/8.1.2");
         httpClient.addHeader("Connection", "close");
 
+        // the server's clock to age the observation by
+        const char* headerKeys[] = { "Date" };
+        httpClient.collectHeaders(headerKeys, 1);
+
         char last[257] = {0};
         char data[129] = {0};
 
         if (httpClient.GET() == HTTP_CODE_OK) {
+          observation->server_time = NwsStations::parseHttpDate(httpClient.header("Date").c_str());
+
           while (httpClient.getStream().available()) {
             size_t bytes = httpClient.getStream().readBytes(data, 128);
             data[bytes] = 0;
             strcat(last, data);
 
+            // properties.timestamp precedes the readings; wait until all 25 characters are in
+            const char* timestamp = observation->observed == 0 ? strstr(last, "\"timestamp\": \"") : nullptr;
+            if (timestamp != nullptr && strlen(timestamp) >= 39) observation->observed = NwsStations::parseTimestamp(timestamp + 14);
+
             if (strstr(last, "visibility")) {
               const String parse = String(last);
               const int start = parse.indexOf("\"value\": ");
               const int end = parse.indexOf(",", start);
               String pa = parse.substring(start + 9, end);
 
+              httpClient.end();
+
               if (isNumeric(pa)) {
-                httpClient.end();
-                return pa.toInt() / 100.0;
-              } else {
-                httpClient.end();
-                LOG_PRINTLN("Bad response from NWS - altitude will be ignored");    
-                return INVALID_SEALEVELPRESSURE_HPA;
+                observation->sea_level_hpa = pa.toInt() / 100.0;
+                return true;
               }
+
+              LOG_TAG(WARN, SUBSYSTEM_NWS);
+              LOG_PRINTF("NWS %s: no sea level pressure in response\n", station);
+              return false;
             }
 
             memcpy(last, data, bytes + 1);
           }
           httpClient.end();
-          LOG_PRINTLN("Sea Level Barometer missing from NWS response - altitude will be ignored");    
-          return INVALID_SEALEVELPRESSURE_HPA;
+          LOG_TAG(WARN, SUBSYSTEM_NWS);
+          LOG_PRINTF("NWS %s: sea level barometer missing from response\n", station);
+          return false;
         } else {
             httpClient.end();
-            LOG_PRINTLN("Bad HTTP Response Code from NWS - altitude will be ignored");
-            return INVALID_SEALEVELPRESSURE_HPA;
+            LOG_TAG(WARN, SUBSYSTEM_NWS);
+            LOG_PRINTF("NWS %s: bad HTTP response code\n", station);
+            return false;
         }
     } else {
         httpClient.end();
-        LOG_PRINTLN("Unable to connect to NWS - altitude will be ignored");
-        return INVALID_SEALEVELPRESSURE_HPA;
+        LOG_TAG(WARN, SUBSYSTEM_NWS);
+        LOG_PRINTF("NWS %s: unable to connect\n", station);
+        return false;
     }
 #endif
 }
@@ -559,12 +1807,310 @@ const bool isNumeric(const String str) {
   return true;
 }
 
+const char* packSensorName(const char* suffix, const tiny_int pipeline) {
+  char* name = &sensorNameArena[sensorNameArenaUsed];
+  if (pipeline == 0) {
+    sensorNameArenaUsed += sprintf(name, "%s%s", deviceName, suffix) + 1;
+  } else {
+    sensorNameArenaUsed += sprintf(name, "%s_%d%s", deviceName, pipeline + 1, suffix) + 1;
+  }
+  return name;
+}
+
+const char* packSensorLabel(const char* name, const tiny_int pipeline) {
+  if (pipeline == 0) return name;
+
+  char* label = &sensorNameArena[sensorNameArenaUsed];
+  sensorNameArenaUsed += sprintf(label, "%s %d", name, pipeline + 1) + 1;
+  return label;
+}
+
+HASensorNumber* createSensor(const SENSOR_DESCRIPTOR_TYPE& descriptor, const tiny_int pipeline) {
+  HASensorNumber* sensor = new (sensorStorage[sensorStorageUsed++]) HASensorNumber(packSensorName(descriptor.suffix, pipeline), descriptor.precision);
+
+  if (descriptor.device_class) sensor->setDeviceClass(descriptor.device_class);
+  if (descriptor.icon) sensor->setIcon(descriptor.icon);
+  sensor->setName(packSensorLabel(descriptor.name, pipeline));
+  sensor->setUnitOfMeasurement(descriptor.unit);
+
+  return sensor;
+}
+
 const String escParam(const char * param_name) {
   char buf[64];
   sprintf(buf, "{%s}", param_name);
   return String(buf);
 }
 
+// rtc memory survives everything but a power cycle, which leaves garbage the crc rejects
+const bool loadRetainedState() {
+    #ifdef esp32
+      memcpy(&retained, rtcRetained, sizeof(retained));
+    #else
+      ESP.rtcUserMemoryRead(RTC_RETAINED_OFFSET, (uint32_t*) &retained, sizeof(retained));
+    #endif
+
+    return DutyCycle::verify(&retained, sizeof(retained));
+}
+
+void restoreRetainedState() {
+    const unsigned long sysmillis = millis();
+
+    SEALEVELPRESSURE_HPA = retained.sea_level_hpa;
+    if (retained.calibration_age != ULONG_MAX) last_pressure_calibration = sysmillis - retained.calibration_age;
+
+    // a different set of sensors makes the rest meaningless
+    if (retained.pipeline_count != pipeline_count) return;
+
+    for (tiny_int i = 0; i < pipeline_count; i++) {
+      SENSOR_PIPELINE_TYPE& pipeline = pipelines[i];
+
+      pipeline.samples = retained.samples[i];
+      pipeline.final_temperature = retained.final_values[i][TEMPERATURE_CHANNEL];
+      pipeline.final_humidity = retained.final_values[i][HUMIDITY_CHANNEL];
+      pipeline.final_pressure = retained.final_values[i][PRESSURE_CHANNEL];
+      pipeline.final_altitude = retained.final_values[i][ALTITUDE_CHANNEL];
+    }
+
+    window_start = sysmillis - retained.window_age;
+    window_ticks = retained.window_ticks;
+    finalRssi = retained.final_rssi;
+
+    // deep sleep wakes publish their own window
+    snapshot_pending = retained.snapshot_valid && !deep_sleep;
+
+    #ifdef BME280_LOG_LEVEL_BASIC
+      LOG_TAG(INFO, SUBSYSTEM_POWER);
+      LOG_PRINTF("Restored window of %d sample(s)%s from rtc memory\n", window_ticks.sample_count,
+                 retained.snapshot_valid ? " and last snapshot" : "");
+    #endif
+}
+
+void publishSnapshot() {
+    for (tiny_int i = 0; i < pipeline_count; i++) {
+      setPipelineValues(pipelines[i]);
+    }
+
+    if (isSampleValid(finalRssi)) deviceSensors[RSSI_CHANNEL - PIPELINE_CHANNELS]->setValue(finalRssi);
+    if (isSampleValid(SEALEVELPRESSURE_HPA) && hasSeaLevelSource()) deviceSensors[SEA_LEVEL_PRESSURE_CHANNEL - PIPELINE_CHANNELS]->setValue(SEALEVELPRESSURE_HPA * HPA_TO_INHG);
+    ipAddressSensor->setValue(WiFi.localIP().toString().c_str());
+
+    bs.updateHtmlTemplate("/index.template.html", false);
+    snapshot_pending = false;
+
+    LOG_TAG(INFO, SUBSYSTEM_POWER);
+    LOG_PRINTF("Restored snapshot published %lu ms after boot\n", millis());
+}
+
+void saveRetainedState() {
+    const unsigned long sysmillis = millis();
+    const tiny_int count = pipeline_count < MAX_SENSOR_PIPELINES ? pipeline_count : MAX_SENSOR_PIPELINES;
+
+    for (tiny_int i = 0; i < count; i++) {
+      const SENSOR_PIPELINE_TYPE& pipeline = pipelines[i];
+
+      retained.final_values[i][TEMPERATURE_CHANNEL] = pipeline.final_temperature;
+      retained.final_values[i][HUMIDITY_CHANNEL] = pipeline.final_humidity;
+      retained.final_values[i][PRESSURE_CHANNEL] = pipeline.final_pressure;
+      retained.final_values[i][ALTITUDE_CHANNEL] = pipeline.final_altitude;
+      retained.pipeline_address[i] = pipeline.address;
+      retained.pipeline_bus[i] = SENSOR_BUS_SPI;
+      for (tiny_int bus = 0; bus < SENSOR_BUS_COUNT; bus++) {
+        if (SENSOR_BUSES[bus] == pipeline.bus) retained.pipeline_bus[i] = bus;
+      }
+    }
+
+    retained.pipeline_count = count;
+    retained.sea_level_hpa = SEALEVELPRESSURE_HPA;
+    retained.calibration_age = last_pressure_calibration == ULONG_MAX ? ULONG_MAX : sysmillis - last_pressure_calibration;
+    retained.window_age = sysmillis - window_start;
+    retained.final_rssi = finalRssi;
+    retained.deep_sleep = deep_sleep;
+
+    // a cycle left mid-window must not send the next boot down the sample wake path
+    if (!deep_sleep) retained.cycle.next_action = DUTY_CYCLE_PUBLISH;
+
+    saveRetainedWindow();
+}
+
+// a radio-off wake only adds to the window -- finals and calibration stay as the last full boot left them
+void saveRetainedWindow() {
+    for (tiny_int i = 0; i < retained.pipeline_count; i++) {
+      retained.samples[i] = pipelines[i].samples;
+    }
+    retained.window_ticks = window_ticks;
+
+    DutyCycle::seal(&retained, sizeof(retained));
+
+    #ifdef esp32
+      memcpy(rtcRetained, &retained, sizeof(retained));
+    #else
+      ESP.rtcUserMemoryWrite(RTC_RETAINED_OFFSET, (uint32_t*) &retained, sizeof(retained));
+    #endif
+}
+
+const bool isDeepSleepWake() {
+    #ifdef esp32
+      return esp_sleep_get_wakeup_cause() == ESP_SLEEP_WAKEUP_TIMER;
+    #else
+      return ESP.getResetInfoPtr()->reason == REASON_DEEP_SLEEP_AWAKE;
+    #endif
+}
+
+void sampleWake() {
+    dutyCycle.configure(retained.sample_interval, retained.samples_per_publish);
+    dutyCycle.begin(&retained.cycle, true);
+
+    SEALEVELPRESSURE_HPA = retained.sea_level_hpa;
+    pipeline_count = retained.pipeline_count;
+    window_ticks = retained.window_ticks;
+
+    #if SENSOR_BUS_COUNT > 1
+      Wire1.begin(BME280_WIRE1_SDA, BME280_WIRE1_SCL);
+    #endif
+
+    for (tiny_int i = 0; i < pipeline_count; i++) {
+      SENSOR_PIPELINE_TYPE& pipeline = pipelines[i];
+
+      pipeline.address = retained.pipeline_address[i];
+      pipeline.samples = retained.samples[i];
+
+      // no soft reset here -- begin() would spend over 100 ms of the wake in init()
+      if (retained.pipeline_bus[i] == SENSOR_BUS_SPI) {
+        pipeline.bme.resumeSPI(pipeline.address, retained.spi_clock);
+      } else {
+        pipeline.bus = SENSOR_BUSES[retained.pipeline_bus[i]];
+        pipeline.bme.resume(pipeline.address, pipeline.bus);
+        pipeline.bus->setClock(BME280_I2C_CLOCK);
+      }
+
+      pipeline.bme.resumeForced((Adafruit_BME280::sensor_sampling) retained.osrs_temperature,
+                                (Adafruit_BME280::sensor_sampling) retained.osrs_pressure,
+                                (Adafruit_BME280::sensor_sampling) retained.osrs_humidity,
+                                (Adafruit_BME280::sensor_filter) retained.iir_filter);
+    }
+
+    measurement_budget = BME280Sensor::measurementMicros((Adafruit_BME280::sensor_sampling) retained.osrs_temperature,
+                                                         (Adafruit_BME280::sensor_sampling) retained.osrs_pressure,
+                                                         (Adafruit_BME280::sensor_sampling) retained.osrs_humidity);
+
+    // rssi is unknown with the radio off -- repeat the last one so the window's rssi stays sane
+    takeForcedSample(retained.last_rssi);
+    enterDeepSleep(0);
+}
+
+void takeForcedSample(const long currentRssi) {
+    for (tiny_int i = 0; i < pipeline_count; i++) {
+      pipelines[i].bme.startForcedMeasurement();
+    }
+
+    const unsigned long conversionStart = micros();
+    delay(measurement_budget / 1000);
+
+    bool measuring = true;
+    while (measuring && micros() - conversionStart < BME280_FORCED_TIMEOUT * 1000UL) {
+      measuring = false;
+      for (tiny_int i = 0; i < pipeline_count && !measuring; i++) {
+        measuring = pipelines[i].bme.isMeasuring();
+      }
+    }
+
+    for (tiny_int i = 0; i < pipeline_count; i++) {
+      samplePipeline(pipelines[i], currentRssi);
+    }
+    countWindowTick(currentRssi);
+}
+
+void handleDutyCycle(const unsigned long sysmillis) {
+    if (!cycle_sampled) {
+      // a configured elevation saves the https round trip entirely on battery
+      if (bme280_config.nws_station_flag == CFG_SET && bme280_config.station_elevation_flag == CFG_NOT_SET && dutyCycle.getAction() == DUTY_CYCLE_PUBLISH &&
+         (retained.cycle.last_calibration == UINT32_MAX || dutyCycle.getClock() - retained.cycle.last_calibration >= 300000)) {
+        SEALEVELPRESSURE_HPA = getSeaLevelPressure();
+        retained.cycle.last_calibration = dutyCycle.getClock();
+      }
+
+      takeForcedSample(abs(WiFi.RSSI()));
+      cycle_sampled = true;
+
+      #ifdef BME280_LOG_LEVEL_BASIC
+        LOG_TAG(DEBUG, SUBSYSTEM_SENSOR);
+        LOG_DEFERF("Gathered Sample #%d\n", window_ticks.sample_count);
+      #endif
+    }
+
+    // a cold boot stays reachable for a while so deep sleep can be turned off again
+    const bool coldBoot = retained.cycle.wakes == 1;
+    if (coldBoot && sysmillis < DUTY_CYCLE_SETUP_WINDOW) return;
+
+    if (isWindowComplete(sysmillis)) {
+      if (!mqtt.isConnected()) {
+        if (sysmillis < DUTY_CYCLE_CONNECT_TIMEOUT) return;
+
+        // keep the window for the next publish wake and forget a broker address that may have moved
+        LOG_TAG(WARN, SUBSYSTEM_MQTT);
+        LOG_PRINTLN("MQTT not connected - window held for the next cycle");
+        retained.mqtt_server_ip = 0;
+      } else {
+        publishIfWindowComplete(sysmillis);
+      }
+    }
+
+    // wifi came up with Bootstrap, so the radio was on for the whole wake
+    enterDeepSleep(sysmillis);
+}
+
+void enterDeepSleep(const unsigned long radioMillis) {
+    if (radioMillis > 0) {
+      // a full boot refreshes the snapshot a radio-off wake works from
+      retained.sample_interval = sample_interval;
+      retained.samples_per_publish = bme280_config.samples_per_publish;
+      retained.osrs_temperature = bme280_config.osrs_temperature;
+      retained.osrs_pressure = bme280_config.osrs_pressure;
+      retained.osrs_humidity = bme280_config.osrs_humidity;
+      retained.iir_filter = bme280_config.iir_filter;
+      retained.spi_clock = bme280_config.spi_clock;
+      retained.last_rssi = abs(WiFi.RSSI());
+      retained.wifi_channel = WiFi.channel();
+      if (WiFi.BSSID() != nullptr) memcpy(retained.wifi_bssid, WiFi.BSSID(), sizeof(retained.wifi_bssid));
+
+      IPAddress serverIp;
+      if (retained.mqtt_server_ip == 0 && mqtt.isConnected() && WiFi.hostByName(bme280_config.mqtt_server, serverIp)) {
+        retained.mqtt_server_ip = serverIp;
+      }
+    }
+
+    const unsigned long awake = millis();
+    const uint32_t duration = dutyCycle.sleep(awake, radioMillis, window_ticks.sample_count);
+
+    #ifdef BME280_LOG_LEVEL_BASIC
+      if (radioMillis > 0) {
+        LOG_TAG(INFO, SUBSYSTEM_POWER);
+        LOG_PRINTF("Wake #%lu: awake %lu ms (radio %lu ms), sleeping %lu ms, ~%s mA this cycle, ~%s mA average\n",
+                   (unsigned long) retained.cycle.wakes, awake, radioMillis, (unsigned long) duration,
+                   toFloatStr(dutyCycle.getCycleCurrent(), 3).c_str(), toFloatStr(dutyCycle.getAverageCurrent(), 3).c_str());
+        if (dutyCycle.getQuietWakes() > 0) {
+          LOG_TAG(INFO, SUBSYSTEM_POWER);
+          LOG_PRINTF("  %u radio-off wake(s) since the last, %lu ms awake on average\n",
+                     dutyCycle.getQuietWakes(), (unsigned long) (dutyCycle.getQuietAwake() / dutyCycle.getQuietWakes()));
+        }
+      }
+    #endif
+
+    if (radioMillis > 0) {
+      saveRetainedState();
+    } else {
+      saveRetainedWindow();
+    }
+
+    #ifdef esp32
+      ESP.deepSleep((uint64_t) duration * 1000);
+    #else
+      // only the wake that publishes pays for rf calibration
+      ESP.deepSleep((uint64_t) duration * 1000, dutyCycle.getAction() == DUTY_CYCLE_PUBLISH ? WAKE_RF_DEFAULT : WAKE_RF_DISABLED);
+    #endif
+}
+
 void printHeapStats() {
   #ifdef BME280_LOG_LEVEL_BASIC
     uint32_t myfree;
@@ -576,9 +2122,11 @@ void printHeapStats() {
       const uint32_t free = ESP.getFreeHeap();
       const uint32_t max = ESP.getMaxAllocHeap();
       const uint32_t min = ESP.getMinFreeHeap();
+      LOG_TAG(DEBUG, SUBSYSTEM_SYSTEM);
       LOG_PRINTF("(%ld) -> size: %5d - free: %5d - max: %5d - min: %5d <-\n", millis(), size, free, max, min);
     #else
       ESP.getHeapStats(&myfree, &mymax, &myfrag);
+      LOG_TAG(DEBUG, SUBSYSTEM_SYSTEM);
       LOG_PRINTF("(%ld) -> free: %5d - max: %5d - frag: %3d%% <-\n", millis(), myfree, mymax, myfrag);
     #endif
   #endif
@@ -0,0 +1,143 @@
+/***************************************************************************
+Copyright © 2023 Shell M. Shrader <shell at shellware dot com>
+----------------------------------------------------------------------------
+This work is free. You can redistribute it and/or modify it under the
+terms of the Do What The Fuck You Want To Public License, Version 2,
+as published by Sam Hocevar. See the COPYING file for more details.
+****************************************************************************/
+#include <stdio.h>
+#include <string.h>
+#include <ctype.h>
+
+#include "nws_stations.h"
+
+static const char* const MONTHS = "JanFebMarAprMayJunJulAugSepOctNovDec";
+
+NwsStations::NwsStations() {
+    count = 0;
+    memset(stations, 0, sizeof(stations));
+}
+
+// comma and / or space separated, in order of preference
+uint8_t NwsStations::parse(const char* list) {
+    memset(stations, 0, sizeof(stations));
+    count = 0;
+
+    while (list != nullptr && *list && count < NWS_MAX_STATIONS) {
+        while (*list == ',' || isspace((unsigned char) *list)) list++;
+
+        uint8_t len = 0;
+        while (*list && *list != ',' && !isspace((unsigned char) *list)) {
+            if (len < NWS_STATION_ID_LEN - 1) stations[count].id[len++] = toupper((unsigned char) *list);
+            list++;
+        }
+
+        if (len > 0) count++;
+    }
+
+    return count;
+}
+
+uint8_t NwsStations::getCount() const {
+    return count;
+}
+
+const char* NwsStations::getId(uint8_t index) const {
+    return index < count ? stations[index].id : "";
+}
+
+bool NwsStations::isAvailable(uint8_t index, uint32_t now) const {
+    return getRetryIn(index, now) == 0;
+}
+
+uint32_t NwsStations::getRetryIn(uint8_t index, uint32_t now) const {
+    if (index >= count) return UINT32_MAX;
+
+    const NWS_STATION_TYPE& station = stations[index];
+    if (station.open_for == 0) return 0;
+
+    // wrap safe; an elapsed breaker is half open until the next result
+    const uint32_t elapsed = now - station.opened_at;
+    return elapsed >= station.open_for ? 0 : station.open_for - elapsed;
+}
+
+void NwsStations::recordSuccess(uint8_t index, uint32_t latency) {
+    if (index >= count) return;
+
+    NWS_STATION_TYPE& station = stations[index];
+    station.attempts++;
+    station.successes++;
+    station.latency_total += latency;
+    station.last_latency = latency;
+    station.failures = 0;
+    station.open_for = 0;
+}
+
+void NwsStations::recordFailure(uint8_t index, uint32_t latency, uint32_t now) {
+    if (index >= count) return;
+
+    NWS_STATION_TYPE& station = stations[index];
+    station.attempts++;
+    station.latency_total += latency;
+    station.last_latency = latency;
+    if (station.failures < UINT8_MAX) station.failures++;
+
+    if (station.failures >= NWS_BREAKER_THRESHOLD) {
+        // a failed half-open try doubles the wait
+        station.open_for = station.open_for == 0 ? NWS_BREAKER_BASE_MS :
+                           station.open_for >= NWS_BREAKER_MAX_MS / 2 ? NWS_BREAKER_MAX_MS : station.open_for * 2;
+        station.opened_at = now;
+    }
+}
+
+// percent of attempts that produced a reading, 100 before the first
+uint8_t NwsStations::getSuccessRate(uint8_t index) const {
+    if (index >= count || stations[index].attempts == 0) return 100;
+    return (uint32_t) stations[index].successes * 100 / stations[index].attempts;
+}
+
+uint32_t NwsStations::getAverageLatency(uint8_t index) const {
+    if (index >= count || stations[index].attempts == 0) return 0;
+    return stations[index].latency_total / stations[index].attempts;
+}
+
+uint32_t NwsStations::getLatestLatency(uint8_t index) const {
+    return index < count ? stations[index].last_latency : 0;
+}
+
+// observation timestamps look like 2023-10-27T20:51:00+00:00; 0 if unparseable
+int32_t NwsStations::parseTimestamp(const char* iso) {
+    int year, month, day, hour, minute, second, offsetHours = 0, offsetMinutes = 0;
+    char sign = '+';
+
+    const int fields = sscanf(iso, "%4d-%2d-%2dT%2d:%2d:%2d%c%2d:%2d", &year, &month, &day, &hour, &minute, &second, &sign, &offsetHours, &offsetMinutes);
+    if (fields < 6 || month < 1 || month > 12) return 0;
+
+    const int32_t offset = (offsetHours * 3600 + offsetMinutes * 60) * (sign == '-' ? -1 : 1);
+    return toEpoch(year, month, day, hour, minute, second) - (fields == 9 ? offset : 0);
+}
+
+// rfc 1123 as in the Date header: Fri, 27 Oct 2023 20:55:12 GMT; 0 if unparseable
+int32_t NwsStations::parseHttpDate(const char* date) {
+    int day, year, hour, minute, second;
+    char month[4] = {0};
+
+    if (sscanf(date, "%*3s, %2d %3s %4d %2d:%2d:%2d", &day, month, &year, &hour, &minute, &second) != 6) return 0;
+
+    const char* found = strlen(month) == 3 ? strstr(MONTHS, month) : nullptr;
+    if (found == nullptr || (found - MONTHS) % 3 != 0) return 0;
+
+    return toEpoch(year, (found - MONTHS) / 3 + 1, day, hour, minute, second);
+}
+
+// days from civil (Howard Hinnant), good for any proleptic gregorian date
+int32_t NwsStations::toEpoch(int32_t year, uint8_t month, uint8_t day, uint8_t hour, uint8_t minute, uint8_t second) {
+    year -= month <= 2;
+    const int32_t era = (year >= 0 ? year : year - 399) / 400;
+    const uint32_t yoe = year - era * 400;
+    const uint32_t doy = (153 * (month + (month > 2 ? -3 : 9)) + 2) / 5 + day - 1;
+    const uint32_t doe = yoe * 365 + yoe / 4 - yoe / 100 + doy;
+    const int32_t days = era * 146097 + (int32_t) doe - 719468;
+
+    return days * 86400 + hour * 3600 + minute * 60 + second;
+}
@@ -0,0 +1,15 @@
+/***************************************************************************
+Copyright © 2023 Shell M. Shrader <shell at shellware dot com>
+----------------------------------------------------------------------------
+This work is free. You can redistribute it and/or modify it under the
+terms of the Do What The Fuck You Want To Public License, Version 2,
+as published by Sam Hocevar. See the COPYING file for more details.
+****************************************************************************/
+#include <math.h>
+
+#include "sea_level.h"
+
+float stationToSeaLevelPressure(float stationHpa, float celsius, float elevation) {
+    const float layerKelvin = celsius + 273.15f + STANDARD_LAPSE_RATE * elevation / 2;
+    return stationHpa * expf(STANDARD_GRAVITY * elevation / (DRY_AIR_GAS_CONSTANT * layerKelvin));
+}
@@ -0,0 +1,73 @@
+/***************************************************************************
+Copyright © 2023 Shell M. Shrader <shell at shellware dot com>
+----------------------------------------------------------------------------
+This work is free. You can redistribute it and/or modify it under the
+terms of the Do What The Fuck You Want To Public License, Version 2,
+as published by Sam Hocevar. See the COPYING file for more details.
+****************************************************************************/
+#include <string.h>
+
+#include "stream_estimator.h"
+
+// indexed by estimator_mode
+static const char* const ESTIMATOR_NAMES[] = { "off", "ema", "kalman" };
+
+void StreamEstimator::configure(estimator_mode estimatorMode, float emaAlpha, float processNoise, float measurementNoise) {
+    mode = estimatorMode;
+    alpha = emaAlpha;
+    q = processNoise;
+    r = measurementNoise;
+    reset();
+}
+
+void StreamEstimator::reset() {
+    estimate = 0;
+    variance = 0;
+    primed = false;
+}
+
+float StreamEstimator::update(float measurement) {
+    if (!primed || mode == ESTIMATOR_OFF) {
+        // the first reading is the best estimate we have, good to within r
+        estimate = measurement;
+        variance = r;
+        primed = true;
+        return estimate;
+    }
+
+    if (mode == ESTIMATOR_EMA) {
+        estimate += alpha * (measurement - estimate);
+        return estimate;
+    }
+
+    // predict (random walk), then correct
+    variance += q;
+    const float gain = variance / (variance + r);
+    estimate += gain * (measurement - estimate);
+    variance *= 1 - gain;
+
+    return estimate;
+}
+
+float StreamEstimator::getValue() const {
+    return estimate;
+}
+
+float StreamEstimator::getVariance() const {
+    return variance;
+}
+
+bool StreamEstimator::isPrimed() const {
+    return primed;
+}
+
+const char* StreamEstimator::nameFromMode(estimator_mode estimatorMode) {
+    return estimatorMode <= ESTIMATOR_KALMAN ? ESTIMATOR_NAMES[estimatorMode] : ESTIMATOR_NAMES[ESTIMATOR_OFF];
+}
+
+int8_t StreamEstimator::modeFromName(const char* name) {
+    for (uint8_t i = 0; i <= ESTIMATOR_KALMAN; i++) {
+        if (strcmp(name, ESTIMATOR_NAMES[i]) == 0) return i;
+    }
+    return -1;
+}
@@ -0,0 +1,272 @@
+/***************************************************************************
+Copyright © 2023 Shell M. Shrader <shell at shellware dot com>
+----------------------------------------------------------------------------
+This work is free. You can redistribute it and/or modify it under the
+terms of the Do What The Fuck You Want To Public License, Version 2,
+as published by Sam Hocevar. See the COPYING file for more details.
+****************************************************************************/
+#include <stdio.h>
+#include <string.h>
+#include <ctype.h>
+
+#include "window_history.h"
+
+const char* const WINDOW_HISTORY_CHANNEL_NAMES[WINDOW_HISTORY_CHANNELS] = { "temperature", "humidity", "pressure", "altitude", "rssi" };
+
+static WINDOW_CHANNEL_TYPE window_type::* const CHANNELS[WINDOW_HISTORY_CHANNELS] = {
+    &window_type::temperature, &window_type::humidity, &window_type::pressure, &window_type::altitude, &window_type::rssi
+};
+
+static uint32_t zigzag(const int32_t value) {
+    return ((uint32_t) value << 1) ^ (uint32_t) (value >> 31);
+}
+
+static int32_t unzigzag(const uint32_t value) {
+    return (int32_t) (value >> 1) ^ -(int32_t) (value & 1);
+}
+
+static size_t putVarint(uint8_t* out, uint32_t value) {
+    size_t len = 0;
+    while (value >= 0x80) {
+        out[len++] = (value & 0x7F) | 0x80;
+        value >>= 7;
+    }
+    out[len++] = value;
+    return len;
+}
+
+// differences are taken in 32 bits so they wrap the same on the host
+static int32_t diff(const long value, const long reference) {
+    return (int32_t) ((uint32_t) value - (uint32_t) reference);
+}
+
+static long undiff(const long reference, const int32_t delta) {
+    return (int32_t) ((uint32_t) reference + (uint32_t) delta);
+}
+
+WindowHistory::WindowHistory() {
+    clear();
+}
+
+void WindowHistory::clear() {
+    used = 0;
+    memset(&oldest, 0, sizeof(oldest));
+    newest = oldest;
+}
+
+// the oldest entries make room; one window never needs more than WINDOW_HISTORY_MAX_ENTRY
+void WindowHistory::push(const WINDOW_TYPE& window) {
+    uint8_t entry[WINDOW_HISTORY_MAX_ENTRY];
+    const size_t len = encode(newest, window, entry);
+
+    while (used + len > sizeof(ring)) evict();
+
+    size_t pos = newest.pos;
+    for (size_t i = 0; i < len; i++) {
+        ring[pos] = entry[i];
+        if (++pos == sizeof(ring)) pos = 0;
+    }
+    used += len;
+
+    newest.interval = (uint32_t) window.timestamp - (uint32_t) newest.window.timestamp;
+    newest.window = window;
+    newest.entry++;
+    newest.pos = pos;
+}
+
+uint32_t WindowHistory::getCount() const {
+    return newest.entry - oldest.entry;
+}
+
+size_t WindowHistory::getBytesUsed() const {
+    return used;
+}
+
+uint32_t WindowHistory::getEvicted() const {
+    return oldest.entry;
+}
+
+void WindowHistory::first(WINDOW_HISTORY_CURSOR_TYPE& cursor) const {
+    cursor = oldest;
+}
+
+// a cursor the ring has evicted past skips ahead to the oldest entry left
+bool WindowHistory::next(WINDOW_HISTORY_CURSOR_TYPE& cursor, WINDOW_TYPE& window) const {
+    if (cursor.entry < oldest.entry) cursor = oldest;
+    if (cursor.entry >= newest.entry) return false;
+
+    decode(cursor);
+    window = cursor.window;
+    return true;
+}
+
+// head varint: sample count change << 4 | sensor << 1 | sequence gap flag
+size_t WindowHistory::encode(const WINDOW_HISTORY_CURSOR_TYPE& previous, const WINDOW_TYPE& window, uint8_t* out) const {
+    const WINDOW_TYPE& last = previous.window;
+    const int32_t gap = diff(window.sequence, last.sequence + 1);
+    const uint32_t interval = (uint32_t) window.timestamp - (uint32_t) last.timestamp;
+
+    size_t len = putVarint(out, zigzag(window.sample_count - last.sample_count) << 4 |
+                                (window.sensor & ((1 << WINDOW_HISTORY_SENSOR_BITS) - 1)) << 1 |
+                                (gap != 0));
+    if (gap != 0) len += putVarint(&out[len], zigzag(gap));
+    len += putVarint(&out[len], zigzag(interval - previous.interval));
+
+    for (uint8_t i = 0; i < WINDOW_HISTORY_CHANNELS; i++) {
+        const WINDOW_CHANNEL_TYPE& channel = window.*CHANNELS[i];
+        const WINDOW_CHANNEL_TYPE& before = last.*CHANNELS[i];
+
+        len += putVarint(&out[len], zigzag(diff(channel.average, before.average)));
+        len += putVarint(&out[len], zigzag(diff(diff(channel.average, channel.low), diff(before.average, before.low))));
+        len += putVarint(&out[len], zigzag(diff(diff(channel.high, channel.average), diff(before.high, before.average))));
+    }
+
+    return len;
+}
+
+void WindowHistory::decode(WINDOW_HISTORY_CURSOR_TYPE& cursor) const {
+    size_t pos = cursor.pos;
+
+    auto getVarint = [&]() -> uint32_t {
+        uint32_t value = 0;
+        for (uint8_t shift = 0; shift < 35; shift += 7) {
+            const uint8_t b = ring[pos];
+            if (++pos == sizeof(ring)) pos = 0;
+            value |= (uint32_t) (b & 0x7F) << shift;
+            if ((b & 0x80) == 0) break;
+        }
+        return value;
+    };
+
+    WINDOW_TYPE& window = cursor.window;
+    const uint32_t head = getVarint();
+    const int32_t gap = head & 1 ? unzigzag(getVarint()) : 0;
+
+    window.sequence = (uint32_t) window.sequence + 1 + gap;
+    window.sensor = head >> 1 & ((1 << WINDOW_HISTORY_SENSOR_BITS) - 1);
+    window.sample_count += unzigzag(head >> 4);
+
+    cursor.interval += unzigzag(getVarint());
+    window.timestamp = (uint32_t) window.timestamp + cursor.interval;
+
+    for (uint8_t i = 0; i < WINDOW_HISTORY_CHANNELS; i++) {
+        WINDOW_CHANNEL_TYPE& channel = window.*CHANNELS[i];
+        const int32_t below = diff(channel.average, channel.low);
+        const int32_t above = diff(channel.high, channel.average);
+
+        channel.average = undiff(channel.average, unzigzag(getVarint()));
+        channel.low = diff(channel.average, undiff(below, unzigzag(getVarint())));
+        channel.high = undiff(channel.average, undiff(above, unzigzag(getVarint())));
+    }
+
+    cursor.entry++;
+    cursor.pos = pos;
+}
+
+// decoding the oldest entry against the state before it gives the state before the next
+void WindowHistory::evict() {
+    const size_t start = oldest.pos;
+    decode(oldest);
+    used -= (oldest.pos + sizeof(ring) - start) % sizeof(ring);
+}
+
+void WindowHistory::beginQuery(WINDOW_HISTORY_QUERY_TYPE& query, uint32_t from, uint32_t to, uint8_t channels, uint32_t now) const {
+    query.from = from;
+    query.to = to;
+    query.now = now;
+    query.channels = channels & WINDOW_HISTORY_ALL_CHANNELS;
+    query.stage = HISTORY_QUERY_PREAMBLE;
+    query.rows = 0;
+    first(query.cursor);
+}
+
+// whole rows only; a row that does not fit is rendered again on the next call
+size_t WindowHistory::readQuery(WINDOW_HISTORY_QUERY_TYPE& query, char* out, size_t capacity) const {
+    char row[WINDOW_HISTORY_ROW_LEN];
+    size_t len = 0;
+
+    while (query.stage != HISTORY_QUERY_DONE) {
+        const WINDOW_HISTORY_QUERY_TYPE saved = query;
+        const size_t rowLen = formatRow(query, row, sizeof(row));
+
+        if (len + rowLen > capacity) {
+            query = saved;
+            break;
+        }
+
+        memcpy(&out[len], row, rowLen);
+        len += rowLen;
+    }
+
+    return len;
+}
+
+bool WindowHistory::isQueryDone(const WINDOW_HISTORY_QUERY_TYPE& query) const {
+    return query.stage == HISTORY_QUERY_DONE;
+}
+
+size_t WindowHistory::formatRow(WINDOW_HISTORY_QUERY_TYPE& query, char* row, size_t capacity) const {
+    int len = 0;
+
+    switch (query.stage) {
+        case HISTORY_QUERY_PREAMBLE:
+            len = snprintf(row, capacity, "{\"now\":%lu,\"columns\":[\"timestamp\",\"sequence\",\"sensor\",\"samples\"", (unsigned long) query.now);
+            for (uint8_t i = 0; i < WINDOW_HISTORY_CHANNELS; i++) {
+                if (query.channels & 1 << i) len += snprintf(&row[len], capacity - len, ",\"%s\"", WINDOW_HISTORY_CHANNEL_NAMES[i]);
+            }
+            len += snprintf(&row[len], capacity - len, "],\"windows\":[");
+            query.stage = HISTORY_QUERY_ROWS;
+            return len;
+
+        case HISTORY_QUERY_ROWS: {
+            WINDOW_TYPE window;
+            while (next(query.cursor, window)) {
+                const uint32_t timestamp = window.timestamp;
+                if (timestamp < query.from) continue;
+                if (timestamp > query.to) break;
+
+                len = snprintf(row, capacity, "%s[%lu,%lu,%u,%d", query.rows > 0 ? "," : "",
+                               (unsigned long) timestamp, (unsigned long) window.sequence, window.sensor, window.sample_count);
+                for (uint8_t i = 0; i < WINDOW_HISTORY_CHANNELS; i++) {
+                    if ((query.channels & 1 << i) == 0) continue;
+                    const WINDOW_CHANNEL_TYPE& channel = window.*CHANNELS[i];
+                    len += snprintf(&row[len], capacity - len, ",[%ld,%ld,%ld]", (long) channel.average, (long) channel.low, (long) channel.high);
+                }
+                len += snprintf(&row[len], capacity - len, "]");
+
+                query.rows++;
+                return len;
+            }
+            query.stage = HISTORY_QUERY_CLOSE;
+        }
+        // fall through
+
+        case HISTORY_QUERY_CLOSE:
+            query.stage = HISTORY_QUERY_DONE;
+            return snprintf(row, capacity, "],\"count\":%lu}", (unsigned long) query.rows);
+    }
+
+    return 0;
+}
+
+// comma separated channel names, an empty list selects them all; 0 if any is unknown
+uint8_t WindowHistory::parseChannels(const char* list) {
+    uint8_t channels = 0;
+
+    while (list != nullptr && *list) {
+        while (*list == ',' || isspace((unsigned char) *list)) list++;
+        if (*list == 0) break;
+
+        size_t len = 0;
+        while (list[len] && list[len] != ',' && !isspace((unsigned char) list[len])) len++;
+
+        uint8_t i = 0;
+        while (i < WINDOW_HISTORY_CHANNELS && (strlen(WINDOW_HISTORY_CHANNEL_NAMES[i]) != len || strncmp(WINDOW_HISTORY_CHANNEL_NAMES[i], list, len) != 0)) i++;
+        if (i == WINDOW_HISTORY_CHANNELS) return 0;
+
+        channels |= 1 << i;
+        list += len;
+    }
+
+    return channels == 0 ? WINDOW_HISTORY_ALL_CHANNELS : channels;
+}
@@ -0,0 +1,196 @@
+// AdaptiveSampler: an indoor trace of temperature, pressure and humidity,
+// one reading a second for three hours with the BME280's noise, replayed
+// at whatever interval the sampler asks for.  Quiet stretches must back
+// off to the maximum, and an hvac pressure step, a heater ramp and a
+// shower must each pull the interval down to the minimum.  The interval
+// stays in bounds and only ever drops to the minimum or doubles.  Then
+// the samples saved against a fixed cadence and the cost of an update.
+#include <cassert>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <random>
+#include <vector>
+#include "adaptive_sampler.h"
+
+#define MIN_INTERVAL    1000
+#define MAX_INTERVAL    32000
+#define TRACE_SECONDS   (3 * 3600)
+
+struct Reading {
+  int32_t values[ADAPTIVE_CHANNELS];   // milli-C, milli-hPa, milli-%
+};
+
+struct Event {
+  const char* name;
+  uint32_t start;                      // s
+  uint32_t end;
+};
+
+static const Event EVENTS[] = {
+  { "hvac pressure step", 1800, 2100 },
+  { "heater ramp",        4500, 4800 },
+  { "shower",             7200, 7500 },
+};
+
+static std::vector<Reading> trace;
+
+static double ramp(uint32_t t, uint32_t start, uint32_t end) {
+  return t < start ? 0 : (t >= end ? 1 : (double) (t - start) / (end - start));
+}
+
+// quantized like the compensated readings
+static void record() {
+  std::mt19937 rng(280);
+  std::normal_distribution<double> noise(0, 1);
+
+  for (uint32_t t = 0; t < TRACE_SECONDS; t++) {
+    double temperature = 21.3 + 0.2 * sin(t / 5400.0) + 3.0 * ramp(t, 4500, 4800) - 3.0 * ramp(t, 6000, 7000);
+    double pressure = 1013.2 - 0.15 * t / 3600 + 0.12 * ramp(t, 1800, 1810) - 0.12 * ramp(t, 2100, 2110);
+    double humidity = 44.0 + 20.0 * ramp(t, 7200, 7500) - 20.0 * ramp(t, 7800, 9000);
+
+    temperature += noise(rng) * 0.01;
+    pressure += noise(rng) * 0.012;
+    humidity += noise(rng) * 0.03;
+
+    trace.push_back({ { (int32_t) lround(temperature * 100) * 10, (int32_t) lround(pressure * 1000), (int32_t) lround(humidity * 1000) } });
+  }
+}
+
+struct Step {
+  uint32_t time;                       // s
+  uint32_t interval;                   // ms, asked for after this sample
+};
+
+static std::vector<Step> replay(AdaptiveSampler& sampler) {
+  std::vector<Step> steps;
+
+  for (uint32_t t = 0; t < TRACE_SECONDS; ) {
+    const uint32_t interval = sampler.update(trace[t].values, t * 1000);
+    steps.push_back({ t, interval });
+    t += interval / 1000;
+  }
+
+  return steps;
+}
+
+static void checkBounds(const std::vector<Step>& steps) {
+  uint32_t previous = steps[0].interval;
+  size_t drops = 0, doubles = 0;
+
+  for (const Step& step : steps) {
+    assert(step.interval >= MIN_INTERVAL && step.interval <= MAX_INTERVAL);
+
+    if (step.interval < previous) {
+      assert(step.interval == MIN_INTERVAL);
+      drops++;
+    } else if (step.interval > previous) {
+      assert(step.interval == previous * 2 || step.interval == MAX_INTERVAL);
+      doubles++;
+    }
+    previous = step.interval;
+  }
+
+  printf("bounds: %zu samples, %zu drops to the minimum, %zu doublings\n", steps.size(), drops, doubles);
+}
+
+// quiet means no event is running or settling
+static bool isQuiet(uint32_t t) {
+  if (t < 120) return false;
+  for (const Event& event : EVENTS) {
+    if (t + 60 >= event.start && t < event.end + 1800) return false;
+  }
+  return true;
+}
+
+static void checkQuiet(const std::vector<Step>& steps) {
+  // the first flat samples hold, then every one doubles
+  uint32_t reached = 0;
+  for (const Step& step : steps) {
+    if (step.interval == MAX_INTERVAL) {
+      reached = step.time;
+      break;
+    }
+  }
+  assert(reached > 0 && reached < 120);
+
+  uint32_t quiet = 0, atMax = 0;
+  for (size_t i = 0; i + 1 < steps.size(); i++) {
+    if (!isQuiet(steps[i].time)) continue;
+    const uint32_t span = steps[i + 1].time - steps[i].time;
+    quiet += span;
+    if (steps[i].interval == MAX_INTERVAL) atMax += span;
+  }
+  assert(atMax * 10 >= quiet * 9);
+
+  printf("quiet: maximum after %u s, %.1f%% of quiet time at the maximum\n", reached, 100.0 * atMax / quiet);
+}
+
+static void checkEvents(const std::vector<Step>& steps) {
+  for (const Event& event : EVENTS) {
+    uint32_t detected = UINT32_MAX, atMin = 0;
+
+    for (const Step& step : steps) {
+      if (step.time < event.start || step.time >= event.end) continue;
+      if (step.interval == MIN_INTERVAL) {
+        if (detected == UINT32_MAX) detected = step.time;
+        atMin++;
+      }
+    }
+
+    // the first sample inside it lands within one maximum interval, and a
+    // slow ramp may need one more before the smoothed deviation crosses
+    assert(detected != UINT32_MAX);
+    assert(detected - event.start <= 2 * MAX_INTERVAL / 1000);
+    printf("%s: minimum %u s in, %u samples at the minimum\n", event.name, detected - event.start, atMin);
+  }
+}
+
+static void checkConfigure() {
+  AdaptiveSampler sampler;
+  const int32_t values[ADAPTIVE_CHANNELS] = { 21000, 1013000, 44000 };
+
+  sampler.configure(5000, 2000, 60000);
+  assert(sampler.getInterval() == 5000);
+
+  sampler.configure(1000, 8000, 100);
+  assert(sampler.getInterval() == 1000);
+  sampler.configure(1000, 8000, 60000);
+  assert(sampler.getInterval() == 8000);
+
+  // the first sample only primes, a repeated timestamp changes nothing
+  sampler.configure(1000, 8000, 2000);
+  assert(sampler.update(values, 1000) == 2000);
+  assert(sampler.update(values, 1000) == 2000);
+  assert(!sampler.isActive());
+  printf("configure: start clamped, max raised to min, priming ok\n");
+}
+
+static void benchUpdate() {
+  AdaptiveSampler sampler;
+  sampler.configure(MIN_INTERVAL, MAX_INTERVAL, MIN_INTERVAL);
+
+  uint32_t sink = 0;
+  const auto start = std::chrono::steady_clock::now();
+  for (uint32_t t = 0; t < TRACE_SECONDS; t++) sink += sampler.update(trace[t].values, t * 1000);
+  const double ns = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count();
+
+  assert(sink > 0);
+  printf("update: %.0f ns (host)\n", ns / TRACE_SECONDS);
+}
+
+int main() {
+  record();
+
+  AdaptiveSampler sampler;
+  sampler.configure(MIN_INTERVAL, MAX_INTERVAL, MIN_INTERVAL);
+  const std::vector<Step> steps = replay(sampler);
+
+  checkBounds(steps);
+  checkQuiet(steps);
+  checkEvents(steps);
+  checkConfigure();
+  printf("savings: %zu samples against %u at a fixed %u ms\n", steps.size(), TRACE_SECONDS, MIN_INTERVAL);
+  benchUpdate();
+  return 0;
+}
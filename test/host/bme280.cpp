@@ -0,0 +1,159 @@
+// BME280Sensor: the burst read of the eight data registers and the integer
+// compensation, against a fake register file.  The datasheet's worked
+// example must compensate to its published temperature and pressure,
+// humidity must match the datasheet's floating point formula, and skipped
+// channels must read as skipped.  Then, for 1 to 5 pipelines (3 on the
+// esp8266, 5 on the esp32), the bus transactions and bytes of one pass, the
+// bus time they cost at 400 kHz i2c and 10 MHz spi, and the host time of
+// the compensation -- next to the stock Adafruit read path.
+#include <cassert>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include "bme280_sensor.h"
+
+#define PIPELINES          5
+#define I2C_HZ             400000.0
+#define SPI_HZ             10000000.0
+
+// bmp280 datasheet 3.12 for temperature and pressure, a typical part for humidity
+static const uint16_t CALIBRATION_T[] = { 27504, 26435, (uint16_t) -1000 };
+static const uint16_t CALIBRATION_P[] = { 36477, (uint16_t) -10685, 3024, 2855, 140, (uint16_t) -7, 15500, (uint16_t) -14600, 6000 };
+static const uint8_t  H1 = 75, H3 = 0;
+static const int16_t  H2 = 362, H4 = 313, H5 = 50;
+static const int8_t   H6 = 30;
+
+#define EXAMPLE_ADC_T      519888
+#define EXAMPLE_ADC_P      415148
+#define EXAMPLE_ADC_H      30000
+
+static void putLe(uint8_t reg, uint16_t value) {
+  FakeBme::regs[reg] = value;
+  FakeBme::regs[reg + 1] = value >> 8;
+}
+
+static void setData(int32_t adcP, int32_t adcT, int32_t adcH) {
+  uint8_t* d = &FakeBme::regs[BME280_REGISTER_PRESSUREDATA];
+  d[0] = adcP >> 12; d[1] = adcP >> 4; d[2] = adcP << 4;
+  d[3] = adcT >> 12; d[4] = adcT >> 4; d[5] = adcT << 4;
+  d[6] = adcH >> 8; d[7] = adcH;
+}
+
+static void loadChip() {
+  memset(FakeBme::regs, 0, sizeof(FakeBme::regs));
+  FakeBme::regs[BME280_REGISTER_CHIPID] = BME280_CHIP_ID;
+
+  for (int i = 0; i < 3; i++) putLe(BME280_REGISTER_DIG_T1 + 2 * i, CALIBRATION_T[i]);
+  for (int i = 0; i < 9; i++) putLe(BME280_REGISTER_DIG_T1 + 6 + 2 * i, CALIBRATION_P[i]);
+  FakeBme::regs[BME280_REGISTER_DIG_H1] = H1;
+  putLe(BME280_REGISTER_DIG_H2, H2);
+  FakeBme::regs[BME280_REGISTER_DIG_H2 + 2] = H3;
+  FakeBme::regs[BME280_REGISTER_DIG_H2 + 3] = H4 >> 4;
+  FakeBme::regs[BME280_REGISTER_DIG_H2 + 4] = (H4 & 0x0F) | (H5 & 0x0F) << 4;
+  FakeBme::regs[BME280_REGISTER_DIG_H2 + 5] = H5 >> 4;
+  FakeBme::regs[BME280_REGISTER_DIG_H2 + 6] = H6;
+
+  setData(EXAMPLE_ADC_P, EXAMPLE_ADC_T, EXAMPLE_ADC_H);
+}
+
+// datasheet 8.1 floating point humidity, from the integer t_fine
+static double humidityDouble(int32_t adcH, int32_t tFine) {
+  double h = tFine - 76800.0;
+  h = (adcH - (H4 * 64.0 + H5 / 16384.0 * h)) * (H2 / 65536.0 * (1.0 + H6 / 67108864.0 * h * (1.0 + H3 / 67108864.0 * h)));
+  h = h * (1.0 - H1 * h / 524288.0);
+  return h < 0 ? 0 : (h > 100 ? 100 : h);
+}
+
+static void checkCompensation() {
+  loadChip();
+
+  BME280Sensor sensor;
+  assert(sensor.begin(BME280_ADDRESS, &Wire));
+
+  BME280_READING_TYPE reading;
+  assert(sensor.readSample(&reading));
+
+  // 25.08 C and 100653.27 Pa in the worked example
+  assert(reading.temperature == 25080);
+  assert(reading.pressure == 1006533);
+
+  // the same t_fine the integer path used: 25.08 C is 128422
+  const double humidity = humidityDouble(EXAMPLE_ADC_H, 128422);
+  assert(fabs(reading.humidity / 1000.0 - humidity) < 0.01);
+
+  // oversampling off reads back the reset value
+  setData(0x80000, EXAMPLE_ADC_T, 0x8000);
+  assert(sensor.readSample(&reading));
+  assert(reading.pressure == 0 && reading.humidity == 0 && reading.temperature == 25080);
+  setData(EXAMPLE_ADC_P, 0x80000, EXAMPLE_ADC_H);
+  assert(!sensor.readSample(&reading));
+
+  // a resume re-reads the calibration without a reset
+  setData(EXAMPLE_ADC_P, EXAMPLE_ADC_T, EXAMPLE_ADC_H);
+  BME280Sensor resumed;
+  assert(resumed.resume(BME280_ADDRESS, &Wire));
+  resumed.resumeForced(Adafruit_BME280::SAMPLING_X1, Adafruit_BME280::SAMPLING_X1, Adafruit_BME280::SAMPLING_X1, Adafruit_BME280::FILTER_OFF);
+  assert(resumed.readSample(&reading) && reading.pressure == 1006533);
+
+  FakeBme::regs[BME280_REGISTER_CHIPID] = 0x58;
+  assert(!resumed.resume(BME280_ADDRESS, &Wire));
+  FakeBme::regs[BME280_REGISTER_CHIPID] = BME280_CHIP_ID;
+
+  printf("compensation: %.2f C, %.3f hPa, %.3f %% (double %.3f %%)\n",
+         reading.temperature / 1000.0, reading.pressure / 1000.0, reading.humidity / 1000.0, humidity);
+}
+
+// start, address, register, restart, address, data, stop
+static double i2cMicros(unsigned long transactions, unsigned long bytes) {
+  return (transactions * (2 + 9 + 2) + bytes * 9) / I2C_HZ * 1e6;
+}
+
+static double spiMicros(unsigned long bytes) {
+  return bytes * 8 / SPI_HZ * 1e6;
+}
+
+static void benchPipelines() {
+  loadChip();
+
+  BME280Sensor sensors[PIPELINES];
+  for (int i = 0; i < PIPELINES; i++) assert(sensors[i].begin(BME280_ADDRESS, &Wire));
+
+  const int rounds = 200000;
+  for (int pipelines = 1; pipelines <= PIPELINES; pipelines++) {
+    BME280_READING_TYPE reading;
+
+    FakeBme::transactions = FakeBme::bytes = 0;
+    for (int i = 0; i < pipelines; i++) sensors[i].readSample(&reading);
+    const unsigned long burstTransactions = FakeBme::transactions, burstBytes = FakeBme::bytes;
+
+    FakeBme::transactions = FakeBme::bytes = 0;
+    for (int i = 0; i < pipelines; i++) {
+      sensors[i].readTemperature();
+      sensors[i].readPressure();
+      sensors[i].readHumidity();
+    }
+    const unsigned long stockTransactions = FakeBme::transactions, stockBytes = FakeBme::bytes;
+
+    long sink = 0;
+    const auto start = std::chrono::steady_clock::now();
+    for (int r = 0; r < rounds; r++) {
+      for (int i = 0; i < pipelines; i++) {
+        sensors[i].readSample(&reading);
+        sink += reading.pressure;
+      }
+    }
+    const double us = std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - start).count() / rounds;
+    assert(sink != 0);
+
+    printf("%d pipelines: burst %lu transactions / %lu bytes, %.0f us i2c / %.1f us spi; stock %lu / %lu, %.0f us i2c / %.1f us spi; "
+           "read + compensate %.3f us (host)\n",
+           pipelines, burstTransactions, burstBytes, i2cMicros(burstTransactions, burstBytes), spiMicros(burstBytes),
+           stockTransactions, stockBytes, i2cMicros(stockTransactions, stockBytes), spiMicros(stockBytes), us);
+  }
+}
+
+int main() {
+  checkCompensation();
+  benchPipelines();
+  return 0;
+}
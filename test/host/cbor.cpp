@@ -0,0 +1,289 @@
+// CborWriter against the text payloads the Home Assistant sensors carry,
+// on the same realistic BME280 windows.  Every raw window record (the
+// layout publishRawWindow() writes) decodes back to its window, and the
+// text states parse back to the published values.  Then bytes and
+// microseconds per window to encode each form and to decode it again on
+// the collector.
+#include <cassert>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <algorithm>
+#include <random>
+#include <vector>
+#include "cbor.h"
+#include "window.h"
+
+#define WINDOWS            20000
+#define RAW_WINDOW_MAX_LEN 96
+#define HPA_TO_INHG        0.02952998057228486
+
+static std::mt19937 rng(27);
+
+static double gauss(double sigma) { return std::normal_distribution<double>(0, sigma)(rng); }
+
+static WINDOW_CHANNEL_TYPE channel(const long* v, int n) {
+  WINDOW_CHANNEL_TYPE c { 0, v[0], v[0] };
+  for (int i = 0; i < n; i++) {
+    c.low = std::min(c.low, v[i]);
+    c.high = std::max(c.high, v[i]);
+    c.average += v[i];
+  }
+  c.average /= n;
+  return c;
+}
+
+// 12 samples per window with the sensor's noise on a daily swing
+static WINDOW_TYPE makeWindow(unsigned long sequence, uint8_t sensor) {
+  WINDOW_TYPE w {};
+  w.sequence = sequence;
+  w.sensor = sensor;
+  w.timestamp = sequence * 60000;
+  w.sample_count = 12;
+
+  const double day = sequence / 1440.0 * 2 * M_PI;
+  const double t = 21.0 + 3 * sin(day);
+  const double h = 45 - 8 * sin(day);
+  const double p = 1013.0 + 2 * sin(day * 0.5);
+
+  long st[12], sh[12], sp[12], sa[12], sr[12];
+  for (int i = 0; i < 12; i++) {
+    const double pp = p + gauss(0.012);
+    st[i] = lround((t + gauss(0.01)) * 100) * 10;
+    sh[i] = lround((h + gauss(0.03)) * 1024) * 1000 / 1024;
+    sp[i] = lround(pp * 1000);
+    sa[i] = lround(44330.0 * (1 - pow(pp / 1013.25, 0.1903)) * 1000);
+    sr[i] = 62 + lround(gauss(1.5));
+  }
+  w.temperature = channel(st, 12);
+  w.humidity = channel(sh, 12);
+  w.pressure = channel(sp, 12);
+  w.altitude = channel(sa, 12);
+  w.rssi = channel(sr, 12);
+  return w;
+}
+
+// the map publishRawWindow() builds
+static size_t encodeWindow(const WINDOW_TYPE& window, uint8_t* payload, size_t capacity) {
+  const WINDOW_CHANNEL_TYPE* channels[] = { &window.temperature, &window.humidity, &window.pressure, &window.altitude, &window.rssi };
+  CborWriter cbor(payload, capacity);
+
+  cbor.beginMap(9);
+  cbor.writeUnsigned(0);
+  cbor.writeUnsigned(window.sequence);
+  cbor.writeUnsigned(1);
+  cbor.writeUnsigned(window.timestamp);
+  cbor.writeUnsigned(2);
+  cbor.writeUnsigned(window.sample_count);
+
+  for (int i = 0; i < 5; i++) {
+    cbor.writeUnsigned(3 + i);
+    cbor.beginArray(3);
+    cbor.writeInt(channels[i]->average);
+    cbor.writeInt(channels[i]->low);
+    cbor.writeInt(channels[i]->high);
+  }
+
+  cbor.writeUnsigned(8);
+  cbor.writeUnsigned(window.sensor);
+
+  return cbor.overflowed() ? 0 : cbor.length();
+}
+
+// just enough of a collector to read the record back
+struct Reader {
+  const uint8_t* p;
+  const uint8_t* end;
+
+  uint8_t major;
+  uint32_t head() {
+    assert(p < end);
+    const uint8_t initial = *p++;
+    major = initial >> 5;
+    const uint8_t info = initial & 0x1F;
+    if (info < 24) return info;
+
+    const int bytes = info == 24 ? 1 : info == 25 ? 2 : 4;
+    assert(info <= 26 && p + bytes <= end);
+    uint32_t value = 0;
+    for (int i = 0; i < bytes; i++) value = value << 8 | *p++;
+    return value;
+  }
+
+  int64_t integer() {
+    const uint32_t value = head();
+    assert(major <= 1);
+    return major == 0 ? (int64_t) value : -1 - (int64_t) value;
+  }
+};
+
+static bool decodeWindow(const uint8_t* payload, size_t len, WINDOW_TYPE& window) {
+  Reader r { payload, payload + len, 0 };
+  WINDOW_CHANNEL_TYPE* channels[] = { &window.temperature, &window.humidity, &window.pressure, &window.altitude, &window.rssi };
+
+  const uint32_t pairs = r.head();
+  if (r.major != 5) return false;
+
+  for (uint32_t i = 0; i < pairs; i++) {
+    const int64_t key = r.integer();
+    if (key >= 3 && key <= 7) {
+      if (r.head() != 3 || r.major != 4) return false;
+      channels[key - 3]->average = r.integer();
+      channels[key - 3]->low = r.integer();
+      channels[key - 3]->high = r.integer();
+      continue;
+    }
+
+    const int64_t value = r.integer();
+    if (key == 0) window.sequence = value;
+    else if (key == 1) window.timestamp = value;
+    else if (key == 2) window.sample_count = value;
+    else if (key == 8) window.sensor = value;
+    else return false;
+  }
+
+  return r.p == r.end;
+}
+
+// HANumeric: the value scaled by the precision, rounded and printed with
+// the decimal point put back in
+static size_t formatState(char* buf, double value, int precision) {
+  static const int64_t SCALE[] = { 1, 10, 100, 1000 };
+  const int64_t scaled = llround(value * SCALE[precision]);
+  const uint64_t magnitude = scaled < 0 ? -scaled : scaled;
+
+  char digits[24];
+  int n = 0;
+  uint64_t rest = magnitude;
+  do {
+    digits[n++] = '0' + rest % 10;
+    rest /= 10;
+  } while (rest > 0 || n <= precision);
+
+  size_t len = 0;
+  if (scaled < 0) buf[len++] = '-';
+  while (n > 0) {
+    if (n == precision) buf[len++] = '.';
+    buf[len++] = digits[--n];
+  }
+  buf[len] = 0;
+  return len;
+}
+
+// the four pipeline states setPipelineValues() publishes, one message each
+struct TextStates {
+  char text[4][24];
+  size_t len[4];
+};
+
+static const int PRECISIONS[] = { 1, 0, 2, 1 };
+
+static void stateValues(const WINDOW_TYPE& w, double* values) {
+  values[0] = w.temperature.average / 1000.0 * 1.8 + 32;
+  values[1] = w.humidity.average / 1000.0;
+  values[2] = w.pressure.average / 1000.0 * HPA_TO_INHG;
+  values[3] = w.altitude.average / 1000.0;
+}
+
+static size_t formatWindow(const WINDOW_TYPE& window, TextStates& states) {
+  double values[4];
+  stateValues(window, values);
+
+  size_t total = 0;
+  for (int i = 0; i < 4; i++) total += states.len[i] = formatState(states.text[i], values[i], PRECISIONS[i]);
+  return total;
+}
+
+static bool same(const WINDOW_CHANNEL_TYPE& a, const WINDOW_CHANNEL_TYPE& b) {
+  return a.average == b.average && a.low == b.low && a.high == b.high;
+}
+
+static std::vector<WINDOW_TYPE> windows;
+
+static void checkRoundTrip() {
+  uint8_t payload[RAW_WINDOW_MAX_LEN];
+  size_t longest = 0;
+
+  for (const WINDOW_TYPE& w : windows) {
+    const size_t len = encodeWindow(w, payload, sizeof(payload));
+    assert(len > 0);
+    longest = std::max(longest, len);
+
+    WINDOW_TYPE d {};
+    assert(decodeWindow(payload, len, d));
+    assert(d.sequence == w.sequence && d.timestamp == w.timestamp && d.sample_count == w.sample_count && d.sensor == w.sensor);
+    assert(same(d.temperature, w.temperature) && same(d.humidity, w.humidity) && same(d.pressure, w.pressure));
+    assert(same(d.altitude, w.altitude) && same(d.rssi, w.rssi));
+
+    TextStates states;
+    formatWindow(w, states);
+    double values[4];
+    stateValues(w, values);
+    for (int i = 0; i < 4; i++) {
+      assert(fabs(strtod(states.text[i], NULL) - values[i]) <= 0.5 / pow(10, PRECISIONS[i]) + 1e-9);
+    }
+  }
+
+  // the buffer must never truncate, and the writer must flag it when it would
+  assert(encodeWindow(windows[0], payload, 10) == 0);
+
+  char text[24];
+  formatState(text, -0.04, 1);
+  assert(strcmp(text, "0.0") == 0 || strcmp(text, "-0.0") == 0);
+  formatState(text, 29.92, 2);
+  assert(strcmp(text, "29.92") == 0);
+
+  printf("round trip: %zu windows, longest record %zu of %d bytes\n", windows.size(), longest, RAW_WINDOW_MAX_LEN);
+}
+
+template <typename F>
+static double microsPerWindow(F f) {
+  const auto start = std::chrono::steady_clock::now();
+  f();
+  return std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - start).count() / windows.size();
+}
+
+static void bench() {
+  std::vector<uint8_t> records(windows.size() * RAW_WINDOW_MAX_LEN);
+  std::vector<size_t> recordLen(windows.size());
+  std::vector<TextStates> states(windows.size());
+  size_t cborBytes = 0, textBytes = 0;
+
+  const double cborEncode = microsPerWindow([&] {
+    for (size_t i = 0; i < windows.size(); i++) cborBytes += recordLen[i] = encodeWindow(windows[i], &records[i * RAW_WINDOW_MAX_LEN], RAW_WINDOW_MAX_LEN);
+  });
+  const double textEncode = microsPerWindow([&] {
+    for (size_t i = 0; i < windows.size(); i++) textBytes += formatWindow(windows[i], states[i]);
+  });
+
+  long sink = 0;
+  const double cborDecode = microsPerWindow([&] {
+    for (size_t i = 0; i < windows.size(); i++) {
+      WINDOW_TYPE d {};
+      decodeWindow(&records[i * RAW_WINDOW_MAX_LEN], recordLen[i], d);
+      sink += d.pressure.average;
+    }
+  });
+  double textSink = 0;
+  const double textDecode = microsPerWindow([&] {
+    for (size_t i = 0; i < windows.size(); i++) {
+      for (int c = 0; c < 4; c++) textSink += strtod(states[i].text[c], NULL);
+    }
+  });
+  assert(sink != 0 && textSink != 0);
+
+  const double n = windows.size();
+  printf("cbor record: %.1f bytes per window, 20 values, encode %.3f us, decode %.3f us (host)\n", cborBytes / n, cborEncode, cborDecode);
+  printf("text states: %.1f bytes per window, 4 averages in 4 messages, encode %.3f us, decode %.3f us (host)\n", textBytes / n, textEncode, textDecode);
+  printf("per value: cbor %.2f bytes, text %.2f bytes\n", cborBytes / n / 20, textBytes / n / 4);
+}
+
+int main() {
+  for (unsigned long i = 0; i < WINDOWS; i++) windows.push_back(makeWindow(i, i % 3));
+
+  checkRoundTrip();
+  bench();
+  return 0;
+}
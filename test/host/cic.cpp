@@ -0,0 +1,168 @@
+// CicDecimator against the trimmed mean the windows use (drop the low
+// and the high, average the rest), on a synthetic noisy pressure step:
+// 1013 hPa with the BME280's 1.2 Pa of noise at 16x oversampling, then
+// 5 hPa higher.  A constant must come through exactly, and the integrators
+// must wrap cleanly at the largest ratio.  For each ratio it compares the
+// output variance on the flat stretch against the trimmed mean's, and the
+// outputs each needs to cross the step.  Then ns per input sample for both.
+#include <cassert>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <random>
+#include <vector>
+#include "cic_decimator.h"
+
+#define BASELINE     1013000        // milli-hPa
+#define STEP         5000
+#define NOISE        12.0
+#define OUTPUTS      4000           // per side of the step
+
+static std::vector<int32_t> makeStep(uint32_t ratio) {
+  std::mt19937 rng(32 + ratio);
+  std::normal_distribution<double> noise(0, NOISE);
+  std::vector<int32_t> samples;
+
+  for (uint32_t i = 0; i < 2 * OUTPUTS * ratio; i++) {
+    samples.push_back((i < OUTPUTS * ratio ? BASELINE : BASELINE + STEP) + (int32_t) lround(noise(rng)));
+  }
+  return samples;
+}
+
+// as the window code does it: the sum less the low and the high over n - 2
+static std::vector<int32_t> trimmedMean(const std::vector<int32_t>& samples, uint32_t ratio) {
+  std::vector<int32_t> out;
+
+  for (size_t start = 0; start + ratio <= samples.size(); start += ratio) {
+    int64_t sum = 0;
+    int32_t low = samples[start], high = samples[start];
+    for (uint32_t i = 0; i < ratio; i++) {
+      const int32_t v = samples[start + i];
+      sum += v;
+      if (v < low) low = v;
+      if (v > high) high = v;
+    }
+    out.push_back(ratio > 2 ? (int32_t) ((sum - low - high) / (ratio - 2)) : (int32_t) (sum / ratio));
+  }
+  return out;
+}
+
+// primed with the baseline so output i ends on the same input as the
+// trimmed mean's i
+static std::vector<int32_t> decimate(const std::vector<int32_t>& samples, uint32_t ratio) {
+  CicDecimator<> cic;
+  cic.setRatio(ratio);
+
+  std::vector<int32_t> out;
+  int32_t value;
+  for (size_t i = 0; i < (CIC_ORDER - 1) * ratio; i++) cic.push(BASELINE, &value);
+  for (int32_t sample : samples) {
+    if (cic.push(sample, &value)) out.push_back(value);
+  }
+  return out;
+}
+
+struct Stats {
+  double mean;
+  double variance;
+};
+
+static Stats stats(const std::vector<int32_t>& out, size_t from, size_t to) {
+  double sum = 0, squares = 0;
+  for (size_t i = from; i < to; i++) sum += out[i];
+  const double mean = sum / (to - from);
+  for (size_t i = from; i < to; i++) squares += (out[i] - mean) * (out[i] - mean);
+  return { mean, squares / (to - from - 1) };
+}
+
+// outputs after the step until one lands past 90% of it and every later one stays past 50%
+static size_t riseOutputs(const std::vector<int32_t>& out) {
+  size_t rise = 0;
+  for (size_t i = OUTPUTS; i < out.size(); i++) {
+    if (out[i] < BASELINE + STEP / 2) rise = 0;
+    else if (rise == 0 && out[i] >= BASELINE + STEP * 9 / 10) rise = i - OUTPUTS + 1;
+  }
+  return rise;
+}
+
+static void checkExact() {
+  static const int32_t VALUES[] = { 0, 1, -1, 1100000, -1100000, 12345 };
+  static const uint32_t RATIOS[] = { 1, 2, 7, 64, CIC_MAX_RATIO };
+
+  for (uint32_t ratio : RATIOS) {
+    for (int32_t constant : VALUES) {
+      CicDecimator<> cic;
+      cic.setRatio(ratio);
+
+      int32_t value = 0;
+      size_t outputs = 0;
+      // enough inputs to push the top integrator far past 2^64 at the largest ratio
+      for (uint32_t i = 0; i < (CIC_ORDER + 3) * ratio; i++) {
+        if (cic.push(constant, &value)) {
+          assert(value == constant);
+          outputs++;
+        }
+      }
+      assert(outputs == 4);
+    }
+  }
+
+  CicDecimator<> cic;
+  cic.setRatio(0);
+  assert(cic.getRatio() == 1);
+  cic.setRatio(CIC_MAX_RATIO * 2);
+  assert(cic.getRatio() == CIC_MAX_RATIO);
+  printf("exact: constants through every ratio to %u, ratio clamped\n", CIC_MAX_RATIO);
+}
+
+static void compare(uint32_t ratio) {
+  const std::vector<int32_t> samples = makeStep(ratio);
+  const std::vector<int32_t> trimmed = trimmedMean(samples, ratio);
+  const std::vector<int32_t> cic = decimate(samples, ratio);
+  assert(trimmed.size() == 2 * OUTPUTS && cic.size() == 2 * OUTPUTS);
+
+  // skip past the step response on both sides
+  const Stats trimmedFlat = stats(trimmed, OUTPUTS + CIC_ORDER, trimmed.size());
+  const Stats cicFlat = stats(cic, OUTPUTS + CIC_ORDER, cic.size());
+
+  // unbiased on the flat, within a few standard errors of the mean
+  assert(fabs(cicFlat.mean - BASELINE - STEP) < 1.0);
+  assert(fabs(trimmedFlat.mean - BASELINE - STEP) < 1.0);
+
+  // the order 3 response spans 3R - 2 inputs against the trimmed mean's R - 2
+  if (ratio >= 4) assert(cicFlat.variance < trimmedFlat.variance);
+
+  // the box crosses in one output, the cic spreads the step over its order
+  const size_t trimmedRise = riseOutputs(trimmed);
+  const size_t cicRise = riseOutputs(cic);
+  assert(trimmedRise == 1);
+  assert(cicRise >= 2 && cicRise <= CIC_ORDER);
+
+  // ns per input sample
+  int64_t sink = 0;
+  auto start = std::chrono::steady_clock::now();
+  for (int32_t v : trimmedMean(samples, ratio)) sink += v;
+  const double trimmedNs = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count() / samples.size();
+
+  CicDecimator<> timed;
+  timed.setRatio(ratio);
+  int32_t value;
+  start = std::chrono::steady_clock::now();
+  for (int32_t v : samples) {
+    if (timed.push(v, &value)) sink += value;
+  }
+  const double cicNs = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count() / samples.size();
+  assert(sink != 0);
+
+  printf("ratio %5u: noise cic %.2f / trimmed mean %.2f / raw %.1f milli-hPa, rise cic %zu / trimmed mean %zu outputs, "
+         "%.1f / %.1f ns per sample (host)\n",
+         ratio, sqrt(cicFlat.variance), sqrt(trimmedFlat.variance), NOISE, cicRise, trimmedRise, cicNs, trimmedNs);
+}
+
+int main() {
+  checkExact();
+  compare(4);
+  compare(16);
+  compare(64);
+  return 0;
+}
@@ -0,0 +1,192 @@
+// DutyCycle: a simulated run of sample and publish wakes, each one restoring
+// its state from a fake rtc block, sleeping on a fake clock and sealing the
+// block again.  Covers the cold boot, the sample cadence and the quiet wake
+// totals, then a crc mismatch, a stale magic and a resized block, all of
+// which must start a fresh timeline.  Then the cost of a seal + verify.
+#include <cassert>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include "duty_cycle.h"
+
+#define SAMPLE_INTERVAL    10000
+#define SAMPLES_PER_PUBLISH 6
+#define SAMPLE_AWAKE       40       // ms, radio off
+#define PUBLISH_AWAKE      3500     // ms, radio up for most of it
+#define PUBLISH_RADIO      3000
+
+// the shape main.h retains: the cycle first, then the payload it covers
+typedef struct fake_retained_type {
+  DUTY_CYCLE_STATE_TYPE cycle;
+  uint32_t      samples_held;
+  uint32_t      payload[84];      // about the size of the real block
+} FAKE_RETAINED_TYPE;
+
+// survives "deep sleep"; everything else is rebuilt on each wake
+static uint8_t rtc[sizeof(FAKE_RETAINED_TYPE)];
+static uint32_t fakeClock = 0;
+
+struct Wake {
+  bool restored;
+  duty_cycle_action action;
+  uint32_t duration;
+  DutyCycle cycle;
+};
+
+// one boot: read the rtc, verify, run the wake, sleep, seal and write back
+static Wake wake() {
+  Wake w;
+  FAKE_RETAINED_TYPE retained;
+  memcpy(&retained, rtc, sizeof(retained));
+
+  w.restored = DutyCycle::verify(&retained, sizeof(retained));
+  if (!w.restored) retained.samples_held = 0;
+
+  w.cycle.configure(SAMPLE_INTERVAL, SAMPLES_PER_PUBLISH);
+  w.cycle.begin(&retained.cycle, w.restored);
+  w.action = w.cycle.getAction();
+
+  const uint32_t awake = w.action == DUTY_CYCLE_PUBLISH ? PUBLISH_AWAKE : SAMPLE_AWAKE;
+  const uint32_t radio = w.action == DUTY_CYCLE_PUBLISH ? PUBLISH_RADIO : 0;
+  const uint16_t held = w.action == DUTY_CYCLE_PUBLISH ? 0 : retained.samples_held;
+
+  w.duration = w.cycle.sleep(awake, radio, held);
+  retained.samples_held = held + 1;
+  fakeClock += awake + w.duration;
+
+  DutyCycle::seal(&retained, sizeof(retained));
+  memcpy(rtc, &retained, sizeof(retained));
+  return w;
+}
+
+static void checkCrc() {
+  // the ieee 802.3 check value
+  assert(DutyCycle::crc32((const uint8_t*) "123456789", 9) == 0xCBF43926);
+  assert(DutyCycle::crc32(NULL, 0) == 0);
+  printf("crc32: check value ok\n");
+}
+
+static void checkColdBoot() {
+  memset(rtc, 0xA5, sizeof(rtc));
+  fakeClock = 0;
+
+  Wake w = wake();
+  assert(!w.restored);
+  assert(w.action == DUTY_CYCLE_PUBLISH);
+  assert(w.cycle.getClock() == fakeClock);
+  assert(w.duration == SAMPLE_INTERVAL - PUBLISH_AWAKE);
+
+  FAKE_RETAINED_TYPE retained;
+  memcpy(&retained, rtc, sizeof(retained));
+  assert(retained.cycle.wakes == 1);
+  assert(DutyCycle::verify(&retained, sizeof(retained)));
+  printf("cold boot: publishes first, clock %u ms\n", fakeClock);
+}
+
+// carries on from the cold boot's block
+static void checkCadence() {
+  for (int round = 0; round < 4; round++) {
+    for (int i = 1; i < SAMPLES_PER_PUBLISH; i++) {
+      Wake w = wake();
+      assert(w.restored);
+      assert(w.action == DUTY_CYCLE_SAMPLE);
+      assert(w.duration + SAMPLE_AWAKE == SAMPLE_INTERVAL);
+    }
+
+    Wake w = wake();
+    assert(w.restored);
+    assert(w.action == DUTY_CYCLE_PUBLISH);
+    assert(w.cycle.getQuietWakes() == SAMPLES_PER_PUBLISH - 1);
+    assert(w.cycle.getQuietAwake() == (SAMPLES_PER_PUBLISH - 1) * SAMPLE_AWAKE);
+    assert(w.cycle.getClock() == fakeClock);
+  }
+
+  FAKE_RETAINED_TYPE retained;
+  memcpy(&retained, rtc, sizeof(retained));
+  assert(retained.cycle.wakes == 1 + 4 * SAMPLES_PER_PUBLISH);
+
+  // every wake kept the interval, so the clock is whole intervals
+  assert(fakeClock == retained.cycle.wakes * SAMPLE_INTERVAL);
+
+  DutyCycle cycle;
+  cycle.configure(SAMPLE_INTERVAL, SAMPLES_PER_PUBLISH);
+  cycle.begin(&retained.cycle, true);
+  // the cold boot publish plus four rounds of samples and a publish
+  const float sampleCharge = SAMPLE_AWAKE * DUTY_CYCLE_AWAKE_MA + (SAMPLE_INTERVAL - SAMPLE_AWAKE) * DUTY_CYCLE_SLEEP_MA;
+  const float publishCharge = (PUBLISH_AWAKE - PUBLISH_RADIO) * DUTY_CYCLE_AWAKE_MA + PUBLISH_RADIO * DUTY_CYCLE_RADIO_MA +
+                              (SAMPLE_INTERVAL - PUBLISH_AWAKE) * DUTY_CYCLE_SLEEP_MA;
+  const float expected = (5 * publishCharge + 4 * (SAMPLES_PER_PUBLISH - 1) * sampleCharge) / fakeClock;
+  const float average = cycle.getAverageCurrent();
+  assert(average > expected * 0.999 && average < expected * 1.001);
+  printf("cadence: %u wakes over %u ms, %.3f mA average\n", retained.cycle.wakes, fakeClock, average);
+}
+
+// a long wake still sleeps, and the next one comes late rather than never
+static void checkOverrun() {
+  FAKE_RETAINED_TYPE retained {};
+  DutyCycle cycle;
+  cycle.configure(SAMPLE_INTERVAL, SAMPLES_PER_PUBLISH);
+  cycle.begin(&retained.cycle, false);
+
+  assert(cycle.sleep(SAMPLE_INTERVAL + 500, SAMPLE_INTERVAL, 0) == DUTY_CYCLE_MIN_SLEEP);
+  assert(cycle.sleep(SAMPLE_INTERVAL - DUTY_CYCLE_MIN_SLEEP / 2, 0, 0) == DUTY_CYCLE_MIN_SLEEP);
+  assert(cycle.getClock() == 2 * SAMPLE_INTERVAL + 500 - DUTY_CYCLE_MIN_SLEEP / 2 + 2 * DUTY_CYCLE_MIN_SLEEP);
+  printf("overrun: sleeps %u ms minimum\n", DUTY_CYCLE_MIN_SLEEP);
+}
+
+// any damage to the block must be a cold boot, never a half-restored one
+static void checkMismatch(const char* name, void (*damage)(FAKE_RETAINED_TYPE&)) {
+  memset(rtc, 0, sizeof(rtc));
+  fakeClock = 0;
+  for (int i = 0; i < 3; i++) wake();
+
+  FAKE_RETAINED_TYPE retained;
+  memcpy(&retained, rtc, sizeof(retained));
+  assert(retained.cycle.wakes == 3);
+  assert(DutyCycle::verify(&retained, sizeof(retained)));
+
+  damage(retained);
+  assert(!DutyCycle::verify(&retained, sizeof(retained)));
+  memcpy(rtc, &retained, sizeof(retained));
+
+  fakeClock = 0;
+  Wake w = wake();
+  assert(!w.restored);
+  assert(w.action == DUTY_CYCLE_PUBLISH);
+  assert(w.cycle.getClock() == fakeClock);
+
+  memcpy(&retained, rtc, sizeof(retained));
+  assert(retained.cycle.wakes == 1);
+  assert(retained.samples_held == 1);
+  printf("%s: cold boot\n", name);
+}
+
+static void benchSeal() {
+  FAKE_RETAINED_TYPE retained {};
+  for (size_t i = 0; i < sizeof(retained.payload) / sizeof(retained.payload[0]); i++) retained.payload[i] = i * 2654435761u;
+
+  const int rounds = 20000;
+  bool valid = true;
+  const auto start = std::chrono::steady_clock::now();
+  for (int i = 0; i < rounds; i++) {
+    retained.payload[i % 84]++;
+    DutyCycle::seal(&retained, sizeof(retained));
+    valid &= DutyCycle::verify(&retained, sizeof(retained));
+  }
+  const double us = std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - start).count();
+  assert(valid);
+  printf("seal + verify: %zu bytes in %.2f us (host)\n", sizeof(retained), us / rounds);
+}
+
+int main() {
+  checkCrc();
+  checkColdBoot();
+  checkCadence();
+  checkOverrun();
+  checkMismatch("crc mismatch", [](FAKE_RETAINED_TYPE& r) { r.payload[17] ^= 1; });
+  checkMismatch("stale magic", [](FAKE_RETAINED_TYPE& r) { r.cycle.magic = 0; });
+  // sealed by a build with a different retained layout
+  checkMismatch("resized block", [](FAKE_RETAINED_TYPE& r) { r.cycle.length -= sizeof(uint32_t); });
+  benchSeal();
+  return 0;
+}
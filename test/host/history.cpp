@@ -0,0 +1,210 @@
+// WindowHistory: every window pushed decodes back exactly, through
+// eviction, timestamp wrap, sequence gaps, several sensors and extreme
+// values; the /api/history json read back in small chunks parses to the
+// same windows.  Then bytes per window for realistic BME280 windows and
+// the decode and query speed over three days of them.
+#include <cassert>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <algorithm>
+#include <random>
+#include <string>
+#include <vector>
+#include "window_history.h"
+
+static std::mt19937 rng(42);
+static WindowHistory history;
+
+static double gauss(double sigma) { return std::normal_distribution<double>(0, sigma)(rng); }
+
+static WINDOW_CHANNEL_TYPE channel(const long* v) {
+  WINDOW_CHANNEL_TYPE c;
+  c.low = std::min({ v[0], v[1], v[2] });
+  c.high = std::max({ v[0], v[1], v[2] });
+  c.average = (v[0] + v[1] + v[2]) / 3;
+  return c;
+}
+
+// 3 samples per window with the sensor's noise on a daily swing
+static WINDOW_TYPE makeWindow(unsigned long sequence, unsigned long timestamp, double minute, uint8_t sensor) {
+  WINDOW_TYPE w {};
+  w.sequence = sequence;
+  w.sensor = sensor;
+  w.timestamp = timestamp;
+  w.sample_count = 3;
+
+  const double day = minute / 1440 * 2 * M_PI;
+  const double t = 21.0 + 3 * sin(day) + 0.3 * sin(minute / 37.0);
+  const double h = 45 - 8 * sin(day);
+  const double p = 1013.0 + 2 * sin(day * 0.5);
+
+  long st[3], sh[3], sp[3], sa[3], sr[3];
+  for (int i = 0; i < 3; i++) {
+    const double pp = p + gauss(0.012);
+    st[i] = lround((t + gauss(0.01)) * 100) * 10;
+    sh[i] = lround((h + gauss(0.03)) * 1024) * 1000 / 1024;
+    sp[i] = lround(pp * 1000);
+    sa[i] = lround(44330.0 * (1 - pow(pp / 1013.25, 0.1903)) * 1000);
+    sr[i] = 62 + lround(gauss(1.5));
+  }
+  w.temperature = channel(st);
+  w.humidity = channel(sh);
+  w.pressure = channel(sp);
+  w.altitude = channel(sa);
+  w.rssi = channel(sr);
+  return w;
+}
+
+static bool same(const WINDOW_CHANNEL_TYPE& a, const WINDOW_CHANNEL_TYPE& b) {
+  return a.average == b.average && a.low == b.low && a.high == b.high;
+}
+
+static bool same(const WINDOW_TYPE& a, const WINDOW_TYPE& b) {
+  return a.sequence == b.sequence && a.sensor == b.sensor && (uint32_t) a.timestamp == (uint32_t) b.timestamp &&
+         a.sample_count == b.sample_count && same(a.temperature, b.temperature) && same(a.humidity, b.humidity) &&
+         same(a.pressure, b.pressure) && same(a.altitude, b.altitude) && same(a.rssi, b.rssi);
+}
+
+// the ring holds the newest getCount() of what was pushed, in order
+static int checkRing(const std::vector<WINDOW_TYPE>& pushed) {
+  WINDOW_HISTORY_CURSOR_TYPE c;
+  WINDOW_TYPE w;
+  size_t i = pushed.size() - history.getCount();
+  int bad = 0;
+  history.first(c);
+  while (history.next(c, w)) bad += !same(w, pushed[i++]);
+  return bad + (i != pushed.size());
+}
+
+// the whole query, read in chunks the size a slow client would take
+static std::string query(uint32_t from, uint32_t to, uint8_t channels, size_t chunk) {
+  WINDOW_HISTORY_QUERY_TYPE q;
+  std::string out;
+  char buf[1436];
+  history.beginQuery(q, from, to, channels, 0);
+  while (!history.isQueryDone(q)) {
+    size_t n = history.readQuery(q, buf, std::min(chunk, sizeof(buf)));
+    assert(n > 0);
+    out.append(buf, n);
+  }
+  return out;
+}
+
+// every number in the "windows" array, in order: timestamp, sequence, sensor,
+// samples, then [average, low, high] per channel in WINDOW_HISTORY_CHANNEL_NAMES order
+static std::vector<long long> numbers(const std::string& json) {
+  std::vector<long long> v;
+  const char* p = strstr(json.c_str(), "\"windows\":[") + 11;
+  const char* end = strstr(p, "],\"count\":");
+  while (p < end) {
+    if (*p == '-' || (*p >= '0' && *p <= '9')) {
+      char* next;
+      v.push_back(strtoll(p, &next, 10));
+      p = next;
+    } else {
+      p++;
+    }
+  }
+  return v;
+}
+
+static void checkJson(const std::vector<WINDOW_TYPE>& pushed) {
+  const size_t first = pushed.size() - history.getCount();
+
+  for (size_t chunk : { (size_t) WINDOW_HISTORY_ROW_LEN, (size_t) 1436 }) {
+    const std::string json = query(0, UINT32_MAX, WINDOW_HISTORY_ALL_CHANNELS, chunk);
+    const std::vector<long long> v = numbers(json);
+    assert(v.size() == history.getCount() * 19);
+
+    for (size_t i = 0; i < history.getCount(); i++) {
+      const WINDOW_TYPE& w = pushed[first + i];
+      const long long* row = &v[i * 19];
+      const WINDOW_CHANNEL_TYPE* channels[] = { &w.temperature, &w.humidity, &w.pressure, &w.altitude, &w.rssi };
+      assert(row[0] == (long long) (uint32_t) w.timestamp && row[1] == (long long) (uint32_t) w.sequence);
+      assert(row[2] == w.sensor && row[3] == w.sample_count);
+      for (int k = 0; k < WINDOW_HISTORY_CHANNELS; k++) {
+        assert(row[4 + k * 3] == channels[k]->average && row[5 + k * 3] == channels[k]->low && row[6 + k * 3] == channels[k]->high);
+      }
+    }
+    char count[32];
+    snprintf(count, sizeof(count), "],\"count\":%lu}", (unsigned long) history.getCount());
+    assert(json.size() > strlen(count) && json.compare(json.size() - strlen(count), strlen(count), count) == 0);
+  }
+
+  // a range and a channel list select rows and columns
+  const uint32_t from = pushed[first + 10].timestamp, to = pushed[first + 19].timestamp;
+  const std::string json = query(from, to, WindowHistory::parseChannels("pressure, rssi"), 120);
+  assert(json.find("\"columns\":[\"timestamp\",\"sequence\",\"sensor\",\"samples\",\"pressure\",\"rssi\"]") != std::string::npos);
+  assert(numbers(json).size() == 10 * 10 && json.find("\"count\":10}") != std::string::npos);
+  assert(WindowHistory::parseChannels("temp") == 0 && WindowHistory::parseChannels("") == WINDOW_HISTORY_ALL_CHANNELS);
+}
+
+int main() {
+  std::vector<WINDOW_TYPE> pushed;
+  int bad = 0;
+
+  // random extremes, gaps, sensors and a timestamp wrap
+  {
+    std::uniform_int_distribution<long> any(INT32_MIN, INT32_MAX);
+    unsigned long ts = 0xFFFF0000UL;
+    for (int m = 0; m < 20000; m++) {
+      WINDOW_TYPE w = makeWindow(m * (m % 7 ? 1 : 3), ts, m, m % 5);
+      ts = (uint32_t) (ts + (m % 11 ? 60000 : any(rng)));
+      if (m % 13 == 0) {
+        w.temperature = { any(rng), any(rng), any(rng) };
+        w.sample_count = (short) any(rng);
+        w.sequence = (uint32_t) any(rng);
+      }
+      w.timestamp = (uint32_t) w.timestamp;
+      w.sequence = (uint32_t) w.sequence;
+      pushed.push_back(w);
+      history.push(w);
+      if (m % 777 == 0) bad += checkRing(pushed);
+    }
+    bad += checkRing(pushed);
+    checkJson(pushed);
+  }
+  printf("history: round trip mismatches %d\n", bad);
+  assert(bad == 0);
+
+  // three days of one sensor at 1 minute windows
+  history.clear();
+  pushed.clear();
+  unsigned long ts = 12345;
+  for (int m = 0; m < 3 * 1440; m++) {
+    ts += 60000 + (rng() % 40) - 20 + (m % 97 == 0 ? 3500 : 0);
+    pushed.push_back(makeWindow(m, ts, m, 0));
+    history.push(pushed.back());
+  }
+  assert(checkRing(pushed) == 0);
+  checkJson(pushed);
+  printf("history: json round trip ok\n");
+  printf("one sensor: %.1f bytes per window, %u windows (%.1f h at 1 min) in %d bytes\n",
+         (double) history.getBytesUsed() / history.getCount(), history.getCount(), history.getCount() / 60.0, WINDOW_HISTORY_SIZE);
+
+  {
+    const int reps = 2000;
+    unsigned long sum = 0;
+    auto t0 = std::chrono::steady_clock::now();
+    for (int r = 0; r < reps; r++) {
+      WINDOW_HISTORY_CURSOR_TYPE c;
+      WINDOW_TYPE w;
+      history.first(c);
+      while (history.next(c, w)) sum += w.temperature.average;
+    }
+    double us = std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - t0).count() / reps;
+    printf("decode only: %.0f ns per window (%lu)\n", us * 1000 / history.getCount(), sum % 10);
+  }
+
+  for (int one = 0; one < 2; one++) {
+    const uint8_t channels = one ? WindowHistory::parseChannels("temperature") : WINDOW_HISTORY_ALL_CHANNELS;
+    const int reps = 200;
+    size_t bytes = 0;
+    auto t0 = std::chrono::steady_clock::now();
+    for (int r = 0; r < reps; r++) bytes += query(0, UINT32_MAX, channels, 1436).size();
+    double us = std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - t0).count() / reps;
+    printf("query, %s: %.0f ns per row, %.0f MB/s of json\n", one ? "one channel " : "all channels", us * 1000 / history.getCount(), bytes / reps / us);
+  }
+}
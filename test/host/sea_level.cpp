@@ -0,0 +1,105 @@
+// stationToSeaLevelPressure: reference pairs of station pressure,
+// temperature and elevation with the sea level pressure they came from,
+// reduced back again.  The references are the 1976 US Standard Atmosphere
+// from sea level to 3000 m, and the same lapse rate integrated exactly
+// from 1013.25 hPa for stations far colder and warmer than standard.
+//
+// Tolerance: 0.1 hPa up to 2000 m and 0.2 hPa to 3000 m.  The error is
+// the mean-temperature approximation of the hypsometric equation, and it
+// grows with the layer's depth.  NWS seaLevelPressure uses a 12 hour mean
+// temperature and a plateau correction, so the "Sea level cross-check"
+// line in the log should be read against a looser bound of a few hPa.
+#include <cassert>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include "sea_level.h"
+
+#define SEA_LEVEL_HPA  1013.25
+#define ISA_KELVIN     288.15
+
+struct Pair {
+  double station;      // hPa
+  double celsius;
+  double elevation;    // m
+  double sea_level;    // hPa
+};
+
+static double tolerance(double elevation) {
+  return elevation <= 2000 ? 0.1 : 0.2;
+}
+
+// pressure at a station whose air column has the standard lapse rate and
+// the given temperature at the station
+static Pair lapsePair(double elevation, double celsius) {
+  const double seaKelvin = celsius + 273.15 + STANDARD_LAPSE_RATE * elevation;
+  const double exponent = STANDARD_GRAVITY / (DRY_AIR_GAS_CONSTANT * STANDARD_LAPSE_RATE);
+  return { SEA_LEVEL_HPA * pow(1 - STANDARD_LAPSE_RATE * elevation / seaKelvin, exponent), celsius, elevation, SEA_LEVEL_HPA };
+}
+
+static double check(const Pair& pair) {
+  const double reduced = stationToSeaLevelPressure(pair.station, pair.celsius, pair.elevation);
+  const double error = fabs(reduced - pair.sea_level);
+  assert(error <= tolerance(pair.elevation));
+  return error;
+}
+
+static void checkStandardAtmosphere() {
+  static const double ELEVATIONS[] = { 0, 100, 250, 500, 1000, 1500, 1609, 2000, 2500, 3000 };
+  double worst = 0;
+
+  for (double elevation : ELEVATIONS) {
+    // the 1976 standard: 15 C and 1013.25 hPa at sea level, 6.5 K/km
+    const Pair pair = { SEA_LEVEL_HPA * pow(1 - STANDARD_LAPSE_RATE * elevation / ISA_KELVIN, 5.255877),
+                        ISA_KELVIN - 273.15 - STANDARD_LAPSE_RATE * elevation, elevation, SEA_LEVEL_HPA };
+    const double error = check(pair);
+    if (error > worst) worst = error;
+    printf("standard atmosphere: %4.0f m, %7.2f hPa at %6.2f C, off by %.3f hPa\n", elevation, pair.station, pair.celsius, error);
+  }
+
+  printf("standard atmosphere: worst %.3f hPa\n", worst);
+}
+
+static void checkTemperatures() {
+  static const double ELEVATIONS[] = { 300, 1600, 2000 };
+  static const double CELSIUS[] = { -25, 0, 20, 35 };
+
+  for (double elevation : ELEVATIONS) {
+    double worst = 0;
+    for (double celsius : CELSIUS) {
+      const double error = check(lapsePair(elevation, celsius));
+      if (error > worst) worst = error;
+    }
+    printf("-25 to 35 C: %4.0f m, worst %.3f hPa\n", elevation, worst);
+  }
+}
+
+// a wrong temperature must move the result the way the physics does
+static void checkSensitivity() {
+  const Pair pair = lapsePair(1600, 10);
+  const double cold = stationToSeaLevelPressure(pair.station, 0, pair.elevation);
+  const double warm = stationToSeaLevelPressure(pair.station, 20, pair.elevation);
+
+  assert(cold > pair.sea_level && warm < pair.sea_level);
+  assert(stationToSeaLevelPressure(pair.station, 10, 0) == (float) pair.station);
+  printf("sensitivity: %.2f hPa per 10 C at 1600 m\n", (cold - warm) / 2);
+}
+
+static void benchReduce() {
+  const int rounds = 1000000;
+  float sink = 0;
+  const auto start = std::chrono::steady_clock::now();
+  for (int i = 0; i < rounds; i++) sink += stationToSeaLevelPressure(834.0f + (i & 63) * 0.01f, 4.5f, 1609);
+  const double ns = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count();
+
+  assert(sink > 0);
+  printf("reduce: %.1f ns (host)\n", ns / rounds);
+}
+
+int main() {
+  checkStandardAtmosphere();
+  checkTemperatures();
+  checkSensitivity();
+  benchReduce();
+  return 0;
+}
@@ -0,0 +1,178 @@
+// Just enough of Adafruit_BME280 and Adafruit_BusIO to run BME280Sensor on
+// the host.  Every device reads one fake register file, and FakeBme counts
+// the transactions and bytes that would have crossed the bus.  The stock
+// readTemperature / readPressure / readHumidity make the same bus reads as
+// the library (temperature again before pressure and humidity) but only
+// return the raw adc values.
+#pragma once
+#include <Arduino.h>
+#include <Wire.h>
+#include <SPI.h>
+
+#define BME280_ADDRESS           (0x77)
+#define BME280_ADDRESS_ALTERNATE (0x76)
+#define SPI_BITORDER_MSBFIRST    1
+#define SPI_MODE0                0
+
+struct FakeBme {
+  static inline uint8_t regs[256];
+  static inline unsigned long transactions;
+  static inline unsigned long bytes;       // register addresses and data, both ways
+
+  static void count(size_t len) {
+    transactions++;
+    bytes += len;
+  }
+};
+
+class Adafruit_I2CDevice {
+public:
+  Adafruit_I2CDevice(uint8_t, TwoWire* = &Wire) {}
+  bool begin(bool = true) { return true; }
+  bool write_then_read(const uint8_t* wbuf, size_t wlen, uint8_t* rbuf, size_t rlen, bool = false) {
+    memcpy(rbuf, &FakeBme::regs[wbuf[0]], rlen);
+    FakeBme::count(wlen + rlen);
+    return true;
+  }
+  bool write(const uint8_t* buf, size_t len, bool = true, const uint8_t* = nullptr, size_t = 0) {
+    FakeBme::regs[buf[0]] = buf[1];
+    FakeBme::count(len);
+    return true;
+  }
+};
+
+class Adafruit_SPIDevice {
+public:
+  Adafruit_SPIDevice(int8_t, uint32_t = 1000000, int = SPI_BITORDER_MSBFIRST, int = SPI_MODE0, SPIClass* = &SPI) {}
+  bool begin() { return true; }
+  bool write_then_read(const uint8_t* wbuf, size_t wlen, uint8_t* rbuf, size_t rlen, uint8_t = 0xFF) {
+    memcpy(rbuf, &FakeBme::regs[wbuf[0] & 0x7F], rlen);
+    FakeBme::count(wlen + rlen);
+    return true;
+  }
+  bool write(const uint8_t* buf, size_t len, const uint8_t* = nullptr, size_t = 0) {
+    FakeBme::regs[buf[0] & 0x7F] = buf[1];
+    FakeBme::count(len);
+    return true;
+  }
+};
+
+typedef struct {
+  uint16_t dig_T1; int16_t dig_T2; int16_t dig_T3;
+  uint16_t dig_P1; int16_t dig_P2; int16_t dig_P3; int16_t dig_P4; int16_t dig_P5; int16_t dig_P6; int16_t dig_P7; int16_t dig_P8; int16_t dig_P9;
+  uint8_t dig_H1; int16_t dig_H2; uint8_t dig_H3; int16_t dig_H4; int16_t dig_H5; int8_t dig_H6;
+} bme280_calib_data;
+
+enum {
+  BME280_REGISTER_DIG_T1 = 0x88,
+  BME280_REGISTER_DIG_H1 = 0xA1,
+  BME280_REGISTER_CHIPID = 0xD0,
+  BME280_REGISTER_DIG_H2 = 0xE1,
+  BME280_REGISTER_CONTROLHUMID = 0xF2,
+  BME280_REGISTER_STATUS = 0xF3,
+  BME280_REGISTER_CONTROL = 0xF4,
+  BME280_REGISTER_CONFIG = 0xF5,
+  BME280_REGISTER_PRESSUREDATA = 0xF7,
+  BME280_REGISTER_TEMPDATA = 0xFA,
+  BME280_REGISTER_HUMIDDATA = 0xFD,
+};
+
+class Adafruit_BME280 {
+public:
+  enum sensor_sampling { SAMPLING_NONE = 0, SAMPLING_X1, SAMPLING_X2, SAMPLING_X4, SAMPLING_X8, SAMPLING_X16 };
+  enum sensor_mode { MODE_SLEEP = 0, MODE_FORCED = 1, MODE_NORMAL = 3 };
+  enum sensor_filter { FILTER_OFF = 0, FILTER_X2, FILTER_X4, FILTER_X8, FILTER_X16 };
+  enum standby_duration { STANDBY_MS_0_5 = 0, STANDBY_MS_62_5, STANDBY_MS_125, STANDBY_MS_250, STANDBY_MS_500, STANDBY_MS_1000, STANDBY_MS_10, STANDBY_MS_20 };
+
+  // the library frees whichever bus device it holds
+  ~Adafruit_BME280() {
+    delete i2c_dev;
+    delete spi_dev;
+  }
+
+  bool begin(uint8_t addr = BME280_ADDRESS, TwoWire* theWire = &Wire) {
+    if (!spi_dev) i2c_dev = new Adafruit_I2CDevice(addr, theWire);
+    return init();
+  }
+
+  void setSampling(sensor_mode mode = MODE_NORMAL, sensor_sampling t = SAMPLING_X16, sensor_sampling p = SAMPLING_X16,
+                   sensor_sampling h = SAMPLING_X16, sensor_filter filter = FILTER_OFF, standby_duration duration = STANDBY_MS_0_5) {
+    write8(BME280_REGISTER_CONTROL, MODE_SLEEP);
+    write8(BME280_REGISTER_CONTROLHUMID, h);
+    write8(BME280_REGISTER_CONFIG, (duration << 5) | (filter << 2));
+    write8(BME280_REGISTER_CONTROL, (t << 5) | (p << 2) | mode);
+  }
+
+  float readTemperature() { return read24(BME280_REGISTER_TEMPDATA) >> 4; }
+  float readPressure() { readTemperature(); return read24(BME280_REGISTER_PRESSUREDATA) >> 4; }
+  float readHumidity() { readTemperature(); return read16(BME280_REGISTER_HUMIDDATA); }
+
+protected:
+  uint8_t read8(uint8_t reg) {
+    uint8_t value = 0;
+    read(reg, &value, 1);
+    return value;
+  }
+  uint16_t read16(uint8_t reg) {
+    uint8_t buf[2] = {};
+    read(reg, buf, 2);
+    return buf[0] << 8 | buf[1];
+  }
+  uint32_t read24(uint8_t reg) {
+    uint8_t buf[3] = {};
+    read(reg, buf, 3);
+    return (uint32_t) buf[0] << 16 | buf[1] << 8 | buf[2];
+  }
+  void write8(uint8_t reg, uint8_t value) {
+    uint8_t buf[2] = { reg, value };
+    if (spi_dev) buf[0] &= ~0x80;
+    if (spi_dev) spi_dev->write(buf, 2);
+    else if (i2c_dev) i2c_dev->write(buf, 2);
+  }
+  void read(uint8_t reg, uint8_t* buf, size_t len) {
+    if (spi_dev) reg |= 0x80;
+    if (spi_dev) spi_dev->write_then_read(&reg, 1, buf, len);
+    else if (i2c_dev) i2c_dev->write_then_read(&reg, 1, buf, len);
+  }
+
+  bool init() {
+    if (read8(BME280_REGISTER_CHIPID) != 0x60) return false;
+    readCoefficients();
+    setSampling();
+    return true;
+  }
+
+  // the datasheet 5.4.3 layout, little endian pairs
+  void readCoefficients() {
+    uint8_t t[26] = {}, h[7] = {};
+    read(BME280_REGISTER_DIG_T1, t, sizeof(t));
+    read(BME280_REGISTER_DIG_H2, h, sizeof(h));
+    auto le = [](const uint8_t* p) { return (uint16_t) (p[0] | p[1] << 8); };
+
+    _bme280_calib.dig_T1 = le(&t[0]);
+    _bme280_calib.dig_T2 = le(&t[2]);
+    _bme280_calib.dig_T3 = le(&t[4]);
+    _bme280_calib.dig_P1 = le(&t[6]);
+    _bme280_calib.dig_P2 = le(&t[8]);
+    _bme280_calib.dig_P3 = le(&t[10]);
+    _bme280_calib.dig_P4 = le(&t[12]);
+    _bme280_calib.dig_P5 = le(&t[14]);
+    _bme280_calib.dig_P6 = le(&t[16]);
+    _bme280_calib.dig_P7 = le(&t[18]);
+    _bme280_calib.dig_P8 = le(&t[20]);
+    _bme280_calib.dig_P9 = le(&t[22]);
+    _bme280_calib.dig_H1 = t[25];
+    _bme280_calib.dig_H2 = le(&h[0]);
+    _bme280_calib.dig_H3 = h[2];
+    _bme280_calib.dig_H4 = (int16_t) ((int8_t) h[3] * 16 | (h[4] & 0x0F));
+    _bme280_calib.dig_H5 = (int16_t) ((int8_t) h[5] * 16 | (h[4] >> 4));
+    _bme280_calib.dig_H6 = (int8_t) h[6];
+  }
+
+  int32_t t_fine = 0;
+  int32_t t_fine_adjust = 0;
+  int8_t _cs = -1;
+  Adafruit_I2CDevice* i2c_dev = NULL;
+  Adafruit_SPIDevice* spi_dev = NULL;
+  bme280_calib_data _bme280_calib {};
+};
@@ -0,0 +1,136 @@
+// Just enough of the Arduino core to build TelnetSpy on the host
+#pragma once
+#include <cstdarg>
+#include <cstdint>
+#include <cstddef>
+#include <cstring>
+#include <cstdio>
+#include <cstdlib>
+#include <cmath>
+#include <climits>
+#include <chrono>
+#include <deque>
+#include <memory>
+#include <string>
+#include <vector>
+#include <algorithm>
+
+typedef uint8_t byte;
+typedef bool boolean;
+
+class __FlashStringHelper;
+#define F(x) (reinterpret_cast<const __FlashStringHelper*>(x))
+#define PROGMEM
+#define PSTR(x) (x)
+#define PGM_P const char*
+#define ICACHE_RAM_ATTR
+#define IRAM_ATTR
+#define memcpy_P memcpy
+#define strlen_P strlen
+#define strcpy_P strcpy
+#define snprintf_P snprintf
+#define vsnprintf_P vsnprintf
+#define pgm_read_byte(p) (*(const uint8_t*)(p))
+#define pgm_read_word(p) (*(const uint16_t*)(p))
+#define pgm_read_dword(p) (*(const uint32_t*)(p))
+#define pgm_read_ptr(p) (*(void* const*)(p))
+
+// 32 bits wide like the esp cores, so callers keeping uint32_t timestamps see
+// the same differences; fakeClock freezes millis() at fakeMillis so record
+// timestamps are repeatable
+inline bool fakeClock = false;
+inline unsigned long fakeMillis = 0;
+
+inline unsigned long millis() {
+  if (fakeClock) return fakeMillis;
+  return (uint32_t) std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+inline unsigned long micros() {
+  return (uint32_t) std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+inline void delay(unsigned long) {}
+inline void delayMicroseconds(unsigned int) {}
+inline void yield() {}
+inline bool isDigit(char c) { return c >= '0' && c <= '9'; }
+
+class String {
+  public:
+    std::string s;
+    String() {}
+    String(const char* c) : s(c ? c : "") {}
+    String(const std::string& c) : s(c) {}
+    String(char c) : s(1, c) {}
+    String(int v) : s(std::to_string(v)) {}
+    String(unsigned v) : s(std::to_string(v)) {}
+    String(long v) : s(std::to_string(v)) {}
+    String(unsigned long v) : s(std::to_string(v)) {}
+    String(float v, int d = 2) { char b[32]; snprintf(b, sizeof(b), "%.*f", d, v); s = b; }
+    String(double v, int d = 2) { char b[32]; snprintf(b, sizeof(b), "%.*f", d, v); s = b; }
+    const char* c_str() const { return s.c_str(); }
+    unsigned length() const { return s.size(); }
+    bool reserve(unsigned) { return true; }
+    char operator[](unsigned i) const { return s[i]; }
+    bool operator==(const String& o) const { return s == o.s; }
+    bool operator==(const char* o) const { return s == o; }
+    String& operator+=(const String& o) { s += o.s; return *this; }
+    friend String operator+(const String& a, const String& b) { return a.s + b.s; }
+    friend String operator+(const char* a, const String& b) { return std::string(a) + b.s; }
+};
+
+class Print {
+  public:
+    virtual ~Print() {}
+    virtual size_t write(uint8_t) = 0;
+    virtual size_t write(const uint8_t* b, size_t n) { size_t r = 0; while (n--) r += write(*b++); return r; }
+    size_t write(const char* s) { return write((const uint8_t*) s, strlen(s)); }
+    size_t write(const char* b, size_t n) { return write((const uint8_t*) b, n); }
+    virtual int availableForWrite() { return 0; }
+    virtual void flush() {}
+    size_t print(const String& s) { return write(s.c_str()); }
+    size_t print(const char* s) { return write(s); }
+    size_t print(int v, int = 10) { char b[16]; return write(b, snprintf(b, sizeof(b), "%d", v)); }
+    size_t println(const String& s) { return print(s) + println(); }
+    size_t println(const char* s) { return print(s) + println(); }
+    size_t println() { return write("\r\n"); }
+    size_t printf(const char* f, ...) {
+      char b[256];
+      va_list a;
+      va_start(a, f);
+      int n = vsnprintf(b, sizeof(b), f, a);
+      va_end(a);
+      return write(b, std::min(n, (int) sizeof(b) - 1));
+    }
+};
+
+class Stream : public Print {
+  public:
+    virtual int available() = 0;
+    virtual int read() = 0;
+    virtual int peek() = 0;
+    void setTimeout(unsigned long) {}
+};
+
+enum SerialConfig { SERIAL_8N1 };
+enum SerialMode { SERIAL_FULL };
+
+// swallows everything; tests derive from it to look at or pace the output
+class HardwareSerial : public Stream {
+  public:
+    size_t write(uint8_t) override { return 1; }
+    using Print::write;
+    int available() override { return 0; }
+    int read() override { return -1; }
+    int peek() override { return -1; }
+    int availableForWrite() override { return 128; }
+    void begin(unsigned long, SerialConfig = SERIAL_8N1, SerialMode = SERIAL_FULL, uint8_t = 1) {}
+    void end() {}
+    void swap(uint8_t) {}
+    void set_tx(uint8_t) {}
+    void pins(uint8_t, uint8_t) {}
+    bool isTxEnabled() { return true; }
+    bool isRxEnabled() { return true; }
+    uint32_t baudRate() { return 115200; }
+    operator bool() const { return true; }
+};
+
+extern HardwareSerial Serial;
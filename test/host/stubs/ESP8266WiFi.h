@@ -0,0 +1,103 @@
+// Fake network for TelnetSpy on the host.  A test dials by queueing a Conn on
+// FakeNet::pending; the server accepts it on the next handle().  The test
+// reads what TelnetSpy sent from out, feeds input through in and throttles
+// the connection with window (send room) and cap (bytes taken per write).
+#pragma once
+#include "Arduino.h"
+
+class IPAddress {
+  public:
+    IPAddress() {}
+    IPAddress(uint32_t) {}
+    String toString() const { return String(); }
+};
+
+struct Conn {
+  bool        up     = true;
+  size_t      window = (size_t) 1 << 30;
+  size_t      cap    = (size_t) 1 << 30;
+  size_t      taken  = 0;          // total bytes written, out may be cleared meanwhile
+  std::string out;
+  std::string in;
+  size_t      inPos  = 0;
+};
+
+struct FakeNet {
+  static inline std::deque<std::shared_ptr<Conn>> pending;
+  static inline unsigned long calls = 0;   // receive side calls into the client
+};
+
+class WiFiClient : public Stream {
+  public:
+    WiFiClient() {}
+    WiFiClient(const std::shared_ptr<Conn>& c) : conn(c) {}
+    size_t write(uint8_t c) override { return write(&c, 1); }
+    size_t write(const uint8_t* b, size_t n) override {
+      if (!connected()) return 0;
+      const size_t k = std::min(n, conn->cap);
+      conn->out.append((const char*) b, k);
+      conn->taken += k;
+      conn->window -= std::min(conn->window, k);
+      return k;
+    }
+    using Print::write;
+    int available() override { FakeNet::calls++; return connected() ? conn->in.size() - conn->inPos : 0; }
+    int read() override { FakeNet::calls++; return connected() && conn->inPos < conn->in.size() ? (uint8_t) conn->in[conn->inPos++] : -1; }
+    int peek() override { FakeNet::calls++; return connected() && conn->inPos < conn->in.size() ? (uint8_t) conn->in[conn->inPos] : -1; }
+    int read(uint8_t* b, size_t n) {
+      FakeNet::calls++;
+      if (!connected()) return 0;
+      n = std::min(n, conn->in.size() - conn->inPos);
+      memcpy(b, conn->in.data() + conn->inPos, n);
+      conn->inPos += n;
+      return n;
+    }
+    int availableForWrite() override { return connected() ? std::min(conn->window, (size_t) INT_MAX) : 0; }
+    bool connected() { return conn && conn->up; }
+    void stop() { if (conn) conn->up = false; }
+    void flush() override {}
+    void setNoDelay(bool) {}
+    operator bool() { return connected(); }
+  private:
+    std::shared_ptr<Conn> conn;
+};
+
+class WiFiServer {
+  public:
+    WiFiServer(uint16_t) {}
+    void begin() {}
+    void close() {}
+    void setNoDelay(bool) {}
+    bool hasClient() { return !FakeNet::pending.empty(); }
+    WiFiClient accept() {
+      if (FakeNet::pending.empty()) return WiFiClient();
+      WiFiClient c(FakeNet::pending.front());
+      FakeNet::pending.pop_front();
+      return c;
+    }
+};
+
+enum WiFiMode_t { WIFI_OFF, WIFI_STA, WIFI_AP, WIFI_AP_STA };
+#define NULL_MODE      WIFI_OFF
+#define STATION_MODE   WIFI_STA
+#define SOFTAP_MODE    WIFI_AP
+#define STATIONAP_MODE WIFI_AP_STA
+enum { WL_CONNECTED = 3 };
+
+class WiFiClass {
+  public:
+    WiFiMode_t getMode() { return WIFI_STA; }
+    int status() { return WL_CONNECTED; }
+};
+
+class EspClass {
+  public:
+    void restart() {}
+};
+
+extern WiFiClass WiFi;
+extern EspClass ESP;
+
+extern "C" void ets_putc(char);
+extern "C" void ets_install_putc1(void (*)(char));
+extern "C" void system_set_os_print(uint8_t);
@@ -0,0 +1,10 @@
+// SPIClass for the BME280 fakes -- the bus itself lives in Adafruit_BME280.h
+#pragma once
+#include <Arduino.h>
+
+class SPIClass {
+public:
+  void begin() {}
+};
+
+extern SPIClass SPI;
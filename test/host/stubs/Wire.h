@@ -0,0 +1,13 @@
+// TwoWire for the BME280 fakes -- the bus itself lives in Adafruit_BME280.h
+#pragma once
+#include <Arduino.h>
+
+class TwoWire {
+public:
+  void begin() {}
+  void begin(int, int) {}
+  void setClock(uint32_t hz) { clock = hz; }
+  uint32_t clock = 100000;
+};
+
+extern TwoWire Wire;
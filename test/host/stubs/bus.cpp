@@ -0,0 +1,6 @@
+// the bus globals the BME280 fakes need
+#include <Wire.h>
+#include <SPI.h>
+
+TwoWire Wire;
+SPIClass SPI;
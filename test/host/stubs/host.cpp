@@ -0,0 +1,11 @@
+// Globals the core would provide; every host test links this
+#include "Arduino.h"
+#include "ESP8266WiFi.h"
+
+HardwareSerial Serial;
+WiFiClass WiFi;
+EspClass ESP;
+
+extern "C" void ets_putc(char) {}
+extern "C" void ets_install_putc1(void (*)(char)) {}
+extern "C" void system_set_os_print(uint8_t) {}
@@ -0,0 +1 @@
+// os_print hooks are declared in ESP8266WiFi.h
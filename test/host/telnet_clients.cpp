@@ -0,0 +1,97 @@
+// Several TelnetSpy clients on one ring: the slots fill up and free again,
+// a stalled reader gets a drop marker and the newest lines while the others
+// get everything, and per-client throughput with 1 to 3 readers.
+#include <cassert>
+#include "TelnetSpy.h"
+
+static std::shared_ptr<Conn> dial() {
+  auto c = std::make_shared<Conn>();
+  FakeNet::pending.push_back(c);
+  return c;
+}
+
+static void checkClients(TelnetSpy& t) {
+  auto a = dial(), b = dial(), slow = dial(), extra = dial();
+  for (int i = 0; i < 4; i++) t.handle();
+  assert(t.getClientCount() == 3 && extra->out.find("No more connections") != std::string::npos && !extra->up);
+
+  slow->window = 0;
+  std::string expect;
+  for (int i = 0; i < 400; i++) {
+    char l[40];
+    int n = snprintf(l, sizeof(l), "line %04d abcdefghijklmnop\n", i);
+    t.write((const uint8_t*) l, n);
+    expect.append(l, n);
+    t.handle();
+  }
+  for (int i = 0; i < 5; i++) t.handle();
+  t.flush();
+  assert(a->out == expect && b->out == expect);
+
+  // the stalled reader resumes at the tail, behind a marker, with whole lines
+  slow->window = 1 << 30;
+  t.handle();
+  t.flush();
+  assert(slow->out.find("bytes dropped]") != std::string::npos && slow->out.size() < 1200);
+  std::string tail = slow->out.substr(slow->out.find("]\r\n") + 3);
+  assert(expect.compare(expect.size() - tail.size(), tail.size(), tail) == 0);
+
+  // a disconnect frees the slot
+  b->up = false;
+  t.handle();
+  assert(t.getClientCount() == 2);
+  auto late = dial();
+  t.handle();
+  assert(t.getClientCount() == 3);
+  t.setMaxClients(1);
+  assert(t.getClientCount() == 1 && t.getMaxClients() == 1);
+  t.setMaxClients(3);
+
+  // AO only drops the client that sent it
+  late = dial();
+  t.handle();
+  late->in = std::string("\xff\xf5", 2);
+  t.handle();
+  assert(!late->up && t.getClientCount() == 1);
+}
+
+// writer pushes 64 byte lines and calls handle() every 8 lines
+static void benchClients(TelnetSpy& t) {
+  const char line[] = "2023-10-27 20:51:00 [sensor] t=21.35 h=48.2 p=1013.25 rssi=-61\n";
+  const int lines = 400000;
+
+  for (int n = 1; n <= 3; n++) {
+    t.disconnectClient();
+    t.setBufferSize(2048);
+    std::vector<std::shared_ptr<Conn>> cs;
+    for (int i = 0; i < n; i++) cs.push_back(dial());
+    for (int i = 0; i < n; i++) t.handle();
+
+    auto t0 = std::chrono::steady_clock::now();
+    for (int i = 0; i < lines; i++) {
+      t.write((const uint8_t*) line, sizeof(line) - 1);
+      if ((i & 7) == 0) t.handle();
+      for (auto& c : cs) if (c->out.size() > 1 << 20) c->out.clear();
+    }
+    t.flush();
+    double s = std::chrono::duration<double>(std::chrono::steady_clock::now() - t0).count();
+
+    printf("%d client(s):", n);
+    for (auto& c : cs) printf(" %.0f MB/s", c->taken / s / 1e6);
+    printf(", %u bytes dropped\n", (unsigned) t.getDroppedBytes());
+  }
+}
+
+int main() {
+  TelnetSpy t;
+  t.setSerial(NULL);
+  t.setWelcomeMsg("");
+  t.setPingTime(0);
+  t.begin(115200);
+  t.setBufferSize(1024);
+  t.handle();
+
+  checkClients(t);
+  printf("telnet_clients: ok\n");
+  benchClients(t);
+}
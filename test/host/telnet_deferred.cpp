@@ -0,0 +1,245 @@
+// TelnetSpy deferred records: printDeferred() lines must read back exactly
+// as snprintf formats them, online and offline, for the app's own formats
+// and thousands of random ones.  Then the cost per call and the backlog
+// bytes per line against printing the text.
+#include <cassert>
+#include <random>
+#include "TelnetSpy.h"
+
+// a NULL %s argument is checked on purpose; glibc prints "(null)" like the esp cores
+#pragma GCC diagnostic ignored "-Wformat-overflow"
+#pragma GCC diagnostic ignored "-Wformat-truncation"
+
+struct Spy : TelnetSpy {
+  using TelnetSpy::telnetUsed;
+};
+
+static std::shared_ptr<Conn> dial() {
+  auto c = std::make_shared<Conn>();
+  FakeNet::pending.push_back(c);
+  return c;
+}
+
+static void start(Spy& t) {
+  t.setSerial(NULL);
+  t.setWelcomeMsg("");
+  t.setPingTime(0);
+  t.begin(115200);
+  t.setRecordMode(true);
+}
+
+static int checks = 0, fails = 0;
+
+// the text a client gets for one deferred line, against what snprintf makes of it
+template <typename... A> static void check(bool offline, const char* fmt, A... args) {
+  Spy t;
+  start(t);
+  std::shared_ptr<Conn> c;
+  if (!offline) {
+    c = dial();
+    t.handle();
+  }
+  t.printDeferred(fmt, args...);
+  if (offline) {
+    c = dial();
+    t.handle();
+  }
+  t.flush();
+  t.handle();
+
+  char want[512];
+  int n = snprintf(want, sizeof(want), fmt, args...);
+  std::string w(want, std::max(0, std::min(n, TELNETSPY_DEFERRED_TEXT_LEN)));
+  while (!w.empty() && (w.back() == '\n' || w.back() == '\r')) w.pop_back();
+  std::string expect;
+  for (char ch : w) {
+    if (ch == '\n') expect += '\r';
+    expect += ch;
+  }
+
+  std::string got = c->out;
+  size_t p = got.find("] I ");
+  got = p == std::string::npos ? got : got.substr(p + 4);
+  if (got.size() >= 2) got.resize(got.size() - 2);
+
+  checks++;
+  if (got != expect && !(fmt[0] && w.size() >= TELNETSPY_DEFERRED_TEXT_LEN)) {
+    fails++;
+    printf("MISMATCH [%s]\n got [%s]\nwant [%s]\n", fmt, got.c_str(), expect.c_str());
+  }
+}
+
+static void checkFormats() {
+  for (int off = 0; off < 2; off++) {
+    check(off, "Gathered Sample #%u\n", 123u);
+    check(off, "Sea Level hPa = %.2f\n", 1013.25f);
+    check(off, "Sea Level hPa = %.2f\n", 1013.2512345678);
+    check(off, "Sampled %d sensor(s) in %lu us\n", 2, 4000000000UL);
+    check(off, "Forced conversion read after %lu us (budget %lu us)%s\n", 9000UL, 11500UL, " - timed out");
+    check(off, "BME280 @ 0x%02X (%s bus time %lu us)\n", 0x76, "i2c", 123UL);
+    check(off, "%-8s|%8s|%.3s|%s", "ab", "cd", "efghij", (const char*) NULL);
+    check(off, "%*d|%-*.*f|%%|%c|%5.1e|%g", 6, -42, 10, 3, 2.5, 'Z', 12345.678, 1e-9);
+    check(off, "%lld %llu %zu %hd %hhu %ld %lx %p", -1234567890123LL, 18446744073709551615ULL, (size_t) 77, 70000, 300, -5L, 0xdeadbeefUL, (void*) 0x1234);
+    check(off, "\nSea Level Pressure: [%.2f]\n\n", 1009.5);
+    check(off, "no args");
+    check(off, "%d %d %d %d %d %d %d %d %d %d %d %d %d %d %d %d %d %d %d %d %d %d %d %d %d %d %d %d %d %d",
+          1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15, 16, 17, 18, 19, 20, 21, 22, 23, 24, 25, 26, 27, 28, 29, INT32_MIN);
+  }
+
+  static const char* F[] = { "%d:%s:%.2f\n", "x=%ld y=%u %s", "%08.3f %x %c", "%s %s", "%lu %lld %g" };
+  std::mt19937 r(7);
+  for (int i = 0; i < 3000; i++) {
+    std::string s(r() % 40, 'a' + r() % 26);
+    switch (r() % 5) {
+      case 0: check(false, F[0], (int) r(), s.c_str(), (double) (int) r() / 7); break;
+      case 1: check(false, F[1], (long) (int) r(), (unsigned) r(), s.c_str()); break;
+      case 2: check(false, F[2], (float) (int) r() / 3, (unsigned) r(), 'a' + (int) (r() % 26)); break;
+      case 3: check(false, F[3], s.c_str(), s.c_str()); break;
+      case 4: check(false, F[4], (unsigned long) r(), (long long) r() * (long long) (r() >> 2), (double) r() / 3); break;
+    }
+  }
+
+  // arguments beyond the record's room end the line there
+  {
+    Spy t;
+    start(t);
+    auto c = dial();
+    t.handle();
+    t.printDeferred("%s|%s|%s|%d", std::string(60, 'a').c_str(), std::string(60, 'b').c_str(), std::string(60, 'c').c_str(), 5);
+    t.flush();
+    t.handle();
+    assert(c->out.find(std::string(60, 'a') + "|" + std::string(40, 'b')) != std::string::npos && c->out.find("|c") == std::string::npos);
+  }
+
+  // a text line written before it ends there, and the tag applies to both
+  {
+    static const char* const N[] = { "sys", "sensor" };
+    Spy t;
+    start(t);
+    t.setSubsystemNames(N, 2);
+    auto c = dial();
+    t.handle();
+    t.print("partial ");
+    t.setRecordTag(TELNETSPY_LEVEL_WARN, 1);
+    t.printDeferred("deferred %d\n", 5);
+    t.println("after");
+    t.flush();
+    t.handle();
+    assert(c->out.find("W sensor: partial \r\n") != std::string::npos && c->out.find("W sensor: deferred 5\r\n") != std::string::npos);
+    assert(c->out.find("I sys: after\r\n") != std::string::npos);
+
+    // replay of deferred records works like text ones
+    c->out.clear();
+    c->in += "~w\r\n";
+    t.handle();
+    t.flush();
+    assert(c->out.find("W sensor: deferred 5") != std::string::npos && c->out.find("after") == std::string::npos);
+  }
+}
+
+struct Case {
+  const char* name;
+  void (*text)(Spy&, int);
+  void (*deferred)(Spy&, int);
+};
+
+static const Case CASES[] = {
+  { "Gathered Sample #n",
+    [](Spy& t, int i) { t.println("Gathered Sample #" + String(i)); },
+    [](Spy& t, int i) { t.printDeferred(PSTR("Gathered Sample #%u\n"), i); } },
+  { "Sea Level hPa = x",
+    [](Spy& t, int i) { t.println("Sea Level hPa = " + String(1013.25f + i % 7)); },
+    [](Spy& t, int i) { t.printDeferred(PSTR("Sea Level hPa = %.2f\n"), 1013.25f + i % 7); } },
+  { "Sampled %d in %lu us",
+    [](Spy& t, int i) { t.printf("Sampled %d sensor(s) in %lu us\n", 1, (unsigned long) (1200 + i % 300)); },
+    [](Spy& t, int i) { t.printDeferred(PSTR("Sampled %d sensor(s) in %lu us\n"), 1, (unsigned long) (1200 + i % 300)); } },
+  { "Forced read (3 args)",
+    [](Spy& t, int i) { t.printf("Forced conversion read after %lu us (budget %lu us)%s\n", (unsigned long) (9000 + i % 500), 11500UL, ""); },
+    [](Spy& t, int i) { t.printDeferred(PSTR("Forced conversion read after %lu us (budget %lu us)%s\n"), (unsigned long) (9000 + i % 500), 11500UL, ""); } },
+};
+
+// nobody connected, no serial: the cost of the call and what it leaves in the backlog
+static void benchWriters() {
+  using clk = std::chrono::steady_clock;
+  const int N = 200000;
+
+  printf("%-22s %10s %12s %8s %11s\n", "line", "text ns", "deferred ns", "text B", "deferred B");
+  for (const Case& cs : CASES) {
+    double ns[2], bytes[2];
+    for (int d = 0; d < 2; d++) {
+      Spy t;
+      t.setSerial(NULL);
+      t.setBufferSize(16384);
+      t.begin(115200);
+      t.setRecordMode(true);
+      fakeClock = true;
+      fakeMillis = 0;
+
+      double best = 1e18;
+      for (int rep = 0; rep < 5; rep++) {
+        auto t0 = clk::now();
+        for (int i = 0; i < N; i++) {
+          fakeMillis += 500;
+          (d ? cs.deferred : cs.text)(t, i);
+        }
+        best = std::min(best, std::chrono::duration<double, std::nano>(clk::now() - t0).count() / N);
+      }
+
+      t.clearBuffer();
+      uint16_t before = t.telnetUsed();
+      for (int i = 0; i < 100; i++) {
+        fakeMillis += 500;
+        (d ? cs.deferred : cs.text)(t, i + 1000);
+      }
+      ns[d] = best;
+      bytes[d] = (t.telnetUsed() - before) / 100.0;
+    }
+    printf("%-22s %10.0f %12.0f %8.1f %11.1f\n", cs.name, ns[0], ns[1], bytes[0], bytes[1]);
+  }
+}
+
+// the formatting moves to the reader: one line written and sent to a client
+static void benchReader() {
+  using clk = std::chrono::steady_clock;
+  Spy t;
+  t.setSerial(NULL);
+  t.setBufferSize(16384);
+  t.setWelcomeMsg("");
+  t.setPingTime(0);
+  t.begin(115200);
+  t.setRecordMode(true);
+
+  for (int d = 0; d < 2; d++) {
+    auto c = dial();
+    t.handle();
+    auto t0 = clk::now();
+    long lines = 0;
+    for (int k = 0; k < 2000; k++) {
+      for (int i = 0; i < 100; i++) {
+        fakeMillis += 500;
+        if (d) {
+          t.printDeferred(PSTR("Sampled %d sensor(s) in %lu us\n"), 1, (unsigned long) i);
+        } else {
+          t.printf("Sampled %d sensor(s) in %lu us\n", 1, (unsigned long) i);
+        }
+      }
+      t.handle();
+      lines += 100;
+      c->out.clear();
+    }
+    printf("%s: %.0f ns per line written and sent to one client\n", d ? "deferred" : "text    ",
+           std::chrono::duration<double, std::nano>(clk::now() - t0).count() / lines);
+    t.disconnectClient();
+    t.handle();
+  }
+  fakeClock = false;
+}
+
+int main() {
+  setvbuf(stdout, NULL, _IONBF, 0);
+  checkFormats();
+  printf("telnet_deferred: %d formats, %d mismatches\n", checks, fails);
+  assert(fails == 0);
+  benchWriters();
+  benchReader();
+}
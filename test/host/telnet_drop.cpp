@@ -0,0 +1,46 @@
+// TelnetSpy overflow: whole lines are dropped from the head, every dropped
+// byte and line is counted, and the next client is told where the gap is.
+#include <cassert>
+#include "TelnetSpy.h"
+
+struct Spy : TelnetSpy {
+  std::string contents() {
+    std::string r;
+    for (uint32_t i = bufTail; i != bufHead; i++) r += telnetBuf[i & bufMask];
+    return r;
+  }
+};
+
+int main() {
+  Spy t;
+  t.setSerial(NULL);
+  t.setWelcomeMsg("");
+  t.setPingTime(0);
+  t.begin(115200);
+  t.setBufferSize(64);
+
+  const char* line = "0123456789abcdefghi\r\n";   // 21 bytes
+  for (int i = 0; i < 3; i++) t.write((const uint8_t*) line, 21);
+  assert(t.getDroppedLines() == 0);
+
+  // one more line only fits once the oldest is gone
+  t.write((const uint8_t*) line, 21);
+  assert(t.getDroppedBytes() == 21 && t.getDroppedLines() == 1 && t.contents().size() == 63);
+
+  // more short lines than the line index holds
+  for (int i = 0; i < 1000; i++) t.write((const uint8_t*) "a\n", 2);
+  std::string d = t.contents();
+  assert(d.size() <= 64 && d.compare(0, 2, "a\n") == 0);
+  assert(t.getDroppedBytes() + d.size() == 63 + 21 + 2000);
+
+  // the first client gets the count ahead of what is left
+  auto c = std::make_shared<Conn>();
+  FakeNet::pending.push_back(c);
+  t.handle();
+  t.flush();
+  char marker[48];
+  snprintf(marker, sizeof(marker), TELNETSPY_DROP_MARKER, (unsigned long) t.getDroppedBytes());
+  assert(c->out == marker + d);
+
+  printf("telnet_drop: %u bytes in %u lines dropped, %zu kept, ok\n", (unsigned) t.getDroppedBytes(), (unsigned) t.getDroppedLines(), d.size());
+}
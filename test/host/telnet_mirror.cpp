@@ -0,0 +1,229 @@
+// TelnetSpy serial mirror against a simulated UART at 1.5 Mbaud with a
+// 128 byte FIFO: async output arrives in order and whole, never offers the
+// FIFO more than it takes, loses only the oldest lines when the port is
+// stuck, and costs the loop far less than writing synchronously.
+#include <cassert>
+#include "TelnetSpy.h"
+
+static std::shared_ptr<Conn> dial() {
+  auto c = std::make_shared<Conn>();
+  FakeNet::pending.push_back(c);
+  return c;
+}
+
+// write() waits for FIFO room like the ESP8266 core; a manual port only
+// drains when the test says so, and counts what would have blocked
+struct Uart : HardwareSerial {
+  std::string out;
+  double fifo = 0;
+  bool manual = false;
+  size_t overrun = 0;
+  std::chrono::steady_clock::time_point last = std::chrono::steady_clock::now();
+
+  void tick() {
+    auto now = std::chrono::steady_clock::now();
+    if (!manual) fifo = std::max(0.0, fifo - std::chrono::duration<double, std::micro>(now - last).count() * 0.15);
+    last = now;
+  }
+  void drain(size_t n) { fifo = std::max(0.0, fifo - n); }
+  int availableForWrite() override { tick(); return 128 - (int) std::ceil(fifo); }
+  size_t write(uint8_t b) override { return write(&b, 1); }
+  size_t write(const uint8_t* b, size_t n) override {
+    for (size_t i = 0; i < n; i++) {
+      while (availableForWrite() <= 0) {
+        if (manual) {
+          overrun++;
+          drain(1);
+        }
+      }
+      fifo += 1;
+      out += (char) b[i];
+    }
+    return n;
+  }
+  using Print::write;
+};
+
+static void start(TelnetSpy& t, Uart& u) {
+  t.setSerial(&u);
+  t.setWelcomeMsg("");
+  t.setPingTime(0);
+  t.begin(115200);
+}
+
+static void checkMirror() {
+  // async alone: in order, complete, and never more than the FIFO takes
+  {
+    Uart u;
+    u.manual = true;
+    TelnetSpy t;
+    start(t, u);
+    t.setSerialMirror(TELNETSPY_MIRROR_ASYNC);
+    std::string want;
+    for (int i = 0; i < 200; i++) {
+      char b[64];
+      int n = snprintf(b, sizeof(b), "line %03d of the async mirror test\r\n", i);
+      t.write((const uint8_t*) b, n);
+      want.append(b, n);
+      if (i % 3 == 0) u.drain(100);
+      t.handle();
+    }
+    assert(t.getSerialBacklog() > 0);
+    for (int i = 0; i < 200 && t.getSerialBacklog() > 0; i++) {
+      u.drain(128);
+      t.handle();
+    }
+    assert(u.overrun == 0 && t.getSerialBacklog() == 0 && u.out.find("line 199") != std::string::npos);
+
+    // what arrived is the tail of what was written, behind one drop notice at most
+    size_t m = u.out.find("bytes dropped]");
+    std::string tail = m == std::string::npos ? u.out : u.out.substr(u.out.find("\r\n", m) + 2);
+    assert(want.size() >= tail.size() && want.compare(want.size() - tail.size(), tail.size(), tail) == 0);
+  }
+
+  // async with a telnet client: both get everything
+  {
+    Uart u;
+    u.manual = true;
+    TelnetSpy t;
+    t.setMinBlockSize(1);
+    t.setCollectingTime(0);
+    start(t, u);
+    t.setSerialMirror(TELNETSPY_MIRROR_ASYNC);
+    auto c = dial();
+    t.handle();
+    std::string want;
+    for (int i = 0; i < 40; i++) {
+      char b[64];
+      int n = snprintf(b, sizeof(b), "both %03d\r\n", i);
+      t.write((const uint8_t*) b, n);
+      want.append(b, n);
+      u.drain(16);
+      t.handle();
+    }
+    while (t.getSerialBacklog() > 0) {
+      u.drain(128);
+      t.handle();
+    }
+    t.handle();
+    assert(u.out == want && c->out == want);
+
+    // off: nothing reaches the port, telnet still does
+    t.setSerialMirror(TELNETSPY_MIRROR_OFF);
+    u.out.clear();
+    c->out.clear();
+    t.println("quiet");
+    t.handle();
+    t.handle();
+    assert(u.out.empty() && c->out == "quiet\r\n");
+
+    t.setSerialMirror(TELNETSPY_MIRROR_SYNC);
+    t.println("loud");
+    assert(u.out == "loud\r\n");
+  }
+
+  // record mode: the port gets rendered records, deferred lines formatted late
+  {
+    static const char* const N[] = { "sys", "sensor" };
+    Uart u;
+    u.manual = true;
+    TelnetSpy t;
+    start(t, u);
+    t.setRecordMode(true);
+    t.setSerialMirror(TELNETSPY_MIRROR_ASYNC);
+    t.setSubsystemNames(N, 2);
+    t.setRecordTag(TELNETSPY_LEVEL_WARN, 1);
+    t.printDeferred("deferred %d and a long tail %s\n", 7, std::string(130, 'x').c_str());
+    t.println("text line");
+    assert(u.out.size() <= 128);
+    while (t.getSerialBacklog() > 0) {
+      u.drain(128);
+      t.handle();
+    }
+    assert(u.out.find("W sensor: deferred 7 and a long tail xxx") != std::string::npos && u.out.find("xxx\r\n[") != std::string::npos);
+    assert(u.out.find("I sys: text line\r\n") != std::string::npos);
+
+    // records stay as history for a client connecting later
+    auto c = dial();
+    t.handle();
+    t.flush();
+    assert(c->out.find("deferred 7") != std::string::npos);
+  }
+
+  // a stuck port falls behind and loses the oldest lines; telnet does not notice
+  {
+    Uart u;
+    u.manual = true;
+    TelnetSpy t;
+    t.setMinBlockSize(1);
+    t.setCollectingTime(0);
+    start(t, u);
+    t.setBufferSize(1024);
+    t.setSerialMirror(TELNETSPY_MIRROR_ASYNC);
+    auto c = dial();
+    t.handle();
+    u.fifo = 128;
+    for (int i = 0; i < 300; i++) {
+      char b[64];
+      int n = snprintf(b, sizeof(b), "stuck %03d\r\n", i);
+      t.write((const uint8_t*) b, n);
+      t.handle();
+    }
+    assert(c->out.find("stuck 299") != std::string::npos && c->out.find("dropped") == std::string::npos);
+    while (t.getSerialBacklog() > 0) {
+      u.drain(128);
+      t.handle();
+    }
+    assert(u.out.find("bytes dropped]") != std::string::npos && u.out.find("stuck 299\r\n") != std::string::npos && u.out.find("stuck 000") == std::string::npos);
+  }
+
+  // flush() writes the backlog out
+  {
+    Uart u;
+    TelnetSpy t;
+    t.setSerial(&u);
+    t.begin(115200);
+    t.setSerialMirror(TELNETSPY_MIRROR_ASYNC);
+    for (int i = 0; i < 50; i++) t.println("flushed line with some text");
+    t.flush();
+    assert(t.getSerialBacklog() == 0 && u.out.size() == 50 * 29);
+  }
+}
+
+// a burst of 20 log lines per 10 ms loop, with the UART really draining
+static void benchLoop() {
+  for (int mode = TELNETSPY_MIRROR_SYNC; mode <= TELNETSPY_MIRROR_ASYNC; mode++) {
+    Uart u;
+    TelnetSpy t;
+    t.setSerial(&u);
+    t.setBufferSize(8192);
+    t.begin(115200);
+    t.setRecordMode(true);
+    t.setSerialMirror(mode);
+
+    double worst = 0, total = 0;
+    const int bursts = 50;
+    for (int k = 0; k < bursts; k++) {
+      auto t0 = std::chrono::steady_clock::now();
+      for (int i = 0; i < 20; i++) t.printDeferred("Sampled %d sensor(s) in %lu us, burst %d line %d\n", 1, 1234UL + i, k, i);
+      t.handle();
+      double us = std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - t0).count();
+      worst = std::max(worst, us);
+      total += us;
+
+      // the rest of the loop iteration
+      auto until = std::chrono::steady_clock::now() + std::chrono::milliseconds(10);
+      while (std::chrono::steady_clock::now() < until) t.handle();
+    }
+    t.flush();
+    printf("%s: 20 lines cost %.0f us on average, %.0f us worst, serial stalled %lu us, %zu bytes out\n",
+           mode == TELNETSPY_MIRROR_SYNC ? "sync " : "async", total / bursts, worst, (unsigned long) t.getSerialStallMicros(), u.out.size());
+  }
+}
+
+int main() {
+  setvbuf(stdout, NULL, _IONBF, 0);
+  checkMirror();
+  printf("telnet_mirror: async, off, sync, records, stuck port and flush ok\n");
+  benchLoop();
+}
@@ -0,0 +1,153 @@
+// TelnetSpy receive path: random streams dense in IAC, commands, options,
+// subnegotiations and the filter character must give the same data and
+// the same callbacks at the same stream positions however they are split
+// across reads.  Then a PuTTY style session is timed through the parser.
+//
+//   telnet_nvt [seeds]     fuzz that many seeds (default 1500)
+#include <cassert>
+#include <random>
+#include "TelnetSpy.h"
+
+struct Spy : TelnetSpy {
+  uint16_t used() { return recUsed; }
+  void parse() { checkReceive(sessions[0]); }
+  void reset() { recUsed = recRdIdx = recWrIdx = 0; }
+};
+
+static Spy* spy;
+static size_t total;
+static std::string events, data;
+
+static void drain() {
+  int c;
+  while ((c = spy->read()) != -1) {
+    data += (char) c;
+    total++;
+  }
+}
+
+// callbacks must not re-enter read(), so they log their position in the stream
+static void at() { char b[16]; snprintf(b, sizeof(b), "@%zu", total + spy->used()); events += b; }
+static void ev(const char* n) { events += "<"; events += n; at(); events += ">"; }
+static void brk() { ev("BRK"); }
+static void ip() { ev("IP"); }
+static void ao() { ev("AO"); }
+static void ayt() { ev("AYT"); }
+static void ec() { ev("EC"); }
+static void el() { ev("EL"); }
+static void ga() { ev("GA"); }
+static void flt() { ev("FLT"); }
+static void wwdd(char c, char o) { char b[16]; snprintf(b, sizeof(b), "<%u:%u", (uint8_t) c, (uint8_t) o); events += b; at(); events += ">"; }
+
+// splits: 0 feeds the stream in one read, otherwise in random 1-20 byte reads
+static std::string run(const std::string& in, unsigned splits) {
+  Spy t;
+  spy = &t;
+  total = 0;
+  t.setSerial(NULL);
+  t.setWelcomeMsg("");
+  t.setPingTime(0);
+  t.setRecBufferSize(60000);
+  t.begin(115200);
+  t.setCallbackOnNvtBRK(brk);
+  t.setCallbackOnNvtIP(ip);
+  t.setCallbackOnNvtAO(ao);
+  t.setCallbackOnNvtAYT(ayt);
+  t.setCallbackOnNvtEC(ec);
+  t.setCallbackOnNvtEL(el);
+  t.setCallbackOnNvtGA(ga);
+  t.setCallbackOnNvtWWDD(wwdd);
+  t.setFilter('\x07', "", flt);
+  events.clear();
+  data.clear();
+  t.handle();
+
+  auto c = std::make_shared<Conn>();
+  FakeNet::pending.push_back(c);
+  t.handle();
+
+  std::mt19937 r(splits);
+  for (size_t pos = 0; pos < in.size(); ) {
+    size_t n = splits ? 1 + r() % 20 : in.size();
+    n = std::min(n, in.size() - pos);
+    c->in.append(in, pos, n);
+    pos += n;
+    t.handle();
+    drain();
+  }
+  t.handle();
+  drain();
+  t.disconnectClient();
+  return data + "|" + events;
+}
+
+static std::string randomStream(unsigned seed) {
+  static const unsigned char special[] = { 255, 240, 241, 242, 243, 245, 246, 247, 248, 249, 250, 251, 252, 253, 254, 7, 'a', '\r', '\n', 0 };
+  std::mt19937 r(seed);
+  std::string in;
+  int len = r() % 400;
+  for (int i = 0; i < len; i++) in += (char) ((r() % 3) ? special[r() % sizeof(special)] : (unsigned char) r());
+  return in;
+}
+
+// option negotiation, then command lines and IAC NOP
+static std::string putty(std::string* text) {
+  const unsigned char neg[] = { 255,251,31, 255,251,32, 255,251,24, 255,251,39, 255,253,1, 255,251,3, 255,253,3 };
+  std::string s((const char*) neg, sizeof(neg));
+  for (int i = 0; i < 20; i++) {
+    s += "status\r\nt 21.5\r\nhelp me please\r\n";
+    s += std::string("\xff\xf1", 2);
+    s += "P\r\n";
+    if (text) *text += "status\r\nt 21.5\r\nhelp me please\r\nP\r\n";
+  }
+  return s;
+}
+
+int main(int argc, char** argv) {
+  setvbuf(stdout, NULL, _IONBF, 0);
+  const unsigned seeds = argc > 1 ? atoi(argv[1]) : 1500;
+
+  for (unsigned seed = 1; seed <= seeds; seed++) {
+    const std::string in = randomStream(seed);
+    const std::string whole = run(in, 0), split = run(in, seed);
+    if (whole != split) {
+      size_t k = 0;
+      while (k < whole.size() && k < split.size() && whole[k] == split[k]) k++;
+      printf("seed %u differs at %zu\nwhole: %s\nsplit: %s\n", seed, k,
+             whole.substr(k > 20 ? k - 20 : 0, 80).c_str(), split.substr(k > 20 ? k - 20 : 0, 80).c_str());
+      return 1;
+    }
+  }
+  printf("telnet_nvt: %u random streams parse the same whole and split\n", seeds);
+
+  std::string text;
+  const std::string session = putty(&text);
+  assert(run(session, 0) == text + "|<251:31@0><251:32@0><251:24@0><251:39@0><253:1@0><251:3@0><253:3@0>");
+  assert(run(session, 7) == run(session, 0));
+
+  // the parser alone, over a long session
+  std::string big;
+  while (big.size() < 50000) big += session;
+  Spy t;
+  t.setSerial(NULL);
+  t.setWelcomeMsg("");
+  t.setPingTime(0);
+  t.setRecBufferSize(65000);
+  t.begin(115200);
+  t.handle();
+  auto c = std::make_shared<Conn>();
+  FakeNet::pending.push_back(c);
+  t.handle();
+
+  const int reps = 2000;
+  FakeNet::calls = 0;
+  auto t0 = std::chrono::steady_clock::now();
+  for (int i = 0; i < reps; i++) {
+    t.reset();
+    c->in = big;
+    c->inPos = 0;
+    t.parse();
+  }
+  double s = std::chrono::duration<double>(std::chrono::steady_clock::now() - t0).count();
+  printf("putty session: %.3f client calls per byte, %.0f MB/s\n", (double) FakeNet::calls / reps / big.size(), big.size() * reps / s / 1e6);
+}
@@ -0,0 +1,144 @@
+// TelnetSpy record mode: how many lines a 2048 byte backlog keeps as raw
+// text, as raw text with printed timestamps and as records, then replay
+// filters, live filtering and a stalled reader in record mode.
+#include <cassert>
+#include <random>
+#include "TelnetSpy.h"
+
+static const char* const NAMES[] = { "sys", "sensor", "mqtt", "influx", "nws", "power" };
+static const char* LINES[] = {
+  "Gathered Sample #%d", "Sampled 1 sensor(s) in %d us", "Influx: 12 lines / 1460 bytes sent, 0 dropped, %d us per line",
+  "NWS KMIA: unable to connect", "Radio sleep modem: duty cycle 3.%d%%, idle 9870 ms, radio window 130 ms",
+  "BME280 @ 0x76 read failed - sample skipped", "Raw window #%d published (412 bytes)" };
+static const uint8_t LEVEL[] = { 3, 3, 2, 1, 2, 0, 2 };
+static const uint8_t SUB[] = { 1, 1, 3, 4, 5, 1, 2 };
+
+static std::shared_ptr<Conn> dial() {
+  auto c = std::make_shared<Conn>();
+  FakeNet::pending.push_back(c);
+  return c;
+}
+
+static void start(TelnetSpy& t) {
+  t.setSerial(NULL);
+  t.setWelcomeMsg("");
+  t.setPingTime(0);
+  t.begin(115200);
+  t.setSubsystemNames(NAMES, 6);
+}
+
+// 3000 log lines, then the lines a client connecting afterwards is sent
+static int retained(bool record, bool textStamps, bool bursty) {
+  TelnetSpy t;
+  start(t);
+  t.setRecordMode(record);
+  t.handle();
+
+  std::mt19937 r(1);
+  fakeClock = true;
+  fakeMillis = 1000;
+  for (int i = 0; i < 3000; i++) {
+    fakeMillis += bursty ? ((i % 6) ? r() % 4 : 10000) : 200 + r() % 1500;
+    int k = r() % 7;
+    char b[160];
+    int n = textStamps ? snprintf(b, 40, "[%7lu.%03lu] ", fakeMillis / 1000, fakeMillis % 1000) : 0;
+    n += snprintf(b + n, sizeof(b) - n, LINES[k], (int) (r() % 1000));
+    b[n++] = '\r';
+    b[n++] = '\n';
+    int g = bursty ? (i / 6) % 7 : k;
+    t.setRecordTag(LEVEL[g], SUB[g]);
+    t.write((const uint8_t*) b, n);
+  }
+
+  auto c = dial();
+  t.handle();
+  t.flush();
+  for (int i = 0; i < 10; i++) t.handle();
+  return std::count(c->out.begin(), c->out.end(), '\n');
+}
+
+static void checkReplay() {
+  fakeClock = true;
+  fakeMillis = 0;
+  TelnetSpy t;
+  start(t);
+  t.setRecordMode(true);
+  t.handle();
+  for (int i = 0; i < 20; i++) {
+    fakeMillis += 1234;
+    int k = i % 7;
+    char b[160];
+    int n = snprintf(b, sizeof(b), LINES[k], i);
+    t.setRecordTag(LEVEL[k], SUB[k]);
+    t.write((const uint8_t*) b, n);
+    t.println();
+  }
+  t.print("untagged ");
+  t.print(42);
+  t.println();
+
+  auto c = dial();
+  t.handle();
+  t.flush();
+  assert(c->out.find("[     12.340] I influx: Influx:") != std::string::npos);
+  assert(c->out.find("] I sys: untagged 42\r\n") != std::string::npos);
+
+  // ~w: warnings and errors only
+  c->out.clear();
+  c->in += "~w\r\n";
+  t.handle();
+  t.flush();
+  for (size_t p = 0; (p = c->out.find("] ", p)) != std::string::npos; p++) assert(c->out[p + 2] == 'W' || c->out[p + 2] == 'E');
+  assert(c->out.find("W nws: NWS KMIA") != std::string::npos && c->out.find("E sensor: BME280") != std::string::npos);
+
+  // ~d with subsystems by name and by number
+  c->out.clear();
+  c->in += "~d Power,3\r\n";
+  t.handle();
+  t.flush();
+  assert(c->out.find("power:") != std::string::npos && c->out.find("influx:") != std::string::npos && c->out.find("nws:") == std::string::npos);
+
+  // live lines follow the filter
+  c->out.clear();
+  t.setRecordTag(0, 4);
+  t.println("nws live");
+  t.setRecordTag(0, 5);
+  t.println("power live");
+  for (int i = 0; i < 3; i++) t.handle();
+  t.flush();
+  assert(c->out.find("nws live") == std::string::npos && c->out.find("power live") != std::string::npos);
+
+  // a stalled client gets a marker and then whole records
+  auto slow = dial();
+  t.handle();
+  slow->window = 0;
+  c->in += "~\r\n";
+  t.handle();
+  for (int i = 0; i < 300; i++) {
+    t.setRecordTag(2, 1);
+    t.printf("line %d with some text to fill the buffer\n", i);
+    t.handle();
+  }
+  slow->window = 1 << 30;
+  t.handle();
+  t.flush();
+  assert(slow->out.find("bytes dropped]") != std::string::npos && slow->out.find("line 299 with") != std::string::npos);
+  assert(slow->out.compare(slow->out.find("dropped]\r\n") + 10, 1, "[") == 0);
+
+  // a long line is split into records, and a resize keeps whole records
+  t.println(std::string(400, 'x').c_str());
+  t.setBufferSize(512);
+  t.flush();
+  t.handle();
+  fakeClock = false;
+}
+
+int main() {
+  checkReplay();
+  printf("telnet_records: replay ok\n");
+  for (int bursty = 0; bursty < 2; bursty++) {
+    printf("%s: 2048 byte backlog keeps raw %d lines, raw with text timestamps %d, records %d\n",
+           bursty ? "bursts of 6 every 10 s " : "a line every 0.2-1.7 s ",
+           retained(false, false, bursty), retained(false, true, bursty), retained(true, false, bursty));
+  }
+}
@@ -0,0 +1,54 @@
+// TelnetSpy sending: a full send window costs nothing and blocks nothing,
+// the drop marker waits for room ahead of its data, and a short write
+// leaves the rest queued.
+#include <cassert>
+#include "TelnetSpy.h"
+
+int main() {
+  TelnetSpy t;
+  t.setSerial(NULL);
+  t.setWelcomeMsg("");
+  t.setPingTime(0);
+  t.setMinBlockSize(1);
+  t.setCollectingTime(0);
+  t.begin(115200);
+  t.setBufferSize(64);
+
+  // overflow while offline so a marker is pending, with the data wrapping the ring end
+  std::string kept;
+  for (int i = 0; i < 5; i++) {
+    char b[32];
+    int n = snprintf(b, sizeof(b), "line%d-abcdefghij\n", i);
+    t.write((const uint8_t*) b, n);
+    kept = i < 2 ? kept : kept + b;
+  }
+
+  auto c = std::make_shared<Conn>();
+  c->window = 0;
+  FakeNet::pending.push_back(c);
+  t.handle();
+  assert(c->out.empty() && t.getSendStalls() >= 1);
+
+  // the marker does not fit, so the data behind it waits too
+  c->window = 10;
+  t.handle();
+  assert(c->out.empty());
+
+  c->window = 1000;
+  t.handle();
+  char marker[48];
+  snprintf(marker, sizeof(marker), TELNETSPY_DROP_MARKER, (unsigned long) t.getDroppedBytes());
+  assert(c->out == marker + kept);
+
+  // a short write sends what the stack took and keeps the rest
+  c->out.clear();
+  c->cap = 5;
+  t.write((const uint8_t*) "hello world\n", 12);
+  t.handle();
+  assert(c->out == "hello" && t.getPartialWrites() == 1);
+  c->cap = 1 << 30;
+  t.handle();
+  assert(c->out == "hello world\n");
+
+  printf("telnet_send: %u stall(s), %u partial write(s), ok\n", (unsigned) t.getSendStalls(), (unsigned) t.getPartialWrites());
+}
@@ -0,0 +1,94 @@
+// TelnetSpy write path: the ring keeps the youngest data, os_printf bytes
+// arrive through the staging ring, and per-byte against bulk write speed
+// into a full buffer with nobody connected.
+#include <cassert>
+#include "TelnetSpy.h"
+
+struct Spy : TelnetSpy {
+  std::string contents() {
+    std::string r;
+    for (uint32_t i = bufTail; i != bufHead; i++) r += telnetBuf[i & bufMask];
+    return r;
+  }
+  void drain() { drainDebugBuf(); }
+};
+
+// discards what it is given, as fast as it can
+struct NullSerial : HardwareSerial {
+  size_t write(uint8_t) override { return 1; }
+  size_t write(const uint8_t*, size_t n) override { return n; }
+  using Print::write;
+};
+
+static void checkRing() {
+  Spy t;
+  t.setSerial(NULL);
+  assert(t.getBufferSize() == TELNETSPY_BUFFER_LEN);
+  t.setBufferSize(100);
+  assert(t.getBufferSize() == 64);
+
+  for (int i = 0; i < 10; i++) {
+    char b[32];
+    int n = snprintf(b, sizeof(b), "line %02d abcdefghij\r\n", i);
+    t.write((const uint8_t*) b, n);
+  }
+  std::string d = t.contents();
+  assert(d.size() <= 64 && d.compare(0, 5, "line ") == 0 && d.find("line 09") != std::string::npos);
+
+  t.write('X');
+  t.debugWrite('D');
+  t.debugWrite('E');
+  t.drain();
+  d = t.contents();
+  assert(d.substr(d.size() - 3) == "XDE");
+
+  // shrinking keeps the youngest bytes, growing keeps them all
+  t.setMinBlockSize(1);
+  t.setBufferSize(32);
+  d = t.contents();
+  assert(d.size() == 32 && d.substr(29) == "XDE");
+  t.setBufferSize(256);
+  assert(t.contents().size() == 32);
+
+  // a block larger than the ring keeps its youngest bytes
+  std::string big(1000, 'z');
+  big += "END";
+  t.write((const uint8_t*) big.data(), big.size());
+  d = t.contents();
+  assert(d.size() == 256 && d.substr(253) == "END");
+
+  t.clearBuffer();
+  assert(t.contents().empty());
+  for (int i = 0; i < 300; i++) t.debugWrite('q');
+  t.drain();
+  assert(t.contents().size() == 256);
+}
+
+static void benchWrite() {
+  NullSerial uart;
+  TelnetSpy t;
+  t.setSerial(&uart);
+
+  const char* line = "Normalized Result (Published) - BME280 @ 0x76 t=72.31 h=44.2\n";
+  const size_t len = strlen(line);
+  const size_t iters = 2000000;
+
+  for (int bulk = 0; bulk < 2; bulk++) {
+    auto t0 = std::chrono::steady_clock::now();
+    for (size_t i = 0; i < iters; i++) {
+      if (bulk) {
+        t.write((const uint8_t*) line, len);
+      } else {
+        for (size_t j = 0; j < len; j++) t.write((uint8_t) line[j]);
+      }
+    }
+    double s = std::chrono::duration<double>(std::chrono::steady_clock::now() - t0).count();
+    printf("%s: %.0f MB/s\n", bulk ? "bulk write(const uint8_t*, n)" : "per-byte write(uint8_t)     ", iters * len / s / 1e6);
+  }
+}
+
+int main() {
+  checkRing();
+  printf("telnet_write: ring checks ok\n");
+  benchWrite();
+}